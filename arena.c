@@ -0,0 +1,275 @@
+/*
+  \file   	arena.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.1
+  \brief  	Static arena handing out the large buffers of the phases of a game. The
+  			buffers of different phases share the same bytes, the bytes left free by the
+  			audio buffers extend the capture ring.
+*/
+
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "arena.h"
+#include "audio_processing.h"
+#include "capture.h"
+#include "process_image.h"
+#include "trajectory.h"
+
+
+typedef struct {
+	uint32_t size;
+	uint8_t phases;			// ARENA_IN() of the phases using the buffer
+	uint32_t offset;		// set by arena_start
+} arena_entry_t;
+
+static arena_entry_t entries[ARENA_NB_BUFFERS] = {
+	[ARENA_AUDIO] = {sizeof(audio_buffers_t), ARENA_IN(ARENA_CALIBRATION) | ARENA_IN(ARENA_RACE)
+											  | ARENA_IN(ARENA_RETURN_CALIBRATION)},
+	[ARENA_IMAGE] = {IMAGE_BUFFER_SIZE, ARENA_IN(ARENA_RACE) | ARENA_IN(ARENA_RETURN)
+										| ARENA_IN(ARENA_RETURN_CALIBRATION)},
+	[ARENA_ROUTE] = {RETURN_MAX_POINTS * sizeof(traj_point_t), ARENA_IN(ARENA_RETURN)
+															   | ARENA_IN(ARENA_RETURN_CALIBRATION)},
+	[ARENA_CAPTURE] = {CAPTURE_RING_ARENA_SIZE, ARENA_IN(ARENA_SETUP) | ARENA_IN(ARENA_RETURN)},
+};
+
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+static uint32_t layoutSize = 0;
+static bool layoutValid = FALSE;
+
+static arena_phase_t phase = ARENA_SETUP;
+static bool pending = FALSE;		// a phase change waits for the users
+static uint8_t users = 0;			// buffers acquired and not released
+static uint32_t peak = 0;
+static MUTEX_DECL(arena_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(arena_cond); // @suppress("Field cannot be resolved")
+
+static bool arena_overlap(uint32_t offset, uint32_t size, const arena_entry_t *placed);
+static uint32_t arena_phase_used(arena_phase_t p);
+static void arena_lend_capture(arena_phase_t p);
+
+
+/*
+*	Function to place the buffers in the arena, once before the threads using them.
+*	Each buffer takes the lowest offset free in all of its phases.
+*/
+void arena_start(void) {
+	uint32_t offset, candidate, end;
+	bool free;
+
+	layoutSize = 0;
+
+	for(uint8_t i = 0; i < ARENA_NB_BUFFERS; i++) {
+		arena_entry_t *e = &entries[i];
+		offset = UINT32_MAX;
+
+		// Candidates: the start of the arena and the end of each placed buffer
+		for(int8_t j = -1; j < i; j++) {
+			candidate = (j < 0) ? 0 : entries[j].offset + entries[j].size;
+			candidate = (candidate + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+			free = TRUE;
+
+			for(uint8_t k = 0; k < i; k++) {
+				if((entries[k].phases & e->phases) && arena_overlap(candidate, e->size, &entries[k])) {
+					free = FALSE;
+					break;
+				}
+			}
+
+			if(free && (candidate < offset)) {
+				offset = candidate;
+			}
+		}
+
+		e->offset = offset;
+		end = offset + e->size;
+
+		if(end > layoutSize) {
+			layoutSize = end;
+		}
+	}
+
+	layoutValid = (layoutSize <= ARENA_SIZE);
+	peak = arena_phase_used(phase);
+	arena_lend_capture(phase);
+}
+
+
+/*
+*	Function to change the phase. The buffers of the previous phase are reclaimed,
+*	it waits till they are released. The users asking for a buffer meanwhile wait
+*	for the new phase, or get none with arena_try_acquire.
+*
+*	params :
+*	arena_phase_t newPhase		phase entered
+*/
+void arena_enter(arena_phase_t newPhase) {
+	arena_report_t report;
+
+	chMtxLock(&arena_lock);
+	pending = TRUE;
+
+	while(users > 0) {
+		chCondWait(&arena_cond);
+	}
+
+	chMtxUnlock(&arena_lock);
+
+	// The capture ring moves before its bytes go to the buffers of the new phase. It may
+	// wait for a write on the USB serial, the lock is free meanwhile.
+	arena_lend_capture(newPhase);
+
+	chMtxLock(&arena_lock);
+	phase = newPhase;
+	pending = FALSE;
+
+	if(arena_phase_used(newPhase) > peak) {
+		peak = arena_phase_used(newPhase);
+	}
+
+	chCondBroadcast(&arena_cond);
+	chMtxUnlock(&arena_lock);
+
+	arena_get_report(&report);
+	capture_send(CAPTURE_ARENA, &report, sizeof(report));
+}
+
+
+/*
+*	Function to get the current phase.
+*/
+arena_phase_t arena_get_phase(void) {
+	return phase;
+}
+
+
+/*
+*	Function to get a buffer for one unit of work, it must be released after.
+*	During a phase change it waits for the new phase.
+*
+*	params :
+*	arena_buffer_t buffer		buffer asked
+*
+*	Returns NULL if the buffer isn't used in the current phase.
+*/
+void *arena_acquire(arena_buffer_t buffer) {
+	void *ptr = NULL;
+
+	chMtxLock(&arena_lock);
+
+	while(pending) {
+		chCondWait(&arena_cond);
+	}
+
+	if(layoutValid && (entries[buffer].phases & ARENA_IN(phase))) {
+		users++;
+		ptr = &arena[entries[buffer].offset];
+	}
+
+	chMtxUnlock(&arena_lock);
+
+	return ptr;
+}
+
+
+/*
+*	Function to get a buffer without waiting, for the callers which can't be blocked
+*	(the audio callback). It must be released after.
+*
+*	params :
+*	arena_buffer_t buffer		buffer asked
+*
+*	Returns NULL if the buffer isn't used in the current phase, during a phase change or
+*	if the arena is busy.
+*/
+void *arena_try_acquire(arena_buffer_t buffer) {
+	void *ptr = NULL;
+
+	if(!chMtxTryLock(&arena_lock)) {
+		return NULL;
+	}
+
+	if(layoutValid && !pending && (entries[buffer].phases & ARENA_IN(phase))) {
+		users++;
+		ptr = &arena[entries[buffer].offset];
+	}
+
+	chMtxUnlock(&arena_lock);
+
+	return ptr;
+}
+
+
+/*
+*	Function to release a buffer given by arena_acquire or arena_try_acquire.
+*
+*	params :
+*	arena_buffer_t buffer		buffer released
+*/
+void arena_release(arena_buffer_t buffer) {
+	(void) buffer;
+
+	chMtxLock(&arena_lock);
+	users--;
+
+	if(users == 0) {
+		chCondBroadcast(&arena_cond);
+	}
+
+	chMtxUnlock(&arena_lock);
+}
+
+
+/*
+*	Function to get the usage of the arena.
+*
+*	params :
+*	arena_report_t *report		receives the usage
+*/
+void arena_get_report(arena_report_t *report) {
+	chMtxLock(&arena_lock);
+	report->phase = phase;
+	report->used = arena_phase_used(phase);
+	report->peak = peak;
+	report->size = layoutSize;
+	chMtxUnlock(&arena_lock);
+}
+
+
+/*
+*	Checks if [offset, offset + size) intersects a placed buffer.
+*/
+static bool arena_overlap(uint32_t offset, uint32_t size, const arena_entry_t *placed) {
+	return (offset < placed->offset + placed->size) && (placed->offset < offset + size);
+}
+
+
+/*
+*	Bytes of the buffers of a phase.
+*/
+static uint32_t arena_phase_used(arena_phase_t p) {
+	uint32_t used = 0;
+
+	for(uint8_t i = 0; i < ARENA_NB_BUFFERS; i++) {
+		if(entries[i].phases & ARENA_IN(p)) {
+			used += entries[i].size;
+		}
+	}
+
+	return used;
+}
+
+
+/*
+*	Gives the capture buffer of a phase to the capture ring, or takes it back.
+*/
+static void arena_lend_capture(arena_phase_t p) {
+	if(layoutValid && (entries[ARENA_CAPTURE].phases & ARENA_IN(p))) {
+		capture_set_ring(&arena[entries[ARENA_CAPTURE].offset], entries[ARENA_CAPTURE].size);
+	} else {
+		capture_set_ring(NULL, 0);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+
+
+#define ARENA_SIZE			54656		// Bytes shared by the buffers of the phases, the return
+										// of a tournament needs audio_buffers_t (52 KB) for the
+										// calibration, the image row and the route
+#define ARENA_ALIGN			8			// Alignment of the buffers in bytes
+
+// Phases of a game, each one has its own set of buffers
+typedef enum {
+	ARENA_SETUP = 0,		// selection of the players, waiting between the players
+	ARENA_CALIBRATION,		// voice calibration of a player
+	ARENA_RACE,				// game of a player till the finish line
+	ARENA_RETURN,			// return to the start line
+	ARENA_RETURN_CALIBRATION,	// return of a tournament, the next player is calibrated
+	ARENA_NB_PHASES,
+} arena_phase_t;
+
+#define ARENA_IN(phase)		(1 << (phase))
+
+// Buffers of the arena. Two buffers which never live in the same phase share their bytes.
+typedef enum {
+	ARENA_AUDIO = 0,		// audio_buffers_t, FFT of the four microphones
+	ARENA_IMAGE,			// uint8_t[IMAGE_BUFFER_SIZE], row given to detect_line
+	ARENA_ROUTE,			// traj_point_t[RETURN_MAX_POINTS], route of the fast return
+	ARENA_CAPTURE,			// uint8_t[CAPTURE_RING_ARENA_SIZE], lent to the capture ring
+	ARENA_NB_BUFFERS,
+} arena_buffer_t;
+
+// Usage sent in the CAPTURE_ARENA stream at each phase change
+typedef struct __attribute__((packed)) {
+	uint8_t phase;			// arena_phase_t entered
+	uint32_t used;			// bytes of the buffers of the phase
+	uint32_t peak;			// max of used over the phases entered since the start
+	uint32_t size;			// bytes reserved by the layout of all the phases, size - used
+							// is free during the phase
+} arena_report_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void arena_start(void);
+void arena_enter(arena_phase_t phase);
+arena_phase_t arena_get_phase(void);
+void *arena_acquire(arena_buffer_t buffer);
+void *arena_try_acquire(arena_buffer_t buffer);
+void arena_release(arena_buffer_t buffer);
+void arena_get_report(arena_report_t *report);
+
+
+#endif /* ARENA_H */
@@ -2,19 +2,32 @@
   \file   	audio_processing.c
   \author 	Antoine Duret & Carla Schmid (Group G08)
   \date   	16.05.2021
-  \version	2.2
+  \version	2.4
   \brief  	Code for audio processing related tasks
 */
 
 #include <arm_math.h>
 #include <arm_const_structs.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include "ch.h"
 #include "hal.h"
 
+#include "arena.h"
 #include "audio_processing.h"
+#include "capture.h"
+#include "game.h"
 #include "main.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "periodic.h"
+#include "profiling.h"
+#include "proximity_sensors.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "trajectory.h"
+#include "tuning.h"
 
 #include "audio/microphone.h"
 #include "motors.h"
@@ -25,24 +38,92 @@
 /* 						    (with small additions and changes)							*/
 /*======================================================================================*/
 
-// 2 times FFT_SIZE because these arrays contain complex numbers (real + imaginary)
-static float micLeft_cmplx_input[2 * FFT_SIZE];
-static float micRight_cmplx_input[2 * FFT_SIZE];
-static float micFront_cmplx_input[2 * FFT_SIZE];
-static float micBack_cmplx_input[2 * FFT_SIZE];
-
-// Arrays containing the computed magnitude of the complex numbers
-static float micLeft_output[FFT_SIZE];
-static float micRight_output[FFT_SIZE];
-static float micFront_output[FFT_SIZE];
-static float micBack_output[FFT_SIZE];
-static float four_mics_output[FFT_SIZE];
-
-// Variables used to control the audio command and voice calibration
+// Variables used to control the audio command and voice calibration, set by the game state
+// machine
 static bool audio_command = 0;
 static bool voice_calibration = 0;
+static bool noise_measurement = 0;
 static uint8_t mid_freq = MID_FREQ;
 
+// Spectrum of the motors measured while the e-puck drives back, removed from the voice
+// calibration of a tournament
+static float motorNoise[MAX_FREQ + 1];
+static int16_t motorNoiseFrames = 0;		// negative for the frames left out at the start
+
+// Steering: last peak found by sound_remote, applied to the motors by the steering thread
+static int16_t peak_index = -1;		// peak_index, new_peak and peakTrace under the system lock
+static bool new_peak = FALSE;
+static trace_t frameTrace;			// mic block completing the FFT frame being processed
+static trace_t peakTrace;			// frame of the peak
+static BSEMAPHORE_DECL(peak_sem, TRUE);
+static int16_t leftSpeed = 0;
+static int16_t rightSpeed = 0;
+static periodic_task_t steeringTask;
+
+static void steering_pid(int16_t index);
+static void motor_noise_update(const float *data);
+
+
+// Thread applying the audio command to the motors on each peak found by sound_remote
+static THD_WORKING_AREA(steering_thd_wa, 512);
+static THD_FUNCTION(steering_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	int16_t leftCmd, rightCmd, index;
+	bool peak;
+	trace_t trace;
+
+	periodic_init(&steeringTask, "steering", STEERING_PEAK_PERIOD);
+
+	while(1) {
+		// Woken up by the peaks, and between them to follow the obstacles
+		chBSemWaitTimeout(&peak_sem, MS2ST(STEERING_PERIOD));
+
+		chSysLock();
+		peak = new_peak;
+		index = peak_index;
+		trace = peakTrace;
+		peakTrace.id = 0;
+		new_peak = FALSE;
+		chSysUnlock();
+
+		// A peak of the end of the race never reaches the motors
+		if(!audio_command) {
+			trace_drop(&trace);
+			motor_arbiter_release(MOTOR_SRC_STEERING);
+			leftSpeed = 0;
+			rightSpeed = 0;
+			continue;
+		}
+
+		// Without a new peak, only the obstacle avoidance changes the command
+		if(!peak && (get_obst_mode() != OBST_AVOIDANCE)) {
+			continue;
+		}
+
+		PROF_START(PROF_STEERING);
+
+		if(peak) {
+			periodic_event(&steeringTask);
+			steering_pid(index);
+		}
+
+		leftCmd = leftSpeed;
+		rightCmd = rightSpeed;
+
+		// Repulsion of the obstacles blended into the audio command
+		if(get_obst_mode() == OBST_AVOIDANCE) {
+			obstacle_avoidance(&leftCmd, &rightCmd);
+		}
+
+		PROF_STOP(PROF_STEERING);
+
+		motor_arbiter_request_traced(MOTOR_SRC_STEERING, leftCmd, rightCmd, &trace);
+		trajectory_command(leftCmd, rightCmd);
+	}
+}
+
 
 /*
 *	Callback called when the demodulation of the four microphones is done.
@@ -59,21 +140,34 @@ void process_audio_data(int16_t *data, uint16_t num_samples) {
 	*	So we fill the samples buffers to reach 1024 samples, then we compute the FFTs.
 	*/
 	static uint16_t nb_samples = 0;
+	audio_buffers_t *buffers;
+
+	// Only the block completing a frame is traced, the others just wait in the buffers
+	trace_stamp(&frameTrace, TRACE_MIC_MOTOR);
+
+	capture_send(CAPTURE_MIC, data, num_samples * sizeof(int16_t));
+
+	// The buffers only exist during the calibration and the race. The callback never
+	// waits: the frame is dropped during a phase change.
+	if((buffers = arena_try_acquire(ARENA_AUDIO)) == NULL) {
+		nb_samples = 0;
+		return;
+	}
 
 	// Loop to fill the buffers
 	for(uint16_t i = 0 ; i < num_samples ; i += 4) {
 		// Construct an array of complex numbers. Put 0 to the imaginary part
-		micRight_cmplx_input[nb_samples] = (float)data[i + MIC_RIGHT];
-		micLeft_cmplx_input[nb_samples]  = (float)data[i + MIC_LEFT];
-		micBack_cmplx_input[nb_samples]  = (float)data[i + MIC_BACK];
-		micFront_cmplx_input[nb_samples] = (float)data[i + MIC_FRONT];
+		buffers->micRight_cmplx_input[nb_samples] = (float)data[i + MIC_RIGHT];
+		buffers->micLeft_cmplx_input[nb_samples]  = (float)data[i + MIC_LEFT];
+		buffers->micBack_cmplx_input[nb_samples]  = (float)data[i + MIC_BACK];
+		buffers->micFront_cmplx_input[nb_samples] = (float)data[i + MIC_FRONT];
 
 		nb_samples++;
 
-		micRight_cmplx_input[nb_samples] = 0;
-		micLeft_cmplx_input[nb_samples]  = 0;
-		micBack_cmplx_input[nb_samples]  = 0;
-		micFront_cmplx_input[nb_samples] = 0;
+		buffers->micRight_cmplx_input[nb_samples] = 0;
+		buffers->micLeft_cmplx_input[nb_samples]  = 0;
+		buffers->micBack_cmplx_input[nb_samples]  = 0;
+		buffers->micFront_cmplx_input[nb_samples] = 0;
 
 		nb_samples++;
 
@@ -84,48 +178,65 @@ void process_audio_data(int16_t *data, uint16_t num_samples) {
 	}
 
 	if(nb_samples >= (2 * FFT_SIZE)) {
+		PROF_START(PROF_AUDIO_FRAME);
+		PROF_START(PROF_AUDIO_FFT);
+
 		/*
 		*	- FFT processing -
 		*	This FFT function stores the results in the input buffer given.
 		*	This is an "In Place" function. 
 		*/
-		doFFT_optimized(FFT_SIZE, micLeft_cmplx_input);
-		doFFT_optimized(FFT_SIZE, micRight_cmplx_input);
-		doFFT_optimized(FFT_SIZE, micBack_cmplx_input);
-		doFFT_optimized(FFT_SIZE, micFront_cmplx_input);
+		doFFT_optimized(FFT_SIZE, buffers->micLeft_cmplx_input);
+		doFFT_optimized(FFT_SIZE, buffers->micRight_cmplx_input);
+		doFFT_optimized(FFT_SIZE, buffers->micBack_cmplx_input);
+		doFFT_optimized(FFT_SIZE, buffers->micFront_cmplx_input);
+
+		PROF_STOP(PROF_AUDIO_FFT);
+		PROF_START(PROF_AUDIO_MAG);
 
 		/*
 		*	- Magnitude processing -
 		*	Computes the magnitude of the complex numbers and stores them
 		*	in a buffer of FFT_SIZE because it only contains real numbers.
 		*/
-		arm_cmplx_mag_f32(micLeft_cmplx_input,  micLeft_output,  FFT_SIZE);
-		arm_cmplx_mag_f32(micRight_cmplx_input, micRight_output, FFT_SIZE);
-		arm_cmplx_mag_f32(micBack_cmplx_input,  micBack_output,  FFT_SIZE);
-		arm_cmplx_mag_f32(micFront_cmplx_input, micFront_output, FFT_SIZE);
+		arm_cmplx_mag_f32(buffers->micLeft_cmplx_input,  buffers->micLeft_output,  FFT_SIZE);
+		arm_cmplx_mag_f32(buffers->micRight_cmplx_input, buffers->micRight_output, FFT_SIZE);
+		arm_cmplx_mag_f32(buffers->micBack_cmplx_input,  buffers->micBack_output,  FFT_SIZE);
+		arm_cmplx_mag_f32(buffers->micFront_cmplx_input, buffers->micFront_output, FFT_SIZE);
+
+		PROF_STOP(PROF_AUDIO_MAG);
+		PROF_START(PROF_AUDIO_VOICE);
+
+		// Average of the 4 microphones, used to register the voice and to pilot the robot
+		if(voice_calibration || audio_command || noise_measurement) {
+			mics_average(buffers->micLeft_output, buffers->micRight_output, buffers->micFront_output,
+						 buffers->micBack_output, buffers->four_mics_output, FFT_SIZE);
+		}
 
-		// During the voice calibration: Take average of the 4 microphones to register sound.
-		if((voice_calibration)) {
-			for(uint16_t i = 0; i < FFT_SIZE; i++) {
-				four_mics_output[i] = (micLeft_output[i] + micRight_output[i]
-										+ micFront_output[i] + micBack_output[i])/4.0;
-			}
+		// Before the calibration of a tournament: noise of the motors driving back
+		if(noise_measurement) {
+			motor_noise_update(buffers->four_mics_output);
+		}
 
-			player_voice_calibration(four_mics_output);
+		// During the voice calibration: register sound.
+		if((voice_calibration)) {
+			player_voice_calibration(buffers->four_mics_output);
 		}
 
 		nb_samples = 0;
 
-		// During audio command: Take the average of the 4 microphones to pilot the robot.
+		// During audio command: pilot the robot.
 		if(audio_command) {
-			for(uint16_t i = 0; i < FFT_SIZE; i++) {
-				four_mics_output[i] = (micLeft_output[i] + micRight_output[i]
-										+ micFront_output[i] + micBack_output[i])/4.0;
-			}
-
-			sound_remote(four_mics_output);
+			sound_remote(buffers->four_mics_output);
 		}
+
+		PROF_STOP(PROF_AUDIO_VOICE);
+		PROF_STOP(PROF_AUDIO_FRAME);
 	}
+
+	// Blocks not completing a frame, or frames without audio command, end nowhere
+	frameTrace.id = 0;
+	arena_release(ARENA_AUDIO);
 }
 
 
@@ -143,23 +254,56 @@ void doFFT_optimized(uint16_t size, float* complex_buffer) {
 /* 									 NEW FUNCTIONS										*/
 /*======================================================================================*/
 
+/*
+*	Average of the magnitudes of the four microphones.
+*
+*	params :
+*	const float* left		*
+*	const float* right		* magnitudes computed for each microphone
+*	const float* front		*
+*	const float* back		*
+*	float* output			array receiving the average
+*	uint16_t size			number of values
+*/
+void mics_average(const float* left, const float* right, const float* front, const float* back,
+				  float* output, uint16_t size) {
+	for(uint16_t i = 0; i < size; i++) {
+		output[i] = (left[i] + right[i] + front[i] + back[i]) * 0.25f;
+	}
+}
+
+
 /*
 *	Function defined to do the voice calibration for each player before their game.
+*	In a tournament it runs while the e-puck drives back, the spectrum of the motors
+*	measured since the start of the return is removed while they turn.
 *
 *	params :
 *	float* data			pointer to an array containing the computed average magnitude of the cpx
 *						numbers for four mics
 */
 void player_voice_calibration(float* data) {
-	uint16_t max_norm = MIN_VALUE_THRESHOLD;
+	static tuning_t tuning;
+	static uint32_t tuningVersion = 0;
+	uint16_t max_norm;
 	int16_t max_norm_index = -1;
 	static uint16_t ind_sample = 0;
 	static uint16_t average_freq = 0;
+	int16_t speeds[2];
+	bool driving;
+	float value;
+
+	tuning_update(&tuning, &tuningVersion);
+	max_norm = tuning.minValueThreshold;
+	motor_arbiter_get_output(&speeds[0], &speeds[1]);
+	driving = (speeds[0] != 0) || (speeds[1] != 0);
 
 	// Search for the highest peak
 	for(uint16_t i = MIN_FREQ ; i <= MAX_FREQ ; i++) {
-		if(data[i] > max_norm) {
-			max_norm = data[i];
+		value = driving ? (data[i] - motorNoise[i]) : data[i];
+
+		if(value > max_norm) {
+			max_norm = value;
 			max_norm_index = i;
 		}
 	}
@@ -174,7 +318,7 @@ void player_voice_calibration(float* data) {
 	if(ind_sample == NB_SAMPLES) {
 		average_freq = (average_freq/ind_sample);
 		mid_freq = average_freq;
-		voice_calibration = FALSE;
+		game_post(GAME_EV_CALIBRATED);
 
 		// Reset the average_freq to 0 for next calibration.
 		average_freq = 0;
@@ -184,18 +328,57 @@ void player_voice_calibration(float* data) {
 
 
 /*
-*	Simple function used to detect the highest value in a buffer and to execute a motor
-*	command depending on it. PID control for fine audio command.
+*	Adds a frame to the noise of the motors in the band of the voice calibration. The
+*	frames with the e-puck standing still are left out. The wheels are heard over the whole
+*	band at the speed of the return, not only at their step rate.
+*
+*	params :
+*	const float *data		average magnitude of the four mics
+*/
+static void motor_noise_update(const float *data) {
+	int16_t left, right;
+
+	motor_arbiter_get_output(&left, &right);
+
+	if((left == 0) && (right == 0)) {
+		return;
+	}
+
+	if(motorNoiseFrames < 0) {
+		motorNoiseFrames++;
+		return;
+	}
+
+	for(uint16_t i = MIN_FREQ; i <= MAX_FREQ; i++) {
+		// The first frame starts the average
+		if(motorNoiseFrames == 0) {
+			motorNoise[i] = data[i];
+		} else {
+			motorNoise[i] += (data[i] - motorNoise[i]) / (1 << MOTOR_NOISE_SHIFT);
+		}
+	}
+
+	motorNoiseFrames++;
+}
+
+
+/*
+*	Simple function used to detect the highest value in a buffer around the calibrated
+*	frequency. The peak is given to the steering thread which computes the motor command.
 *
 *	params :
 *	float* data			pointer to an array containing the computed average magnitude of the cpx
 *						numbers for four mics
 */
 void sound_remote(float* data) {
-	int16_t error = 0, max_norm_index = -1, deriv_error = 0;
-	uint16_t max_norm = MIN_VALUE_THRESHOLD;
-	float speed = 0;
-	static int16_t sum_error = 0, previous_error = 0;
+	int16_t max_norm_index = -1;
+	uint16_t max_norm;
+	static tuning_t tuning;
+	static uint32_t tuningVersion = 0;
+	trace_t previous;
+
+	tuning_update(&tuning, &tuningVersion);
+	max_norm = tuning.minValueThreshold;
 
 	// Search for the highest peak
 	for(uint16_t i = mid_freq - HALF_BW ; i <= mid_freq + HALF_BW ; i++) {
@@ -205,43 +388,93 @@ void sound_remote(float* data) {
 		}
 	}
 
+	// The peak of the previous frame may not have been used by the steering yet
+	chSysLock();
+	previous = peakTrace;
+	peakTrace = frameTrace;
+	peak_index = max_norm_index;
+	new_peak = TRUE;
+	chSysUnlock();
+	frameTrace.id = 0;
+	trace_drop(&previous);
+
+	chBSemSignal(&peak_sem);
+}
+
+
+/*
+*	Function to start the THREAD applying the audio command to the motors.
+*/
+void steering_start(void) {
+	monitor_thread_create(steering_thd_wa, sizeof(steering_thd_wa), NORMALPRIO, steering_thd, NULL);
+}
+
+
+/*
+*	PID control for fine audio command, updated for each new peak.
+*
+*	params :
+*	int16_t index		index of the detected peak (-1 if no peak was found)
+*/
+static void steering_pid(int16_t index) {
+	int16_t error = 0, deriv_error = 0;
+	float speed = 0;
+	// 32 bits: the ARW limit GAME_SPEED / KI exceeds INT16_MAX for the small KI
+	static int32_t sum_error = 0;
+	static int16_t previous_error = 0;
+	static tuning_t tuning;
+	static uint32_t tuningVersion = 0;
+	telemetry_steering_t telemetry;
+
+	tuning_update(&tuning, &tuningVersion);
+
 	// PID regulator implementation on the speed for fine audio control.
 	// Error determined by the difference between the mid_freq (voice calibration)
 	// and the control frequency.
-	if((max_norm_index == -1) || (audio_command == FALSE)) {
-		left_motor_set_speed(0);
-		right_motor_set_speed(0);
+	if(index == -1) {
+		leftSpeed = 0;
+		rightSpeed = 0;
 		sum_error = 0;
 	} else {
-		error = max_norm_index - mid_freq;
+		error = index - mid_freq;
 		sum_error += error;
 		deriv_error = error - previous_error;
 		previous_error = error;
 
 		// ARW
-		if(abs(sum_error) > MAX_SUM_ERROR) {
+		if(abs(sum_error) > tuning.maxSumError) {
 			if(sum_error > 0) {
-				sum_error = MAX_SUM_ERROR;
+				sum_error = tuning.maxSumError;
 			} else {
-				sum_error = - MAX_SUM_ERROR;
+				sum_error = - tuning.maxSumError;
 			}
 		}
 
-		speed = KP * error + KI * sum_error + KD * deriv_error;
+		speed = tuning.kp * error + tuning.ki * sum_error + tuning.kd * deriv_error;
 
 		// Peak at a lower frequency than middle frequency : turn left / higher : turn right
 		if(abs(error) < ERROR_THRESHOLD) {
-			left_motor_set_speed(GAME_SPEED);
-			right_motor_set_speed(GAME_SPEED);
+			leftSpeed = tuning.gameSpeed;
+			rightSpeed = tuning.gameSpeed;
 			sum_error = 0;
 		} else if(error < 0) {
-			left_motor_set_speed(GAME_SPEED + speed);
-			right_motor_set_speed(GAME_SPEED);
+			leftSpeed = tuning.gameSpeed + speed;
+			rightSpeed = tuning.gameSpeed;
 		} else {
-			left_motor_set_speed(GAME_SPEED);
-			right_motor_set_speed(GAME_SPEED - speed);
+			leftSpeed = tuning.gameSpeed;
+			rightSpeed = tuning.gameSpeed - speed;
 		}
 	}
+
+	telemetry.peak = index;
+	telemetry.midFreq = mid_freq;
+	telemetry.error = error;
+	telemetry.sumError = sum_error;
+	telemetry.derivError = deriv_error;
+	telemetry.speed = speed;
+	telemetry.leftSpeed = leftSpeed;
+	telemetry.rightSpeed = rightSpeed;
+	capture_send(CAPTURE_STEERING, &telemetry, sizeof(telemetry));
 }
 
 
@@ -253,6 +486,11 @@ void sound_remote(float* data) {
 */
 void status_audio_command(bool status) {
 	audio_command = status;
+
+	// The last command of the steering must not outlive it
+	if(!status) {
+		motor_arbiter_release(MOTOR_SRC_STEERING);
+	}
 }
 
 
@@ -268,8 +506,20 @@ void status_voice_calibration(bool status) {
 
 
 /*
-*	Function to get the voice calibration control status.
+*	Function to control the measurement of the motor noise, it starts again from no noise.
+*
+*	params :
+*	bool status		status value TRUE or FALSE
 */
-bool get_status_voice_calibration(void) {
-	return voice_calibration;
+void status_motor_noise(bool status) {
+	if(status && !noise_measurement) {
+		// The frame being filled still holds the sound of the race
+		motorNoiseFrames = -1;
+
+		for(uint8_t i = 0; i <= MAX_FREQ; i++) {
+			motorNoise[i] = 0;
+		}
+	}
+
+	noise_measurement = status;
 }
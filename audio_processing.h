@@ -7,18 +7,38 @@
 
 // Frequency domain parameters & FFT parameters
 #define FFT_SIZE 				1024
+#define AUDIO_SAMPLE_RATE		16000	// [Hz]
 #define MIN_VALUE_THRESHOLD		10000	// Threshold for audio command intensity
 #define MID_FREQ				15		// Frequency used when voice calibration is turned off
 #define MIN_FREQ				8		// Lowest acceptable frequency for voice calibration
 #define MAX_FREQ				22		// Highest acceptable frequency for voice calibration
 #define HALF_BW					5		// Half of the voice command range
+#define MOTOR_NOISE_SHIFT		3		// Each frame weighs 1/2^3 in the measured motor noise
 #define	ERROR_THRESHOLD			0.1f
 
-// PID regulator parameters (tuned manually)
+// PID regulator parameters (tuned manually, defaults of the parameters in tuning.c)
 #define KP 						200
 #define KD						2
 #define KI 						2.25f
 #define MAX_SUM_ERROR			(GAME_SPEED/KI)		// ARW implementation
+#define STEERING_PERIOD			10		// Refresh of the obstacle avoidance between two peaks in [ms]
+#define STEERING_PEAK_PERIOD	(FFT_SIZE * 1000 / AUDIO_SAMPLE_RATE)	// One peak per frame [ms]
+
+// Buffers of the FFT, handed out by the arena during the calibration and the race
+typedef struct {
+	// 2 times FFT_SIZE because these arrays contain complex numbers (real + imaginary)
+	float micLeft_cmplx_input[2 * FFT_SIZE];
+	float micRight_cmplx_input[2 * FFT_SIZE];
+	float micFront_cmplx_input[2 * FFT_SIZE];
+	float micBack_cmplx_input[2 * FFT_SIZE];
+
+	// Arrays containing the computed magnitude of the complex numbers
+	float micLeft_output[FFT_SIZE];
+	float micRight_output[FFT_SIZE];
+	float micFront_output[FFT_SIZE];
+	float micBack_output[FFT_SIZE];
+	float four_mics_output[FFT_SIZE];
+} audio_buffers_t;
 
 typedef enum {
 	// 2 times FFT_SIZE because these arrays contain complex numbers (real + imaginary)
@@ -41,11 +61,14 @@ void doFFT_optimized(uint16_t size, float* complex_buffer);
 /*======================================================================================*/
 /* 								NEW FUNCTIONS DEFINED									*/
 /*======================================================================================*/
+void mics_average(const float* left, const float* right, const float* front, const float* back,
+				  float* output, uint16_t size);
 void player_voice_calibration(float* data);
 void sound_remote(float* data);
+void steering_start(void);
 void status_audio_command(bool status);
 void status_voice_calibration(bool status);
-bool get_status_voice_calibration(void);
+void status_motor_noise(bool status);
 
 
 #endif /* AUDIO_PROCESSING_H */
@@ -0,0 +1,317 @@
+/*
+  \file   	capture.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.1
+  \brief  	Recording of the sensor data over the USB serial, to replay a game on the
+  			host build
+*/
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include <usbcfg.h>
+
+#include "capture.h"
+#include "main.h"
+#include "monitor.h"
+
+#include "sensors/proximity.h"
+#include "sensors/VL53L0X/VL53L0X.h"
+#include "selector.h"
+
+
+// Chunks waiting to be written on the USB serial, in the own ring or in the bytes lent
+// by the arena
+static uint8_t ownRing[CAPTURE_RING_SIZE];
+static uint8_t *ring = ownRing;
+static uint16_t ringSize = CAPTURE_RING_SIZE;
+static uint16_t ringRead = 0;
+static uint16_t ringWrite = 0;
+static bool writing = FALSE;		// the writer thread reads the ring without the lock
+static uint8_t *nextRing = NULL;	// ring waiting for the end of the write
+static uint16_t nextSize = 0;
+static MUTEX_DECL(ring_lock); // @suppress("Field cannot be resolved")
+static BSEMAPHORE_DECL(ring_sem, TRUE);
+static BSEMAPHORE_DECL(swap_sem, TRUE);
+
+static uint16_t captureStreams = CAPTURE_DEFAULT_STREAMS;
+static uint8_t seq[CAPTURE_NB_STREAMS] = {0};
+static uint32_t dropped = 0;
+static uint16_t crcTable[256];
+
+static void ring_put(const void *data, uint16_t len);
+static void ring_swap(void);
+
+
+// Thread writing the chunks on the USB serial, the producers never wait for the host
+static THD_WORKING_AREA(capture_write_thd_wa, 256);
+static THD_FUNCTION(capture_write_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	uint8_t *data;
+	uint16_t used;
+
+	while(1) {
+		chBSemWait(&ring_sem);
+		chMtxLock(&ring_lock);
+
+		while(ringRead != ringWrite) {
+			// Contiguous part of the ring, the producers don't touch it
+			used = (ringWrite > ringRead) ? (ringWrite - ringRead) : (ringSize - ringRead);
+			data = &ring[ringRead];
+			writing = TRUE;
+			chMtxUnlock(&ring_lock);
+
+			chnWriteTimeout(&SDU1, data, used, MS2ST(CAPTURE_WRITE_TIMEOUT));
+
+			chMtxLock(&ring_lock);
+			writing = FALSE;
+			ringRead = (ringRead + used) % ringSize;
+
+			// A ring given meanwhile is taken between two writes
+			if(nextRing != NULL) {
+				ring_swap();
+				chBSemSignal(&swap_sem);
+			}
+		}
+
+		chMtxUnlock(&ring_lock);
+	}
+}
+
+
+// Thread recording the proximity samples, and the ToF and selector when they change
+static THD_WORKING_AREA(capture_sample_thd_wa, 256);
+static THD_FUNCTION(capture_sample_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	messagebus_topic_t *prox_topic = messagebus_find_topic_blocking(&bus, "/proximity");
+	proximity_msg_t proxValues;
+	uint16_t delta[PROXIMITY_NB_CHANNELS];
+	uint16_t tofDist, lastTofDist = 0;
+	uint8_t selector, lastSelector = 0xFF;
+
+	while(1) {
+		messagebus_topic_wait(prox_topic, &proxValues, sizeof(proxValues));
+
+		for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+			delta[i] = proxValues.delta[i];
+		}
+
+		capture_send(CAPTURE_PROX, delta, sizeof(delta));
+
+		tofDist = VL53L0X_get_dist_mm();
+
+		if(tofDist != lastTofDist) {
+			lastTofDist = tofDist;
+			capture_send(CAPTURE_TOF, &tofDist, sizeof(tofDist));
+		}
+
+		selector = get_selector();
+
+		if(selector != lastSelector) {
+			lastSelector = selector;
+			capture_send(CAPTURE_SELECTOR, &selector, sizeof(selector));
+		}
+	}
+}
+
+
+/*
+*	Function to build the table of the CRC, before any call to capture_crc16().
+*/
+void capture_init(void) {
+	// Table of the CRC-16/CCITT (polynomial 0x1021)
+	for(uint16_t i = 0; i < 256; i++) {
+		uint16_t crc = i << 8;
+
+		for(uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+
+		crcTable[i] = crc;
+	}
+}
+
+
+/*
+*	Function to start the THREADS recording the sensors. capture_init() and usb_start()
+*	must be called before.
+*/
+void capture_start(void) {
+	monitor_thread_create(capture_write_thd_wa, sizeof(capture_write_thd_wa), NORMALPRIO - 1,
+						capture_write_thd, NULL);
+	monitor_thread_create(capture_sample_thd_wa, sizeof(capture_sample_thd_wa), NORMALPRIO,
+						capture_sample_thd, NULL);
+}
+
+
+/*
+*	Function to select the recorded streams.
+*
+*	params :
+*	uint16_t streams		bit field of the streams (1 << capture_stream_t)
+*/
+void capture_set_streams(uint16_t streams) {
+	captureStreams = streams;
+}
+
+
+/*
+*	Function to move the ring to another buffer, the chunks waiting are moved along.
+*	They are dropped if they don't fit in the new buffer. Returns once the previous
+*	buffer isn't used anymore.
+*
+*	params :
+*	uint8_t *buffer			bytes of the ring, NULL for the own ring of CAPTURE_RING_SIZE
+*	uint16_t size			size of the buffer in bytes
+*/
+void capture_set_ring(uint8_t *buffer, uint16_t size) {
+	if(buffer == NULL) {
+		buffer = ownRing;
+		size = CAPTURE_RING_SIZE;
+	}
+
+	chMtxLock(&ring_lock);
+
+	if(buffer == ring) {
+		chMtxUnlock(&ring_lock);
+		return;
+	}
+
+	nextRing = buffer;
+	nextSize = size;
+
+	if(writing) {
+		// The writer thread swaps the rings at the end of its write
+		chMtxUnlock(&ring_lock);
+		chBSemWait(&swap_sem);
+	} else {
+		ring_swap();
+		chMtxUnlock(&ring_lock);
+	}
+}
+
+
+/*
+*	Function to record a chunk of a stream. The chunk is dropped if the USB serial
+*	doesn't follow, the host sees it in the sequence numbers.
+*
+*	params :
+*	capture_stream_t stream		stream of the data
+*	const void *data			payload of the chunk
+*	uint16_t len				payload length in bytes
+*/
+void capture_send(capture_stream_t stream, const void *data, uint16_t len) {
+	capture_header_t header;
+	uint16_t crc;
+	uint16_t freeSpace;
+
+	if((stream >= CAPTURE_NB_STREAMS) || !(captureStreams & (1 << stream))) {
+		return;
+	}
+
+	header.sync = CAPTURE_SYNC;
+	header.stream = stream;
+	header.len = len;
+	header.time = chVTGetSystemTime() * (1000000 / CH_CFG_ST_FREQUENCY);
+
+	chMtxLock(&ring_lock);
+
+	header.seq = seq[stream]++;
+	freeSpace = (ringRead + ringSize - ringWrite - 1) % ringSize;
+
+	if(freeSpace < (sizeof(header) + len + sizeof(crc))) {
+		dropped++;
+		chMtxUnlock(&ring_lock);
+		return;
+	}
+
+	crc = capture_crc16(CAPTURE_CRC_INIT, &header.stream, sizeof(header) - 1);
+	crc = capture_crc16(crc, data, len);
+
+	ring_put(&header, sizeof(header));
+	ring_put(data, len);
+	ring_put(&crc, sizeof(crc));
+
+	chMtxUnlock(&ring_lock);
+
+	chBSemSignal(&ring_sem);
+}
+
+
+/*
+*	Function to get the number of chunks dropped since the start.
+*/
+uint32_t capture_get_dropped(void) {
+	return dropped;
+}
+
+
+/*
+*	Function to update a CRC-16/CCITT with a buffer.
+*
+*	params :
+*	uint16_t crc			current value (CAPTURE_CRC_INIT for a new CRC)
+*	const uint8_t *data		buffer
+*	uint32_t len			buffer length in bytes
+*/
+uint16_t capture_crc16(uint16_t crc, const uint8_t *data, uint32_t len) {
+	for(uint32_t i = 0; i < len; i++) {
+		crc = (crc << 8) ^ crcTable[(crc >> 8) ^ data[i]];
+	}
+
+	return crc;
+}
+
+
+/*
+*	Copies a buffer in the ring, the caller holds the lock and checked the free space.
+*/
+static void ring_put(const void *data, uint16_t len) {
+	const uint8_t *bytes = data;
+	uint16_t first = ringSize - ringWrite;
+
+	if(first > len) {
+		first = len;
+	}
+
+	memcpy(&ring[ringWrite], bytes, first);
+	memcpy(ring, bytes + first, len - first);
+	ringWrite = (ringWrite + len) % ringSize;
+}
+
+
+/*
+*	Moves the chunks waiting to nextRing, the caller holds the lock and the writer
+*	thread isn't writing.
+*/
+static void ring_swap(void) {
+	uint16_t waiting = (ringWrite + ringSize - ringRead) % ringSize;
+	uint16_t first = ringSize - ringRead;
+
+	if(waiting >= nextSize) {
+		// The host sees the lost chunks in the sequence numbers
+		waiting = 0;
+		dropped++;
+	}
+
+	if(first > waiting) {
+		first = waiting;
+	}
+
+	memcpy(nextRing, &ring[ringRead], first);
+	memcpy(nextRing + first, ring, waiting - first);
+
+	ring = nextRing;
+	ringSize = nextSize;
+	ringRead = 0;
+	ringWrite = waiting;
+	nextRing = NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+
+#define CAPTURE_SYNC			0xA5	// First byte of every chunk
+#define CAPTURE_RING_SIZE		8192	// Bytes buffered before the USB serial
+#define CAPTURE_RING_ARENA_SIZE	49152	// Bytes of the ring lent by the arena in the phases
+										// without the audio buffers
+#define CAPTURE_WRITE_TIMEOUT	10		// Max time to write on the USB serial in [ms]
+#define CAPTURE_CRC_INIT		0xFFFF	// CRC-16/CCITT
+
+// Recorded streams
+typedef enum {
+	CAPTURE_MIC = 0,		// int16_t[640], blocks given to process_audio_data
+	CAPTURE_CAM,			// uint8_t[IMAGE_BUFFER_SIZE], rows given to detect_line
+	CAPTURE_TOF,			// uint16_t, ToF distance in [mm] when it changes
+	CAPTURE_PROX,			// uint16_t[8], delta of the proximity sensors
+	CAPTURE_SELECTOR,		// uint8_t, selector position when it changes
+	CAPTURE_PROF,			// prof_report_t, statistics of a profiled site every second
+	CAPTURE_THREADS,		// monitor_report_t, CPU share and stack of a thread
+	CAPTURE_STEERING,		// telemetry_steering_t, PID of the audio steering for each peak
+	CAPTURE_LINE,			// telemetry_line_t, line detection for each image
+	CAPTURE_PARAM,			// tuning_report_t, value of a parameter after each change
+	CAPTURE_ARENA,			// arena_report_t, usage of the arena at each phase change
+	CAPTURE_MOTOR,			// motor_report_t, source driving the motors at each change
+	CAPTURE_TRACE,			// trace_report_t, latencies of a traced path every second
+	CAPTURE_RUN,			// run_record_t, each record appended to the run log or exported
+	CAPTURE_PERIODIC,		// periodic_report_t, deadline counters of a periodic task every second
+	CAPTURE_OBSTACLE,		// obst_report_t, stop latency and avoidance cost every second
+	CAPTURE_NB_STREAMS,		// 16 at most, the streams are selected by a uint16_t
+} capture_stream_t;
+
+#define CAPTURE_ALL				((1 << CAPTURE_NB_STREAMS) - 1)
+#define CAPTURE_RAW				((1 << CAPTURE_MIC) | (1 << CAPTURE_CAM))	// About 130 KB/s
+
+// Streams recorded at boot, the raw sensor data is turned on with the "capture" command
+#define CAPTURE_DEFAULT_STREAMS	(CAPTURE_ALL & ~CAPTURE_RAW)
+
+/*
+*	A chunk is the header, the payload and the CRC-16 of the header (without the sync
+*	byte) and payload. All fields are little-endian.
+*/
+typedef struct __attribute__((packed)) {
+	uint8_t sync;			// CAPTURE_SYNC
+	uint8_t stream;			// capture_stream_t
+	uint8_t seq;			// chunk counter of the stream, shows the dropped chunks
+	uint16_t len;			// payload length in bytes
+	uint32_t time;			// time of the sample in [us] since boot, wraps after 2^32 us
+							// (71.6 min), the host unwraps it
+} capture_header_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void capture_init(void);
+void capture_start(void);
+void capture_set_streams(uint16_t streams);
+void capture_set_ring(uint8_t *buffer, uint16_t size);
+void capture_send(capture_stream_t stream, const void *data, uint16_t len);
+uint32_t capture_get_dropped(void);
+uint16_t capture_crc16(uint16_t crc, const uint8_t *data, uint32_t len);
+
+
+#endif /* CAPTURE_H */
@@ -0,0 +1,326 @@
+/*
+  \file   	game.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	State machine of the game, the events of all the threads are handled here
+*/
+
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "audio_processing.h"
+#include "game.h"
+#include "main.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "process_image.h"
+#include "proximity_filter.h"
+#include "proximity_sensors.h"
+#include "trace.h"
+
+#include "msgbus/messagebus.h"
+
+
+typedef struct {
+	game_state_t from;
+	game_event_t event;
+	game_state_t to;
+} game_transition_t;
+
+// The events not listed here are ignored, e.g. the end of a penalty once the finish
+// line is reached
+static const game_transition_t transitions[] = {
+	{GAME_SETUP,				GAME_EV_PLAYER_READY,	GAME_CALIBRATION},
+	{GAME_WAITING,				GAME_EV_PLAYER_READY,	GAME_CALIBRATION},
+	{GAME_CALIBRATION,			GAME_EV_CALIBRATED,		GAME_COUNTDOWN},
+	{GAME_COUNTDOWN,			GAME_EV_START,			GAME_RACE},
+	{GAME_RACE,					GAME_EV_OBSTACLE,		GAME_PENALTY},
+	{GAME_PENALTY,				GAME_EV_PENALTY_DONE,	GAME_RACE},
+	{GAME_RACE,					GAME_EV_FINISH_LINE,	GAME_FINISHED},
+	{GAME_FINISHED,				GAME_EV_RETURN,			GAME_RETURN},
+	{GAME_RETURN,				GAME_EV_RETURNED,		GAME_WAITING},
+	{GAME_FINISHED,				GAME_EV_GAME_OVER,		GAME_SETUP},
+	// Tournament: the next player is calibrated during the return
+	{GAME_RETURN,				GAME_EV_PLAYER_READY,	GAME_RETURN_CALIBRATION},
+	{GAME_RETURN_CALIBRATION,	GAME_EV_CALIBRATED,		GAME_RETURN_READY},
+	{GAME_RETURN_CALIBRATION,	GAME_EV_RETURNED,		GAME_CALIBRATION},
+	{GAME_RETURN_READY,			GAME_EV_RETURNED,		GAME_COUNTDOWN},
+};
+
+// Events waiting for the game thread
+static msg_t game_mb_buffer[GAME_EVENT_QUEUE];
+static MAILBOX_DECL(game_mb, game_mb_buffer, GAME_EVENT_QUEUE);
+
+// Trace of the last posted event of each kind, under the system lock
+static trace_t eventTraces[GAME_NB_EVENTS];
+
+// Current state, only written by the game thread
+static game_state_msg_t current = {GAME_SETUP, GAME_SETUP, 0};
+static MUTEX_DECL(game_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(game_condvar);
+
+// Split times of the current run, under the lock
+static game_run_t run;
+static systime_t calibrationStart = 0;
+static systime_t raceStart = 0;
+
+static MUTEX_DECL(game_topic_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(game_topic_condvar);
+static messagebus_topic_t game_topic;
+static game_state_msg_t game_topic_value;
+
+static void game_dispatch(game_event_t event);
+static void game_enter(game_state_t state);
+static void game_split(void);
+
+
+// Thread doing the transitions, above the sensor threads so that an event is handled
+// before its sender goes on. game_enter() goes down to the capture ring through the
+// arena and the motor arbiter, about 400 B of frames.
+static THD_WORKING_AREA(game_thd_wa, 1024);
+static THD_FUNCTION(game_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	msg_t event;
+
+	while(1) {
+		chMBFetch(&game_mb, &event, TIME_INFINITE);
+		game_dispatch((game_event_t)event);
+	}
+}
+
+
+/*
+*	Function to start the THREAD of the state machine and to advertise the
+*	"/game_state" topic.
+*/
+void game_start(void) {
+	messagebus_topic_init(&game_topic, &game_topic_lock, &game_topic_condvar,
+						  &game_topic_value, sizeof(game_topic_value));
+	messagebus_advertise_topic(&bus, &game_topic, "/game_state");
+
+	current.time = chVTGetSystemTime();
+	messagebus_topic_publish(&game_topic, &current, sizeof(current));
+
+	monitor_thread_create(game_thd_wa, sizeof(game_thd_wa), NORMALPRIO + 2, game_thd, NULL);
+}
+
+
+/*
+*	Function to send an event to the state machine, it never blocks.
+*
+*	Returns FALSE if the queue is full and the event lost.
+*
+*	params :
+*	game_event_t event		one of GAME_EV_*
+*/
+bool game_post(game_event_t event) {
+	return chMBPost(&game_mb, (msg_t)event, TIME_IMMEDIATE) == MSG_OK;
+}
+
+
+/*
+*	Function to send an event caused by a traced sample, the latency of the trace ends
+*	with the transition done on the event. The trace is taken over by the state machine.
+*
+*	Returns FALSE if the queue is full and the event lost.
+*
+*	params :
+*	game_event_t event		one of GAME_EV_*
+*	trace_t *trace			trace of the sample causing the event
+*/
+bool game_post_traced(game_event_t event, trace_t *trace) {
+	trace_t previous;
+	bool posted;
+
+	chSysLock();
+	previous = eventTraces[event];
+	eventTraces[event] = *trace;
+	chSysUnlock();
+
+	trace->id = 0;
+	trace_drop(&previous);
+
+	// The trace is stored first, the game thread may dispatch the event at once
+	if(!(posted = game_post(event))) {
+		chSysLock();
+		previous = eventTraces[event];
+		eventTraces[event].id = 0;
+		chSysUnlock();
+
+		trace_drop(&previous);
+	}
+
+	return posted;
+}
+
+
+/*
+*	Function to get the current state of the game.
+*/
+game_state_t game_get_state(void) {
+	return (game_state_t)current.state;
+}
+
+
+/*
+*	Function to wait till the game is in a given state. Only the states left on an
+*	event of the caller can be waited for, the other ones could be missed.
+*
+*	Returns the time of the transition to the state.
+*
+*	params :
+*	game_state_t state		state to wait for
+*/
+systime_t game_wait_state(game_state_t state) {
+	return game_wait(GAME_IN(state));
+}
+
+
+/*
+*	Function to wait till the game is in one of several states, same as game_wait_state.
+*
+*	params :
+*	uint16_t states			GAME_IN(state) of each state to wait for
+*/
+systime_t game_wait(uint16_t states) {
+	systime_t time;
+
+	chMtxLock(&game_lock);
+
+	while(!(GAME_IN(current.state) & states)) {
+		chCondWait(&game_condvar);
+	}
+
+	time = current.time;
+	chMtxUnlock(&game_lock);
+
+	return time;
+}
+
+
+/*
+*	Function to get the split times of the last run, complete once the game is in
+*	GAME_FINISHED.
+*
+*	params :
+*	game_run_t *out			pointer to the structure to fill
+*/
+void game_get_run(game_run_t *out) {
+	chMtxLock(&game_lock);
+	*out = run;
+	chMtxUnlock(&game_lock);
+}
+
+
+/*
+*	Looks for the transition of an event in the current state and does it.
+*/
+static void game_dispatch(game_event_t event) {
+	trace_t trace;
+
+	chSysLock();
+	trace = eventTraces[event];
+	eventTraces[event].id = 0;
+	chSysUnlock();
+
+	for(uint8_t i = 0; i < (sizeof(transitions) / sizeof(transitions[0])); i++) {
+		if((transitions[i].from == current.state) && (transitions[i].event == event)) {
+			// The modules are set up before the state can be seen by the other threads
+			game_enter(transitions[i].to);
+
+			chMtxLock(&game_lock);
+			current.previous = current.state;
+			current.state = transitions[i].to;
+			current.time = chVTGetSystemTime();
+			game_split();
+			chCondBroadcast(&game_condvar);
+			chMtxUnlock(&game_lock);
+
+			messagebus_topic_publish(&game_topic, &current, sizeof(current));
+			trace_end(&trace);
+			return;
+		}
+	}
+
+	trace_drop(&trace);
+}
+
+
+/*
+*	Updates the split times of the run on a transition, the caller holds the lock.
+*/
+static void game_split(void) {
+	switch(current.state) {
+		case GAME_CALIBRATION:
+		case GAME_RETURN_CALIBRATION:
+			// The calibration goes on when the return ends
+			if(current.previous != GAME_RETURN_CALIBRATION) {
+				calibrationStart = current.time;
+			}
+			break;
+
+		case GAME_RETURN_READY:
+			run.calibration = current.time - calibrationStart;
+			break;
+
+		case GAME_COUNTDOWN:
+			if(current.previous == GAME_CALIBRATION) {
+				run.calibration = current.time - calibrationStart;
+			}
+			break;
+
+		case GAME_RACE:
+			if(current.previous == GAME_COUNTDOWN) {
+				raceStart = current.time;
+				run.penalties = 0;
+			}
+			break;
+
+		case GAME_PENALTY:
+			run.penalties++;
+			break;
+
+		case GAME_FINISHED:
+			run.race = current.time - raceStart;
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+/*
+*	Entry actions of the states. The detections are only turned on and off here.
+*/
+static void game_enter(game_state_t state) {
+	bool race = (state == GAME_RACE);
+
+	status_voice_calibration((state == GAME_CALIBRATION) || (state == GAME_RETURN_CALIBRATION));
+	status_motor_noise(state == GAME_RETURN);
+	status_audio_command(race);
+	status_obst_detection(race);
+	status_goal_detection(race);
+
+	// The e-puck stays on the finish line till the return
+	if(state == GAME_FINISHED) {
+		motor_arbiter_request(MOTOR_SRC_FINISH, 0, 0);
+	} else {
+		motor_arbiter_release(MOTOR_SRC_FINISH);
+	}
+
+	if(state == GAME_PENALTY) {
+		obstacle_penalty_start();
+	}
+
+	// The e-puck stands still on the start line and the hands are off the selector, the
+	// baseline no longer keeps an obstacle present at the power-on
+	if(state == GAME_CALIBRATION) {
+		proximity_filter_calibrate();
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ch.h"
+
+#include "trace.h"
+
+
+#define GAME_EVENT_QUEUE		8		// Events waiting for the dispatch
+
+// States of the game, published on the "/game_state" topic
+typedef enum {
+	GAME_SETUP = 0,			// number of players chosen with the selector
+	GAME_CALIBRATION,		// voice of the player measured
+	GAME_COUNTDOWN,
+	GAME_RACE,				// audio command, obstacle and goal detection active
+	GAME_PENALTY,			// an obstacle was touched, the e-puck turns and waits
+	GAME_FINISHED,			// finish line reached
+	GAME_RETURN,			// back to the start line
+	GAME_WAITING,			// next player chosen with the selector
+	GAME_RETURN_CALIBRATION,	// tournament: return and voice of the next player measured
+	GAME_RETURN_READY,		// tournament: return, the next player is calibrated
+	GAME_NB_STATES
+} game_state_t;
+
+#define GAME_IN(state)		(1 << (state))
+
+// Events posted by the threads, the transitions are done by the game thread
+typedef enum {
+	GAME_EV_PLAYER_READY = 0,	// from main, in GAME_SETUP, GAME_WAITING or GAME_RETURN
+	GAME_EV_CALIBRATED,			// from the audio processing
+	GAME_EV_START,				// from main, end of the countdown
+	GAME_EV_OBSTACLE,			// from the proximity thread
+	GAME_EV_PENALTY_DONE,		// from the proximity thread
+	GAME_EV_FINISH_LINE,		// from the image processing
+	GAME_EV_RETURN,				// from main
+	GAME_EV_RETURNED,			// from the return thread
+	GAME_EV_GAME_OVER,			// from main, the winner is shown
+	GAME_NB_EVENTS
+} game_event_t;
+
+typedef struct {
+	uint8_t state;			// game_state_t
+	uint8_t previous;
+	systime_t time;			// of the transition
+} game_state_msg_t;
+
+// Split times of the last run, measured on the transitions
+typedef struct {
+	systime_t calibration;	// voice calibration, from the player ready to the calibrated voice
+	systime_t race;			// from the start to the finish line, penalties included
+	uint8_t penalties;
+} game_run_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void game_start(void);
+bool game_post(game_event_t event);
+bool game_post_traced(game_event_t event, trace_t *trace);
+game_state_t game_get_state(void);
+systime_t game_wait_state(game_state_t state);
+systime_t game_wait(uint16_t states);
+void game_get_run(game_run_t *run);
+
+
+#endif /* GAME_H */
@@ -0,0 +1,284 @@
+/*
+  \file   	bench.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Micro-benchmarks of the audio and vision kernels of the firmware on the host.
+  			The CMSIS-DSP calls use the portable versions of sim/sim_dsp.c, so the FFT
+  			and magnitude figures only compare host builds with each other.
+*/
+
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ch.h"
+
+#include "arena.h"
+#include "audio_processing.h"
+#include "capture.h"
+#include "process_image.h"
+
+#include "arm_math.h"
+#include "audio/microphone.h"
+#include "sim.h"
+
+
+#define BENCH_MIN_TIME		0.05		// min duration of a measure in [s]
+#define BENCH_REPEAT		5			// the best of the measures is kept
+#define SAMPLE_RATE			16000.0
+
+typedef struct {
+	const char *name;
+	void (*prepare)(void);				// restores the input, timed apart and subtracted
+	void (*run)(void);
+	uint32_t items;						// processed items per call
+	const char *unit;
+	size_t footprint;					// bytes of the buffers used by a call
+} bench_t;
+
+// The simulation objects are linked with the benchmarks but not started
+sim_options_t simOptions = {.players = 1, .seed = 1};
+
+static float toneInput[2 * FFT_SIZE];
+static float chirpInput[2 * FFT_SIZE];
+static float fftBuffer[2 * FFT_SIZE];
+static float magnitude[4][FFT_SIZE];
+static float average[FFT_SIZE];
+static uint8_t stripedRow[IMAGE_BUFFER_SIZE];
+static uint8_t noisyRow[IMAGE_BUFFER_SIZE];
+static telemetry_line_t line;
+static const float *fftSource = toneInput;
+static uint32_t randState = 12345;
+
+
+static float noise(float amplitude) {
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+
+	return amplitude * (2.0f * (randState / 4294967296.0f) - 1.0f);
+}
+
+
+/*
+*	Synthetic inputs: a whistle at bin 15, a chirp over the voice range, a striped row
+*	like the finish line and a row of noise.
+*/
+static void make_inputs(void) {
+	double phase = 0;
+
+	for(uint16_t i = 0; i < FFT_SIZE; i++) {
+		double freq = (MIN_FREQ + (MAX_FREQ - MIN_FREQ) * (double)i / FFT_SIZE) * SAMPLE_RATE / FFT_SIZE;
+
+		toneInput[2*i] = 600 * sin(2 * M_PI * 15 * i / FFT_SIZE) + noise(40);
+		toneInput[2*i + 1] = 0;
+		chirpInput[2*i] = 600 * sin(phase) + noise(40);
+		chirpInput[2*i + 1] = 0;
+		phase += 2 * M_PI * freq / SAMPLE_RATE;
+	}
+
+	for(uint16_t i = 0; i < IMAGE_BUFFER_SIZE; i++) {
+		stripedRow[i] = (((i + 20) % 70) < 45 ? 0x00 : 0xF8);
+		noisyRow[i] = (uint8_t)(0x80 + noise(120)) & 0xF8;
+	}
+
+	// Magnitudes of a tone for the kernels working on spectra
+	memcpy(fftBuffer, toneInput, sizeof(fftBuffer));
+	doFFT_optimized(FFT_SIZE, fftBuffer);
+
+	for(uint8_t m = 0; m < 4; m++) {
+		arm_cmplx_mag_f32(fftBuffer, magnitude[m], FFT_SIZE);
+	}
+
+	memcpy(average, magnitude[0], sizeof(average));
+}
+
+
+static void prepare_fft(void) {
+	memcpy(fftBuffer, fftSource, sizeof(fftBuffer));
+}
+
+
+static void run_fft(void) {
+	doFFT_optimized(FFT_SIZE, fftBuffer);
+}
+
+
+static void prepare_fft_tone(void) {
+	fftSource = toneInput;
+	prepare_fft();
+}
+
+
+static void prepare_fft_chirp(void) {
+	fftSource = chirpInput;
+	prepare_fft();
+}
+
+
+static void run_magnitude(void) {
+	arm_cmplx_mag_f32(fftBuffer, magnitude[0], FFT_SIZE);
+}
+
+
+static void run_average(void) {
+	mics_average(magnitude[0], magnitude[1], magnitude[2], magnitude[3], average, FFT_SIZE);
+}
+
+
+static void run_calibration(void) {
+	player_voice_calibration(average);
+}
+
+
+static void run_sound_remote(void) {
+	sound_remote(average);
+}
+
+
+static void run_detect_striped(void) {
+	detect_line(stripedRow, MIN_LINE_WIDTH, &line);
+}
+
+
+static void run_detect_noisy(void) {
+	detect_line(noisyRow, MIN_LINE_WIDTH, &line);
+}
+
+
+static void run_process_audio(void) {
+	static int16_t block[MIC_BUFFER_LEN];
+
+	// One FFT frame every 6.4 blocks, the mean cost of a 10 ms block is measured
+	process_audio_data(block, MIC_BUFFER_LEN);
+}
+
+
+static double now_seconds(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*
+*	Best time of a function in [ns/call], the number of calls is raised until a
+*	measure lasts BENCH_MIN_TIME.
+*/
+static double measure(void (*prepare)(void), void (*run)(void)) {
+	double best = 1e30;
+	uint32_t calls = 1;
+
+	while(1) {
+		double start = now_seconds(), elapsed;
+
+		for(uint32_t i = 0; i < calls; i++) {
+			if(prepare != NULL) {
+				prepare();
+			}
+
+			if(run != NULL) {
+				run();
+			}
+		}
+
+		elapsed = now_seconds() - start;
+
+		if(elapsed >= BENCH_MIN_TIME) {
+			break;
+		}
+
+		calls *= 2;
+	}
+
+	for(uint8_t r = 0; r < BENCH_REPEAT; r++) {
+		double start = now_seconds(), elapsed;
+
+		for(uint32_t i = 0; i < calls; i++) {
+			if(prepare != NULL) {
+				prepare();
+			}
+
+			if(run != NULL) {
+				run();
+			}
+		}
+
+		elapsed = (now_seconds() - start) * 1e9 / calls;
+		best = (elapsed < best) ? elapsed : best;
+	}
+
+	return best;
+}
+
+
+static const bench_t benches[] = {
+	{"fft tone",			prepare_fft_tone,	run_fft,			FFT_SIZE,			"samples",
+		sizeof(fftBuffer)},
+	{"fft chirp",			prepare_fft_chirp,	run_fft,			FFT_SIZE,			"samples",
+		sizeof(fftBuffer)},
+	{"cmplx_mag",			NULL,				run_magnitude,		FFT_SIZE,			"values",
+		sizeof(fftBuffer) + sizeof(magnitude[0])},
+	{"mics_average",		NULL,				run_average,		FFT_SIZE,			"values",
+		sizeof(magnitude) + sizeof(average)},
+	{"voice_calibration",	NULL,				run_calibration,	MAX_FREQ - MIN_FREQ + 1,	"bins",
+		sizeof(average)},
+	{"sound_remote",		NULL,				run_sound_remote,	2 * HALF_BW + 1,	"bins",
+		sizeof(average)},
+	{"detect_line striped",	NULL,				run_detect_striped,	IMAGE_BUFFER_SIZE,	"pixels",
+		sizeof(stripedRow)},
+	{"detect_line noise",	NULL,				run_detect_noisy,	IMAGE_BUFFER_SIZE,	"pixels",
+		sizeof(noisyRow)},
+	{"process_audio_data",	NULL,				run_process_audio,	MIC_BUFFER_LEN,		"samples",
+		MIC_BUFFER_LEN * sizeof(int16_t)},
+};
+
+#define NB_BENCHES	(sizeof(benches) / sizeof(benches[0]))
+
+
+int main(int argc, char **argv) {
+	const char *filter = (argc > 1) ? argv[1] : NULL;
+
+	make_inputs();
+	capture_set_streams(0);
+	arena_start();
+	arena_enter(ARENA_RACE);
+	status_voice_calibration(TRUE);
+	status_audio_command(TRUE);
+
+	printf("%-22s %12s %16s %12s %8s\n", "kernel", "ns/call", "throughput", "footprint", "heap");
+
+	for(uint8_t i = 0; i < NB_BENCHES; i++) {
+		const bench_t *b = &benches[i];
+		struct mallinfo2 before, after;
+		double ns, base = 0;
+
+		if((filter != NULL) && (strstr(b->name, filter) == NULL)) {
+			continue;
+		}
+
+		before = mallinfo2();
+		ns = measure(b->prepare, b->run);
+		after = mallinfo2();
+
+		if(b->prepare != NULL) {
+			base = measure(b->prepare, NULL);
+			ns = (ns > base) ? ns - base : 0;
+		}
+
+		printf("%-22s %12.1f %9.1f M%-6s %10zu B %8zd\n", b->name, ns,
+			   (ns > 0) ? b->items * 1e3 / ns : 0.0, b->unit, b->footprint,
+			   (ssize_t)(after.uordblks - before.uordblks));
+	}
+
+	printf("heap: bytes allocated during the measure, 0 for kernels without allocation\n");
+
+	return 0;
+}
+
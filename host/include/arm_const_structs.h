@@ -0,0 +1,10 @@
+#ifndef ARM_CONST_STRUCTS_H
+#define ARM_CONST_STRUCTS_H
+
+#include "arm_math.h"
+
+
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len1024;
+
+
+#endif /* ARM_CONST_STRUCTS_H */
@@ -0,0 +1,27 @@
+#ifndef ARM_MATH_H
+#define ARM_MATH_H
+
+// Portable fallback of the CMSIS-DSP functions used by the firmware (see sim/sim_dsp.c)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define PI						3.14159265358979f
+
+typedef float float32_t;
+
+typedef struct {
+	uint16_t fftLen;
+} arm_cfft_instance_f32;
+
+void arm_cfft_f32(const arm_cfft_instance_f32 *S, float32_t *p1, uint8_t ifftFlag,
+					uint8_t bitReverseFlag);
+void arm_cmplx_mag_f32(float32_t *pSrc, float32_t *pDst, uint32_t numSamples);
+float32_t arm_sin_f32(float32_t x);
+float32_t arm_cos_f32(float32_t x);
+
+
+#endif /* ARM_MATH_H */
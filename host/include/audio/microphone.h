@@ -0,0 +1,17 @@
+#ifndef MICROPHONE_H
+#define MICROPHONE_H
+
+#include <stdint.h>
+
+
+#define MIC_RIGHT		0
+#define MIC_LEFT		1
+#define MIC_BACK		2
+#define MIC_FRONT		3
+
+#define MIC_BUFFER_LEN	640		// 160 samples per microphone every 10 ms (16 kHz)
+
+void mic_start(void (*callback)(int16_t *data, uint16_t num_samples));
+
+
+#endif /* MICROPHONE_H */
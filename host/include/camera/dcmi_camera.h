@@ -0,0 +1,27 @@
+#ifndef DCMI_CAMERA_H
+#define DCMI_CAMERA_H
+
+#include <stdint.h>
+
+
+typedef enum {
+	CAPTURE_ONE_SHOT,
+	CAPTURE_CONTINUOUS,
+} capture_mode_t;
+
+void dcmi_start(void);
+void dcmi_enable_double_buffering(void);
+void dcmi_disable_double_buffering(void);
+void dcmi_set_capture_mode(capture_mode_t mode);
+int8_t dcmi_prepare(void);
+void dcmi_unprepare(void);
+int8_t dcmi_capture_start(void);
+int8_t dcmi_capture_stop(void);
+uint8_t image_is_ready(void);
+void wait_image_ready(void);
+uint8_t *dcmi_get_last_image_ptr(void);
+uint8_t *dcmi_get_first_buffer_ptr(void);
+uint8_t *dcmi_get_second_buffer_ptr(void);
+
+
+#endif /* DCMI_CAMERA_H */
@@ -0,0 +1,27 @@
+#ifndef PO8030_H
+#define PO8030_H
+
+#include <stdint.h>
+
+
+typedef enum {
+	FORMAT_CBYYCRYY = 0x00,
+	FORMAT_CRYYCBYY = 0x01,
+	FORMAT_RGB565 = 0x30,
+	FORMAT_YYYY = 0x44,
+} format_t;
+
+typedef enum {
+	SUBSAMPLING_X1 = 0x20,
+	SUBSAMPLING_X2 = 0x40,
+	SUBSAMPLING_X4 = 0x80,
+} subsampling_t;
+
+void po8030_start(void);
+int8_t po8030_advanced_config(format_t fmt, unsigned int x1, unsigned int y1,
+								unsigned int width, unsigned int height,
+								subsampling_t subsampling_x, subsampling_t subsampling_y);
+uint32_t po8030_get_image_size(void);
+
+
+#endif /* PO8030_H */
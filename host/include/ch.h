@@ -0,0 +1,211 @@
+#ifndef CH_H
+#define CH_H
+
+// Host stand-in of the ChibiOS/RT API used by the firmware.
+// Threads run one at a time on a simulated clock (see sim/sim_kernel.c).
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+
+#define CH_CFG_ST_FREQUENCY		10000				// System ticks per second
+#define STM32_SYSCLK			168000000			// Simulated core clock
+#define STM32_HCLK				STM32_SYSCLK
+
+#define TRUE					1
+#define FALSE					0
+
+#define MSG_OK					((msg_t)0)
+#define MSG_TIMEOUT				((msg_t)-1)
+#define MSG_RESET				((msg_t)-2)
+
+#define TIME_IMMEDIATE			((systime_t)0)
+#define TIME_INFINITE			((systime_t)-1)
+
+#define IDLEPRIO				1
+#define LOWPRIO					2
+#define NORMALPRIO				128
+#define HIGHPRIO				255
+
+typedef uint32_t systime_t;
+typedef intptr_t msg_t;
+typedef uint32_t rtcnt_t;
+typedef uint8_t tprio_t;
+typedef int32_t cnt_t;
+typedef void (*tfunc_t)(void *arg);
+typedef void (*vtfunc_t)(void *par);
+
+// Time conversions, rounded up and computed on 32 bits like ChibiOS (they overflow the same way)
+#define S2ST(sec)				((systime_t)((uint32_t)(sec) * (uint32_t)CH_CFG_ST_FREQUENCY))
+#define MS2ST(msec)				((systime_t)(((uint32_t)(msec) * (uint32_t)CH_CFG_ST_FREQUENCY + 999u) / 1000u))
+#define US2ST(usec)				((systime_t)(((uint32_t)(usec) * (uint32_t)CH_CFG_ST_FREQUENCY + 999999u) / 1000000u))
+#define ST2S(n)					(((uint32_t)(n) + CH_CFG_ST_FREQUENCY - 1u) / (uint32_t)CH_CFG_ST_FREQUENCY)
+#define ST2MS(n)				(((uint32_t)(n) * 1000u + CH_CFG_ST_FREQUENCY - 1u) / (uint32_t)CH_CFG_ST_FREQUENCY)
+#define ST2US(n)				(((uint32_t)(n) * 1000000u + CH_CFG_ST_FREQUENCY - 1u) / (uint32_t)CH_CFG_ST_FREQUENCY)
+#define RTC2US(freq, n)			((((uint32_t)(n) - 1u) / ((uint32_t)(freq) / 1000000u)) + 1u)
+#define RTC2MS(freq, n)			((((uint32_t)(n) - 1u) / ((uint32_t)(freq) / 1000u)) + 1u)
+
+// Objects, all of them are valid when zero-initialized except the semaphores and mailboxes
+typedef struct sim_thread thread_t;
+
+typedef struct {
+	thread_t *head;
+	thread_t *tail;
+} threads_queue_t;
+
+typedef struct mutex {
+	threads_queue_t queue;
+	thread_t *owner;
+	struct mutex *next;
+} mutex_t;
+
+typedef struct {
+	threads_queue_t queue;
+} condition_variable_t;
+
+typedef struct {
+	threads_queue_t queue;
+	cnt_t cnt;
+} semaphore_t;
+
+// Complete so that sizeof(thread_t) works as on the target, the fields belong to sim/sim_kernel.c
+struct sim_thread {
+	pthread_t pthread;
+	pthread_cond_t cond;
+	const char *name;
+	tprio_t prio;
+	uint8_t state;
+	uint64_t wake;				// tick of the timeout, SIM_NEVER if none
+	threads_queue_t *queue;		// object queue in which the thread waits
+	thread_t *next;
+	msg_t msg;					// wake-up message
+	mutex_t *mtxlist;			// owned mutexes, last locked first
+	tfunc_t func;
+	void *arg;
+	thread_t *newer;			// registry
+};
+
+typedef struct {
+	semaphore_t sem;
+} binary_semaphore_t;
+
+typedef struct {
+	msg_t *buffer;
+	msg_t *top;
+	msg_t *wrptr;
+	msg_t *rdptr;
+	semaphore_t fullsem;		// free slots
+	semaphore_t emptysem;		// posted messages
+} mailbox_t;
+
+typedef struct virtual_timer {
+	struct virtual_timer *next;
+	uint64_t deadline;
+	vtfunc_t func;
+	void *par;
+	bool armed;
+} virtual_timer_t;
+
+#define THD_WORKING_AREA(s, n)			uint8_t s[n]
+#define THD_FUNCTION(tname, arg)		void tname(void *arg)
+
+#define MUTEX_DECL(name)				mutex_t name = {{NULL, NULL}, NULL, NULL}
+#define CONDVAR_DECL(name)				condition_variable_t name = {{NULL, NULL}}
+#define SEMAPHORE_DECL(name, n)			semaphore_t name = {{NULL, NULL}, (n)}
+#define BSEMAPHORE_DECL(name, taken)	binary_semaphore_t name = {{{NULL, NULL}, (taken) ? 0 : 1}}
+#define MAILBOX_DECL(name, buffer, size)											\
+	mailbox_t name = {(msg_t *)(buffer), (msg_t *)(buffer) + (size),				\
+					  (msg_t *)(buffer), (msg_t *)(buffer),							\
+					  {{NULL, NULL}, (size)}, {{NULL, NULL}, 0}}
+
+#define chDbgAssert(c, r)				do { if(!(c)) chSysHalt(r); } while(0)
+#define chDbgCheck(c)					chDbgAssert(c, __func__)
+
+#define chSysLock()
+#define chSysUnlock()
+#define chSysLockFromISR()
+#define chSysUnlockFromISR()
+#define chSysGetStatusAndLockX()		0
+#define chSysRestoreStatusX(s)			(void)(s)
+
+// System
+void chSysHalt(const char *reason);
+rtcnt_t chSysGetRealtimeCounterX(void);
+thread_t *chSysGetIdleThreadX(void);
+
+// Threads
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+void chRegSetThreadName(const char *name);
+thread_t *chThdGetSelfX(void);
+tprio_t chThdGetPriorityX(void);
+void chThdSleep(systime_t time);
+void chThdSleepUntil(systime_t time);
+systime_t chThdSleepUntilWindowed(systime_t prev, systime_t next);
+void chThdYield(void);
+#define chThdSleepSeconds(sec)			chThdSleep(S2ST(sec))
+#define chThdSleepMilliseconds(msec)	chThdSleep(MS2ST(msec))
+#define chThdSleepMicroseconds(usec)	chThdSleep(US2ST(usec))
+
+// Registry
+thread_t *chRegFirstThread(void);
+thread_t *chRegNextThread(thread_t *tp);
+const char *chRegGetThreadNameX(thread_t *tp);
+
+// Virtual timers and system time
+systime_t chVTGetSystemTime(void);
+#define chVTGetSystemTimeX()			chVTGetSystemTime()
+#define chVTTimeElapsedSinceX(start)	((systime_t)(chVTGetSystemTimeX() - (start)))
+#define chVTIsSystemTimeWithinX(s, e)	((systime_t)(chVTGetSystemTimeX() - (s)) < (systime_t)((e) - (s)))
+void chVTObjectInit(virtual_timer_t *vtp);
+void chVTSet(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par);
+void chVTReset(virtual_timer_t *vtp);
+#define chVTSetI(vtp, d, f, p)			chVTSet(vtp, d, f, p)
+#define chVTResetI(vtp)					chVTReset(vtp)
+#define chVTIsArmedI(vtp)				((vtp)->armed)
+
+// Mutexes and condition variables
+void chMtxObjectInit(mutex_t *mp);
+void chMtxLock(mutex_t *mp);
+bool chMtxTryLock(mutex_t *mp);
+void chMtxUnlock(mutex_t *mp);
+void chCondObjectInit(condition_variable_t *cp);
+msg_t chCondWait(condition_variable_t *cp);
+msg_t chCondWaitTimeout(condition_variable_t *cp, systime_t time);
+void chCondSignal(condition_variable_t *cp);
+void chCondBroadcast(condition_variable_t *cp);
+void chCondBroadcastI(condition_variable_t *cp);
+#define chMtxLockS(mp)					chMtxLock(mp)
+#define chMtxUnlockS(mp)				chMtxUnlock(mp)
+#define chCondWaitS(cp)					chCondWait(cp)
+
+// Semaphores
+void chSemObjectInit(semaphore_t *sp, cnt_t n);
+msg_t chSemWait(semaphore_t *sp);
+msg_t chSemWaitTimeout(semaphore_t *sp, systime_t time);
+void chSemSignal(semaphore_t *sp);
+void chSemSignalI(semaphore_t *sp);
+void chBSemObjectInit(binary_semaphore_t *bsp, bool taken);
+msg_t chBSemWait(binary_semaphore_t *bsp);
+msg_t chBSemWaitTimeout(binary_semaphore_t *bsp, systime_t time);
+void chBSemSignal(binary_semaphore_t *bsp);
+void chBSemSignalI(binary_semaphore_t *bsp);
+void chBSemReset(binary_semaphore_t *bsp, bool taken);
+#define chSemWaitTimeoutS(sp, t)		chSemWaitTimeout(sp, t)
+
+// Mailboxes
+void chMBObjectInit(mailbox_t *mbp, msg_t *buf, size_t n);
+void chMBReset(mailbox_t *mbp);
+msg_t chMBPost(mailbox_t *mbp, msg_t msg, systime_t timeout);
+msg_t chMBPostI(mailbox_t *mbp, msg_t msg);
+msg_t chMBFetch(mailbox_t *mbp, msg_t *msgp, systime_t timeout);
+msg_t chMBFetchI(mailbox_t *mbp, msg_t *msgp);
+#define chMBGetUsedCountI(mbp)			((size_t)(mbp)->emptysem.cnt)
+#define chMBGetFreeCountI(mbp)			((size_t)(mbp)->fullsem.cnt)
+
+// Scheduler
+#define chSchRescheduleS()
+
+
+#endif /* CH_H */
@@ -0,0 +1,14 @@
+#ifndef CHPRINTF_H
+#define CHPRINTF_H
+
+#include <stdarg.h>
+
+#include "hal.h"
+
+
+int chprintf(BaseSequentialStream *chp, const char *fmt, ...);
+int chvprintf(BaseSequentialStream *chp, const char *fmt, va_list ap);
+int chsnprintf(char *str, size_t size, const char *fmt, ...);
+
+
+#endif /* CHPRINTF_H */
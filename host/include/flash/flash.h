@@ -0,0 +1,20 @@
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// The sectors of the run log are a buffer of the simulation (sim_devices.c)
+#define SIM_FLASH_SIZE			(256 * 1024)
+#define RUN_LOG_ADDR			((uintptr_t)sim_flash)
+
+extern uint8_t sim_flash[SIM_FLASH_SIZE];
+
+void flash_unlock(void);
+void flash_lock(void);
+void flash_sector_erase(void *sector);
+void flash_write(void *dst, const void *src, size_t len);
+
+
+#endif /* FLASH_H */
@@ -0,0 +1,46 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Host stand-in of the ChibiOS/HAL API used by the firmware: streams and channels.
+
+#include "ch.h"
+
+
+// Common virtual methods of the streams and channels
+struct BaseChannelVMT {
+	size_t (*write)(void *ip, const uint8_t *bp, size_t n);
+	size_t (*read)(void *ip, uint8_t *bp, size_t n);
+	msg_t (*put)(void *ip, uint8_t b);
+	msg_t (*get)(void *ip);
+	msg_t (*putt)(void *ip, uint8_t b, systime_t time);
+	msg_t (*gett)(void *ip, systime_t time);
+	size_t (*writet)(void *ip, const uint8_t *bp, size_t n, systime_t time);
+	size_t (*readt)(void *ip, uint8_t *bp, size_t n, systime_t time);
+};
+
+typedef struct {
+	const struct BaseChannelVMT *vmt;
+} BaseSequentialStream;
+
+typedef struct {
+	const struct BaseChannelVMT *vmt;
+} BaseChannel;
+
+#define streamWrite(ip, bp, n)				((ip)->vmt->write(ip, bp, n))
+#define streamRead(ip, bp, n)				((ip)->vmt->read(ip, bp, n))
+#define streamPut(ip, b)					((ip)->vmt->put(ip, b))
+#define streamGet(ip)						((ip)->vmt->get(ip))
+#define chSequentialStreamWrite(ip, bp, n)	streamWrite(ip, bp, n)
+#define chSequentialStreamRead(ip, bp, n)	streamRead(ip, bp, n)
+#define chnWriteTimeout(ip, bp, n, time)	((ip)->vmt->writet(ip, bp, n, time))
+#define chnReadTimeout(ip, bp, n, time)		((ip)->vmt->readt(ip, bp, n, time))
+#define chnPutTimeout(ip, b, time)			((ip)->vmt->putt(ip, b, time))
+#define chnGetTimeout(ip, time)				((ip)->vmt->gett(ip, time))
+
+#define Q_TIMEOUT							MSG_TIMEOUT
+
+void halInit(void);
+void chSysInit(void);
+
+
+#endif /* HAL_H */
@@ -0,0 +1,31 @@
+#ifndef LEDS_H
+#define LEDS_H
+
+#include <stdint.h>
+
+
+typedef enum {
+	LED1,
+	LED3,
+	LED5,
+	LED7,
+	NUM_LED,
+} led_name_t;
+
+typedef enum {
+	LED2,
+	LED4,
+	LED6,
+	LED8,
+	NUM_RGB_LED,
+} rgb_led_name_t;
+
+void set_led(led_name_t led_number, unsigned int value);
+void set_rgb_led(rgb_led_name_t led_number, uint8_t red_val, uint8_t green_val, uint8_t blue_val);
+void toggle_rgb_led(rgb_led_name_t led_number, unsigned int color, uint8_t value);
+void set_body_led(unsigned int value);
+void set_front_led(unsigned int value);
+void clear_leds(void);
+
+
+#endif /* LEDS_H */
@@ -0,0 +1,50 @@
+#ifndef PARAMETER_H
+#define PARAMETER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+typedef struct parameter_namespace_s {
+	const char *id;
+	struct parameter_namespace_s *parent;
+	struct parameter_namespace_s *subspaces;
+	struct parameter_namespace_s *next;
+	struct parameter_s *parameter_list;
+	uint32_t changed_cnt;
+} parameter_namespace_t;
+
+typedef struct parameter_s {
+	const char *id;
+	parameter_namespace_t *ns;
+	struct parameter_s *next;
+	uint8_t type;
+	bool changed;
+	bool defined;
+	union {
+		float s;
+		int32_t i;
+	} value;
+} parameter_t;
+
+
+// Subset of the API of the parameter library, implemented by sim/sim_parameter.c
+void parameter_namespace_declare(parameter_namespace_t *ns, parameter_namespace_t *parent, const char *id);
+parameter_t *parameter_find(parameter_namespace_t *ns, const char *id);
+bool parameter_changed(const parameter_t *p);
+bool parameter_namespace_contains_changed(const parameter_namespace_t *ns);
+
+void parameter_scalar_declare_with_default(parameter_t *p, parameter_namespace_t *ns, const char *id,
+										   float default_val);
+float parameter_scalar_get(parameter_t *p);
+float parameter_scalar_read(parameter_t *p);
+void parameter_scalar_set(parameter_t *p, float value);
+
+void parameter_integer_declare_with_default(parameter_t *p, parameter_namespace_t *ns, const char *id,
+											int32_t default_val);
+int32_t parameter_integer_get(parameter_t *p);
+int32_t parameter_integer_read(parameter_t *p);
+void parameter_integer_set(parameter_t *p, int32_t value);
+
+
+#endif /* PARAMETER_H */
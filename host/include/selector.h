@@ -0,0 +1,8 @@
+#ifndef SELECTOR_H
+#define SELECTOR_H
+
+
+int get_selector(void);
+
+
+#endif /* SELECTOR_H */
@@ -0,0 +1,12 @@
+#ifndef VL53L0X_H
+#define VL53L0X_H
+
+#include <stdint.h>
+
+
+void VL53L0X_start(void);
+void VL53L0X_stop(void);
+uint16_t VL53L0X_get_dist_mm(void);
+
+
+#endif /* VL53L0X_H */
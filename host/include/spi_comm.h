@@ -0,0 +1,8 @@
+#ifndef SPI_COMM_H
+#define SPI_COMM_H
+
+
+void spi_comm_start(void);
+
+
+#endif /* SPI_COMM_H */
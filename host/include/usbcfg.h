@@ -0,0 +1,18 @@
+#ifndef USBCFG_H
+#define USBCFG_H
+
+#include "hal.h"
+
+
+// Serial over USB, bound to a host file by the simulation (see sim_devices.c)
+typedef struct {
+	const struct BaseChannelVMT *vmt;
+	int fd;
+} SerialUSBDriver;
+
+extern SerialUSBDriver SDU1;
+
+void usb_start(void);
+
+
+#endif /* USBCFG_H */
@@ -0,0 +1,64 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ch.h"
+
+
+#define SIM_NEVER				UINT64_MAX
+#define SIM_TICKS_PER_MS		(CH_CFG_ST_FREQUENCY / 1000)
+#define SIM_MAX_SETS			16			// --set and --command options
+
+// Options of a simulation run (see sim_main.c)
+typedef struct {
+	uint8_t players;			// number of players selected by the operator
+	uint32_t seed;				// seed of the noise generators
+	uint32_t duration;			// max simulated time in [s]
+	bool verbose;				// prints the game events
+	const char *usbOut;			// file receiving the USB serial output
+	const char *replay;			// sensor recording replayed instead of the world
+	const char *sets[SIM_MAX_SETS];	// NAME=VALUE parameters set over the USB serial
+	uint8_t nbSets;
+	const char *commands[SIM_MAX_SETS];	// other command lines sent over the USB serial
+	uint8_t nbCommands;
+	const char *flash;			// image of the flash kept from one run to the next
+} sim_options_t;
+
+extern sim_options_t simOptions;
+
+
+// Kernel (sim_kernel.c)
+uint64_t sim_now(void);
+double sim_seconds(void);
+void sim_kernel_start(tfunc_t mainFunc);
+void sim_set_end(uint64_t ticks);
+void sim_stop(int code);
+
+// Devices (sim_devices.c)
+uint32_t sim_motor_digest(void);
+void sim_flash_load(void);
+void sim_flash_save(void);
+uint32_t sim_flash_erases(void);
+
+// World (sim_world.c), called by the kernel when the clock advances and at the end
+void sim_world_init(void);
+void sim_world_advance(uint64_t from, uint64_t to);
+void sim_world_report(void);
+
+// Deterministic noise (sim_world.c)
+uint32_t sim_rand(void);
+float sim_noise(float amplitude);
+
+#define SIM_LOG(...)																\
+	do {																			\
+		if(simOptions.verbose) {													\
+			printf("[%9.3f] ", sim_seconds());										\
+			printf(__VA_ARGS__);													\
+			printf("\n");															\
+		}																			\
+	} while(0)
+
+
+#endif /* SIM_H */
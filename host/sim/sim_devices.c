@@ -0,0 +1,783 @@
+/*
+  \file   	sim_devices.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Stand-ins of the e-puck2 library: motors, LEDs, selector, IR proximity, ToF,
+  			camera, microphones and serial over USB. The sensors sample the simulated
+  			world at the rate of the real peripherals.
+*/
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+#include "usbcfg.h"
+
+#include "main.h"
+
+#include "audio/microphone.h"
+#include "camera/dcmi_camera.h"
+#include "camera/po8030.h"
+#include "flash/flash.h"
+#include "sensors/proximity.h"
+#include "sensors/VL53L0X/VL53L0X.h"
+#include "leds.h"
+#include "memory_protection.h"
+#include "motors.h"
+#include "selector.h"
+#include "spi_comm.h"
+
+#include "tuning.h"
+
+#include "sim.h"
+#include "sim_replay.h"
+#include "sim_world.h"
+
+
+/*======================================================================================*/
+/* 									MOTORS AND LEDS										*/
+/*======================================================================================*/
+
+// FNV-1a hash of the motor commands and their time, compares two runs
+static uint32_t motorDigest = 2166136261u;
+
+static void motor_digest(int16_t speed) {
+	uint32_t words[2] = {chVTGetSystemTime(), (uint16_t)speed};
+	const uint8_t *bytes = (const uint8_t *)words;
+
+	for(uint8_t i = 0; i < sizeof(words); i++) {
+		motorDigest = (motorDigest ^ bytes[i]) * 16777619u;
+	}
+}
+
+
+uint32_t sim_motor_digest(void) {
+	return motorDigest;
+}
+
+
+void motors_init(void) {
+	robot.leftSpeed = 0;
+	robot.rightSpeed = 0;
+}
+
+
+static int16_t motor_clamp(int speed) {
+	if(speed > MOTOR_SPEED_LIMIT) {
+		return MOTOR_SPEED_LIMIT;
+	} else if(speed < -MOTOR_SPEED_LIMIT) {
+		return -MOTOR_SPEED_LIMIT;
+	}
+
+	return speed;
+}
+
+
+void left_motor_set_speed(int speed) {
+	robot.leftSpeed = motor_clamp(speed);
+	motor_digest(robot.leftSpeed);
+}
+
+
+void right_motor_set_speed(int speed) {
+	robot.rightSpeed = motor_clamp(speed);
+	motor_digest(-robot.rightSpeed);
+}
+
+
+int32_t left_motor_get_pos(void) {
+	return (int32_t)floor(robot.leftPos);
+}
+
+
+int32_t right_motor_get_pos(void) {
+	return (int32_t)floor(robot.rightPos);
+}
+
+
+void left_motor_set_pos(int32_t counter_value) {
+	robot.leftPos = counter_value;
+}
+
+
+void right_motor_set_pos(int32_t counter_value) {
+	robot.rightPos = counter_value;
+}
+
+
+void set_led(led_name_t led_number, unsigned int value) {
+	if(led_number < NUM_LED) {
+		robot.led[led_number] = (value > 1) ? !robot.led[led_number] : value;
+	}
+}
+
+
+void set_rgb_led(rgb_led_name_t led_number, uint8_t red_val, uint8_t green_val, uint8_t blue_val) {
+	if(led_number < NUM_RGB_LED) {
+		robot.rgb[led_number][0] = red_val;
+		robot.rgb[led_number][1] = green_val;
+		robot.rgb[led_number][2] = blue_val;
+	}
+}
+
+
+void toggle_rgb_led(rgb_led_name_t led_number, unsigned int color, uint8_t value) {
+	if((led_number < NUM_RGB_LED) && (color < 3)) {
+		robot.rgb[led_number][color] = robot.rgb[led_number][color] ? 0 : value;
+	}
+}
+
+
+void set_body_led(unsigned int value) {
+	robot.bodyLed = (value > 1) ? !robot.bodyLed : value;
+}
+
+
+void set_front_led(unsigned int value) {
+	robot.frontLed = (value > 1) ? !robot.frontLed : value;
+}
+
+
+void clear_leds(void) {
+	memset(robot.led, 0, sizeof(robot.led));
+	memset(robot.rgb, 0, sizeof(robot.rgb));
+}
+
+
+int get_selector(void) {
+	return robot.selector;
+}
+
+
+void spi_comm_start(void) {
+}
+
+
+void mpu_init(void) {
+}
+
+
+/*======================================================================================*/
+/* 									IR PROXIMITY										*/
+/*======================================================================================*/
+
+static messagebus_topic_t proximity_topic;
+static MUTEX_DECL(proximity_topic_lock);
+static CONDVAR_DECL(proximity_topic_condvar);
+static proximity_msg_t proximity_values;
+static proximity_msg_t proximity_buffer;
+
+static THD_WORKING_AREA(proximity_thd_wa, 512);
+static THD_FUNCTION(proximity_thd, arg) {
+	(void)arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	systime_t time = chVTGetSystemTime();
+	sim_replay_cursor_t cursor = {0, 1 << CAPTURE_PROX};
+	const capture_header_t *chunk;
+	uint16_t delta[PROXIMITY_NB_CHANNELS];
+
+	while(sim_replay_active()) {
+		if((chunk = sim_replay_next(&cursor)) == NULL) {
+			chThdSleep(TIME_INFINITE);
+		}
+
+		sim_replay_wait(chunk);
+		sim_replay_payload(chunk, delta, sizeof(delta));
+
+		for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+			proximity_values.delta[i] = delta[i];
+		}
+
+		messagebus_topic_publish(&proximity_topic, &proximity_values, sizeof(proximity_values));
+	}
+
+	while(1) {
+		sim_world_proximity(proximity_values.delta);
+
+		for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+			proximity_values.ambient[i] = 3000;
+			proximity_values.reflected[i] = 3000 - proximity_values.delta[i];
+		}
+
+		messagebus_topic_publish(&proximity_topic, &proximity_values, sizeof(proximity_values));
+
+		time += MS2ST(PROX_PERIOD);
+		chThdSleepUntilWindowed(time - MS2ST(PROX_PERIOD), time);
+	}
+}
+
+
+void proximity_start(void) {
+	messagebus_topic_init(&proximity_topic, &proximity_topic_lock, &proximity_topic_condvar,
+							&proximity_buffer, sizeof(proximity_buffer));
+	messagebus_advertise_topic(&bus, &proximity_topic, "/proximity");
+
+	chThdCreateStatic(proximity_thd_wa, sizeof(proximity_thd_wa), NORMALPRIO + 1, proximity_thd, NULL);
+}
+
+
+void calibrate_ir(void) {
+	sim_world_proximity(proximity_values.initValue);
+}
+
+
+int get_prox(unsigned int sensor_number) {
+	return (sensor_number < PROXIMITY_NB_CHANNELS) ? (int)proximity_values.delta[sensor_number] : 0;
+}
+
+
+int get_calibrated_prox(unsigned int sensor_number) {
+	if(sensor_number >= PROXIMITY_NB_CHANNELS) {
+		return 0;
+	}
+
+	return (int)proximity_values.delta[sensor_number] - (int)proximity_values.initValue[sensor_number];
+}
+
+
+int get_ambient_light(unsigned int sensor_number) {
+	return (sensor_number < PROXIMITY_NB_CHANNELS) ? (int)proximity_values.ambient[sensor_number] : 0;
+}
+
+
+/*======================================================================================*/
+/* 										TOF												*/
+/*======================================================================================*/
+
+static uint16_t tofDist = TOF_MAX_DIST;
+
+static THD_WORKING_AREA(tof_thd_wa, 512);
+static THD_FUNCTION(tof_thd, arg) {
+	(void)arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	float dist;
+	sim_replay_cursor_t cursor = {0, (1 << CAPTURE_TOF) | (1 << CAPTURE_SELECTOR)};
+	const capture_header_t *chunk;
+
+	// The selector is recorded with the ToF
+	while(sim_replay_active()) {
+		if((chunk = sim_replay_next(&cursor)) == NULL) {
+			chThdSleep(TIME_INFINITE);
+		}
+
+		sim_replay_wait(chunk);
+
+		if(chunk->stream == CAPTURE_TOF) {
+			sim_replay_payload(chunk, &tofDist, sizeof(tofDist));
+		} else {
+			sim_replay_payload(chunk, &robot.selector, sizeof(robot.selector));
+		}
+	}
+
+	while(1) {
+		dist = 10 * sim_world_ray(robot.x + ROBOT_RADIUS * cos(robot.theta),
+								   robot.y + ROBOT_RADIUS * sin(robot.theta), robot.theta);
+		dist += sim_noise(2);
+		tofDist = ((dist > TOF_MAX_DIST) || (dist < 0)) ? TOF_MAX_DIST : (uint16_t)dist;
+
+		chThdSleepMilliseconds(TOF_PERIOD);
+	}
+}
+
+
+void VL53L0X_start(void) {
+	chThdCreateStatic(tof_thd_wa, sizeof(tof_thd_wa), NORMALPRIO + 1, tof_thd, NULL);
+}
+
+
+void VL53L0X_stop(void) {
+}
+
+
+uint16_t VL53L0X_get_dist_mm(void) {
+	return tofDist;
+}
+
+
+/*======================================================================================*/
+/* 										CAMERA											*/
+/*======================================================================================*/
+
+static uint8_t imageBuffer[2 * 2 * CAMERA_WIDTH];
+static uint8_t imageReady = 0;
+
+void dcmi_start(void) {
+}
+
+
+void po8030_start(void) {
+}
+
+
+int8_t po8030_advanced_config(format_t fmt, unsigned int x1, unsigned int y1,
+								unsigned int width, unsigned int height,
+								subsampling_t subsampling_x, subsampling_t subsampling_y) {
+	(void)fmt;
+	(void)x1;
+	(void)y1;
+	(void)subsampling_x;
+	(void)subsampling_y;
+
+	return ((width * height * 2) <= sizeof(imageBuffer)) ? 0 : -1;
+}
+
+
+uint32_t po8030_get_image_size(void) {
+	return sizeof(imageBuffer);
+}
+
+
+void dcmi_enable_double_buffering(void) {
+}
+
+
+void dcmi_disable_double_buffering(void) {
+}
+
+
+void dcmi_set_capture_mode(capture_mode_t mode) {
+	(void)mode;
+}
+
+
+int8_t dcmi_prepare(void) {
+	return 0;
+}
+
+
+void dcmi_unprepare(void) {
+}
+
+
+int8_t dcmi_capture_start(void) {
+	imageReady = 0;
+
+	return 0;
+}
+
+
+int8_t dcmi_capture_stop(void) {
+	return 0;
+}
+
+
+uint8_t image_is_ready(void) {
+	return imageReady;
+}
+
+
+/*
+*	The frame is rendered at the end of its exposure: one ray per column, the
+*	grey level goes in the red, green and blue bits of the RGB565 pixels.
+*/
+void wait_image_ready(void) {
+	static sim_replay_cursor_t cursor = {0, 1 << CAPTURE_CAM};
+	const capture_header_t *chunk;
+	uint8_t row[CAMERA_WIDTH];
+	double camX, camY, angle;
+	uint8_t grey;
+
+	// The recorded rows already are the red bits of the pixels
+	if(sim_replay_active()) {
+		if((chunk = sim_replay_next(&cursor)) == NULL) {
+			chThdSleep(TIME_INFINITE);
+		}
+
+		sim_replay_wait(chunk);
+		sim_replay_payload(chunk, row, sizeof(row));
+
+		for(uint16_t c = 0; c < CAMERA_WIDTH; c++) {
+			imageBuffer[2 * c] = row[c];
+			imageBuffer[2 * c + 1] = 0;
+		}
+
+		imageReady = 1;
+		return;
+	}
+
+	chThdSleepMilliseconds(CAMERA_PERIOD);
+
+	camX = robot.x + ROBOT_RADIUS * cos(robot.theta);
+	camY = robot.y + ROBOT_RADIUS * sin(robot.theta);
+
+	for(uint16_t c = 0; c < CAMERA_WIDTH; c++) {
+		angle = robot.theta + (0.5 - (c + 0.5) / CAMERA_WIDTH) * CAMERA_FOV;
+		grey = sim_world_color(camX, camY, angle);
+
+		for(uint8_t line = 0; line < 2; line++) {
+			imageBuffer[2 * (line * CAMERA_WIDTH + c)] = (grey & 0xF8) | (grey >> 5);
+			imageBuffer[2 * (line * CAMERA_WIDTH + c) + 1] = ((grey << 3) & 0xE0) | (grey >> 3);
+		}
+	}
+
+	imageReady = 1;
+}
+
+
+uint8_t *dcmi_get_last_image_ptr(void) {
+	return imageBuffer;
+}
+
+
+uint8_t *dcmi_get_first_buffer_ptr(void) {
+	return imageBuffer;
+}
+
+
+uint8_t *dcmi_get_second_buffer_ptr(void) {
+	return imageBuffer;
+}
+
+
+/*======================================================================================*/
+/* 									MICROPHONES											*/
+/*======================================================================================*/
+
+static void (*micCallback)(int16_t *data, uint16_t num_samples);
+
+static THD_WORKING_AREA(mic_thd_wa, 1024);
+static THD_FUNCTION(mic_thd, arg) {
+	(void)arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	static int16_t samples[MIC_BUFFER_LEN];
+	systime_t time = chVTGetSystemTime();
+	double phase = 0;
+	double motorPhase[2] = {0, 0};
+	sim_replay_cursor_t cursor = {0, 1 << CAPTURE_MIC};
+	const capture_header_t *chunk;
+
+	while(sim_replay_active()) {
+		if((chunk = sim_replay_next(&cursor)) == NULL) {
+			chThdSleep(TIME_INFINITE);
+		}
+
+		sim_replay_wait(chunk);
+		sim_replay_payload(chunk, samples, sizeof(samples));
+
+		if(micCallback != NULL) {
+			micCallback(samples, MIC_BUFFER_LEN);
+		}
+	}
+
+	while(1) {
+		time += MS2ST(MIC_PERIOD);
+		chThdSleepUntilWindowed(time - MS2ST(MIC_PERIOD), time);
+
+		for(uint16_t i = 0; i < MIC_SAMPLES; i++) {
+			float whistle = 0;
+			int16_t speeds[2] = {robot.leftSpeed, robot.rightSpeed};
+
+			if(robot.whistleBin >= 0) {
+				whistle = MIC_AMPLITUDE * sin(phase);
+				phase = fmod(phase + 2 * M_PI * robot.whistleBin / 1024, 2 * M_PI);
+			}
+
+			// Each moving wheel whines at its step rate
+			for(uint8_t wheel = 0; wheel < 2; wheel++) {
+				if(speeds[wheel] != 0) {
+					whistle += MIC_MOTOR_NOISE * sin(motorPhase[wheel]);
+					motorPhase[wheel] = fmod(motorPhase[wheel] + 2 * M_PI * abs(speeds[wheel])
+											 / (MIC_SAMPLES * 1000 / MIC_PERIOD), 2 * M_PI);
+				}
+			}
+
+			for(uint8_t mic = 0; mic < 4; mic++) {
+				samples[4*i + mic] = (int16_t)(whistle + sim_noise(MIC_NOISE));
+			}
+		}
+
+		if(micCallback != NULL) {
+			micCallback(samples, MIC_BUFFER_LEN);
+		}
+	}
+}
+
+
+void mic_start(void (*callback)(int16_t *data, uint16_t num_samples)) {
+	micCallback = callback;
+
+	chThdCreateStatic(mic_thd_wa, sizeof(mic_thd_wa), NORMALPRIO + 1, mic_thd, NULL);
+}
+
+
+/*======================================================================================*/
+/* 									SERIAL OVER USB										*/
+/*======================================================================================*/
+
+// Command lines received by the robot: the --set and --command options, then in replay
+// the parameter changes of the recording at their time
+static char usbIn[2 * SIM_MAX_SETS * 40];
+static uint16_t usbInLen = 0;
+static uint16_t usbInPos = 0;
+static sim_replay_cursor_t paramCursor = {0, 1 << CAPTURE_PARAM};
+static const capture_header_t *paramChunk = NULL;
+
+static size_t usb_write(void *ip, const uint8_t *bp, size_t n) {
+	SerialUSBDriver *sdup = ip;
+
+	if(sdup->fd < 0) {
+		return n;
+	}
+
+	return write(sdup->fd, bp, n) < 0 ? 0 : n;
+}
+
+
+static size_t usb_read(void *ip, uint8_t *bp, size_t n) {
+	(void)ip;
+	(void)bp;
+	(void)n;
+
+	return 0;
+}
+
+
+static msg_t usb_put(void *ip, uint8_t b) {
+	return (usb_write(ip, &b, 1) == 1) ? MSG_OK : MSG_RESET;
+}
+
+
+static msg_t usb_get(void *ip) {
+	(void)ip;
+
+	return MSG_RESET;
+}
+
+
+static msg_t usb_putt(void *ip, uint8_t b, systime_t time) {
+	(void)time;
+
+	return usb_put(ip, b);
+}
+
+
+static msg_t usb_gett(void *ip, systime_t time) {
+	tuning_report_t report;
+	systime_t chunkTime;
+
+	(void)ip;
+
+	if(usbInPos < usbInLen) {
+		return (uint8_t)usbIn[usbInPos++];
+	}
+
+	if(sim_replay_active() && (paramChunk == NULL)) {
+		paramChunk = sim_replay_next(&paramCursor);
+	}
+
+	if(paramChunk != NULL) {
+		chunkTime = paramChunk->time / (1000000 / CH_CFG_ST_FREQUENCY);
+
+		if((systime_t)(chunkTime - chVTGetSystemTime()) <= time) {
+			sim_replay_wait(paramChunk);
+			sim_replay_payload(paramChunk, &report, sizeof(report));
+			paramChunk = NULL;
+
+			usbInLen = snprintf(usbIn, sizeof(usbIn), "set %.*s %.9g\n", TUNING_NAME_LEN, report.name,
+								report.value);
+			usbInPos = 1;
+
+			return (uint8_t)usbIn[0];
+		}
+	}
+
+	chThdSleep(time);
+
+	return Q_TIMEOUT;
+}
+
+
+static size_t usb_writet(void *ip, const uint8_t *bp, size_t n, systime_t time) {
+	(void)time;
+
+	return usb_write(ip, bp, n);
+}
+
+
+static size_t usb_readt(void *ip, uint8_t *bp, size_t n, systime_t time) {
+	(void)ip;
+	(void)bp;
+	(void)n;
+
+	chThdSleep(time);
+
+	return 0;
+}
+
+
+static const struct BaseChannelVMT usbVmt = {
+	usb_write, usb_read, usb_put, usb_get, usb_putt, usb_gett, usb_writet, usb_readt
+};
+
+SerialUSBDriver SDU1 = {&usbVmt, -1};
+
+
+/*
+*	The serial output of the robot goes to the file given with --usb, the --set and
+*	--command options are its first input lines. A recording turns on all the streams,
+*	the raw sensor data is needed by --replay.
+*/
+void usb_start(void) {
+	if((SDU1.fd < 0) && (simOptions.usbOut != NULL)) {
+		SDU1.fd = open(simOptions.usbOut, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		usbInLen = snprintf(usbIn, sizeof(usbIn), "capture %u\n", CAPTURE_ALL);
+	}
+
+	for(uint8_t i = 0; i < simOptions.nbSets; i++) {
+		const char *value = strchr(simOptions.sets[i], '=') + 1;
+
+		usbInLen += snprintf(&usbIn[usbInLen], sizeof(usbIn) - usbInLen, "set %.*s %s\n",
+							 (int)(value - simOptions.sets[i] - 1), simOptions.sets[i], value);
+
+		if(usbInLen >= sizeof(usbIn)) {
+			usbInLen = sizeof(usbIn) - 1;
+		}
+	}
+
+	for(uint8_t i = 0; i < simOptions.nbCommands; i++) {
+		usbInLen += snprintf(&usbIn[usbInLen], sizeof(usbIn) - usbInLen, "%s\n",
+							 simOptions.commands[i]);
+
+		if(usbInLen >= sizeof(usbIn)) {
+			usbInLen = sizeof(usbIn) - 1;
+		}
+	}
+}
+
+
+int chvprintf(BaseSequentialStream *chp, const char *fmt, va_list ap) {
+	char buf[256];
+	int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+
+	if(n > (int)sizeof(buf) - 1) {
+		n = sizeof(buf) - 1;
+	}
+
+	if(n > 0) {
+		streamWrite(chp, (const uint8_t *)buf, n);
+	}
+
+	return n;
+}
+
+
+int chprintf(BaseSequentialStream *chp, const char *fmt, ...) {
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = chvprintf(chp, fmt, ap);
+	va_end(ap);
+
+	return n;
+}
+
+
+int chsnprintf(char *str, size_t size, const char *fmt, ...) {
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(str, size, fmt, ap);
+	va_end(ap);
+
+	return n;
+}
+
+
+/*======================================================================================*/
+/* 										FLASH											*/
+/*======================================================================================*/
+
+uint8_t sim_flash[SIM_FLASH_SIZE];
+static bool flashUnlocked = FALSE;
+static uint32_t flashErases = 0;
+
+
+void flash_unlock(void) {
+	flashUnlocked = TRUE;
+}
+
+
+void flash_lock(void) {
+	flashUnlocked = FALSE;
+}
+
+
+void flash_sector_erase(void *sector) {
+	uint8_t *start = sector;
+
+	if(!flashUnlocked || (start < sim_flash) || (start >= sim_flash + SIM_FLASH_SIZE)) {
+		fprintf(stderr, "flash: erase of a locked or unknown sector\n");
+		sim_stop(1);
+	}
+
+	// Sectors of 128 KB
+	start = sim_flash + ((start - sim_flash) & ~(128 * 1024 - 1));
+	memset(start, 0xFF, 128 * 1024);
+	flashErases++;
+}
+
+
+/*
+*	As in the flash, the programming only clears bits.
+*/
+void flash_write(void *dst, const void *src, size_t len) {
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	if(!flashUnlocked || (d < sim_flash) || (d + len > sim_flash + SIM_FLASH_SIZE)) {
+		fprintf(stderr, "flash: write to a locked or unknown address\n");
+		sim_stop(1);
+	}
+
+	for(size_t i = 0; i < len; i++) {
+		d[i] &= s[i];
+	}
+}
+
+
+/*
+*	The flash is erased at the start, or holds the image given with --flash.
+*/
+void sim_flash_load(void) {
+	FILE *f;
+
+	memset(sim_flash, 0xFF, sizeof(sim_flash));
+
+	if((simOptions.flash != NULL) && ((f = fopen(simOptions.flash, "rb")) != NULL)) {
+		if(fread(sim_flash, 1, sizeof(sim_flash), f) != sizeof(sim_flash)) {
+			memset(sim_flash, 0xFF, sizeof(sim_flash));
+		}
+
+		fclose(f);
+	}
+}
+
+
+/*
+*	The image is written back at the end of the run, as after a reset of the robot.
+*/
+void sim_flash_save(void) {
+	FILE *f;
+
+	if((simOptions.flash != NULL) && ((f = fopen(simOptions.flash, "wb")) != NULL)) {
+		fwrite(sim_flash, 1, sizeof(sim_flash), f);
+		fclose(f);
+	}
+}
+
+
+uint32_t sim_flash_erases(void) {
+	return flashErases;
+}
@@ -0,0 +1,107 @@
+/*
+  \file   	sim_dsp.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Portable versions of the CMSIS-DSP functions used by the firmware
+*/
+
+#include <math.h>
+#include <stdbool.h>
+
+#include "arm_math.h"
+#include "arm_const_structs.h"
+
+
+#define TWIDDLE_MAX		4096		// largest FFT length
+
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len1024 = {1024};
+
+// exp(-2*pi*i*k/TWIDDLE_MAX), computed on the first call
+static float32_t twiddleCos[TWIDDLE_MAX / 2];
+static float32_t twiddleSin[TWIDDLE_MAX / 2];
+static bool twiddleReady = false;
+
+
+/*
+*	In place radix-2 FFT of fftLen interleaved complex numbers (real, imaginary).
+*/
+void arm_cfft_f32(const arm_cfft_instance_f32 *S, float32_t *p1, uint8_t ifftFlag,
+					uint8_t bitReverseFlag) {
+	uint32_t n = S->fftLen;
+	float sign = ifftFlag ? 1.0f : -1.0f;
+
+	(void)bitReverseFlag;
+
+	if(!twiddleReady) {
+		for(uint32_t k = 0; k < TWIDDLE_MAX / 2; k++) {
+			twiddleCos[k] = cos(2 * M_PI * k / TWIDDLE_MAX);
+			twiddleSin[k] = -sin(2 * M_PI * k / TWIDDLE_MAX);
+		}
+
+		twiddleReady = true;
+	}
+
+	// Bit reversal permutation
+	for(uint32_t i = 1, j = 0; i < n; i++) {
+		uint32_t bit = n >> 1;
+
+		for(; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+
+		j ^= bit;
+
+		if(i < j) {
+			float32_t re = p1[2*i], im = p1[2*i + 1];
+
+			p1[2*i] = p1[2*j];
+			p1[2*i + 1] = p1[2*j + 1];
+			p1[2*j] = re;
+			p1[2*j + 1] = im;
+		}
+	}
+
+	// Butterflies
+	for(uint32_t len = 2; len <= n; len <<= 1) {
+		uint32_t stride = TWIDDLE_MAX / len;
+
+		for(uint32_t i = 0; i < n; i += len) {
+			for(uint32_t k = 0; k < len / 2; k++) {
+				float32_t wr = twiddleCos[k * stride], wi = -sign * twiddleSin[k * stride];
+				float32_t *a = &p1[2 * (i + k)];
+				float32_t *b = &p1[2 * (i + k + len / 2)];
+				float32_t tr = b[0] * wr - b[1] * wi;
+				float32_t ti = b[0] * wi + b[1] * wr;
+
+				b[0] = a[0] - tr;
+				b[1] = a[1] - ti;
+				a[0] += tr;
+				a[1] += ti;
+			}
+		}
+	}
+
+	if(ifftFlag) {
+		for(uint32_t i = 0; i < 2 * n; i++) {
+			p1[i] /= n;
+		}
+	}
+}
+
+
+void arm_cmplx_mag_f32(float32_t *pSrc, float32_t *pDst, uint32_t numSamples) {
+	for(uint32_t i = 0; i < numSamples; i++) {
+		pDst[i] = sqrtf(pSrc[2*i] * pSrc[2*i] + pSrc[2*i + 1] * pSrc[2*i + 1]);
+	}
+}
+
+
+float32_t arm_sin_f32(float32_t x) {
+	return sinf(x);
+}
+
+
+float32_t arm_cos_f32(float32_t x) {
+	return cosf(x);
+}
@@ -0,0 +1,792 @@
+/*
+  \file   	sim_kernel.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Simulated ChibiOS kernel. Each firmware thread is a host thread but only
+  			one of them runs at a time: the running thread holds the "cpu" lock and
+  			gives it away when it blocks. When every thread waits, the clock jumps
+  			to the next timeout, so a game runs much faster than real time and
+  			always gives the same result.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "sim.h"
+
+
+enum {
+	SIM_READY,
+	SIM_RUNNING,
+	SIM_SLEEPING,
+	SIM_WAITING,
+	SIM_FINAL,
+};
+
+static pthread_mutex_t cpu = PTHREAD_MUTEX_INITIALIZER;
+static thread_t idleThread = {.name = "idle", .prio = IDLEPRIO, .state = SIM_FINAL};
+static thread_t *current = &idleThread;
+static thread_t *registry = NULL;
+static threads_queue_t readyList = {NULL, NULL};
+static virtual_timer_t *timers = NULL;
+static uint64_t now = 0;
+static uint64_t endTime = SIM_NEVER;
+static bool inIsr = FALSE;
+
+
+/*======================================================================================*/
+/* 									  SCHEDULER											*/
+/*======================================================================================*/
+
+/*
+*	Inserts a thread after the threads of higher or equal priority (ahead == FALSE)
+*	or after the threads of higher priority only (ahead == TRUE).
+*/
+static void queue_insert(threads_queue_t *q, thread_t *tp, bool ahead) {
+	thread_t **pp = &q->head;
+
+	while((*pp != NULL) && (((*pp)->prio > tp->prio) || (!ahead && ((*pp)->prio == tp->prio)))) {
+		pp = &(*pp)->next;
+	}
+
+	tp->next = *pp;
+	*pp = tp;
+
+	if(tp->next == NULL) {
+		q->tail = tp;
+	}
+}
+
+
+static void queue_remove(threads_queue_t *q, thread_t *tp) {
+	thread_t **pp = &q->head;
+	thread_t *prev = NULL;
+
+	while((*pp != NULL) && (*pp != tp)) {
+		prev = *pp;
+		pp = &(*pp)->next;
+	}
+
+	if(*pp == tp) {
+		*pp = tp->next;
+
+		if(q->tail == tp) {
+			q->tail = prev;
+		}
+	}
+
+	tp->next = NULL;
+}
+
+
+static thread_t *queue_pop(threads_queue_t *q) {
+	thread_t *tp = q->head;
+
+	if(tp != NULL) {
+		queue_remove(q, tp);
+	}
+
+	return tp;
+}
+
+
+/*
+*	Moves the clock to the next timeout, fires the virtual timers and wakes up
+*	the threads whose timeout is over.
+*/
+static void sim_advance(void) {
+	uint64_t next = SIM_NEVER;
+
+	for(thread_t *tp = registry; tp != NULL; tp = tp->newer) {
+		if(((tp->state == SIM_SLEEPING) || (tp->state == SIM_WAITING)) && (tp->wake < next)) {
+			next = tp->wake;
+		}
+	}
+
+	for(virtual_timer_t *vtp = timers; vtp != NULL; vtp = vtp->next) {
+		if(vtp->armed && (vtp->deadline < next)) {
+			next = vtp->deadline;
+		}
+	}
+
+	if(next == SIM_NEVER) {
+		fprintf(stderr, "sim: every thread waits forever at %.3f s\n", sim_seconds());
+		sim_stop(1);
+	}
+
+	if(next > endTime) {
+		sim_world_advance(now, endTime);
+		now = endTime;
+		sim_stop(0);
+	}
+
+	sim_world_advance(now, next);
+	now = next;
+
+	inIsr = TRUE;
+
+	for(virtual_timer_t *vtp = timers; vtp != NULL; vtp = vtp->next) {
+		if(vtp->armed && (vtp->deadline <= now)) {
+			vtp->armed = FALSE;
+			vtp->func(vtp->par);
+		}
+	}
+
+	inIsr = FALSE;
+
+	for(thread_t *tp = registry; tp != NULL; tp = tp->newer) {
+		if(((tp->state == SIM_SLEEPING) || (tp->state == SIM_WAITING)) && (tp->wake <= now)) {
+			if(tp->queue != NULL) {
+				queue_remove(tp->queue, tp);
+				tp->queue = NULL;
+			}
+
+			tp->wake = SIM_NEVER;
+			tp->msg = MSG_TIMEOUT;
+			tp->state = SIM_READY;
+			queue_insert(&readyList, tp, FALSE);
+		}
+	}
+}
+
+
+/*
+*	Gives the cpu to the next ready thread. The calling thread has already left
+*	the running state and returns when it gets the cpu back.
+*/
+static void sim_go(thread_t *self) {
+	thread_t *next;
+
+	while((next = queue_pop(&readyList)) == NULL) {
+		sim_advance();
+	}
+
+	next->state = SIM_RUNNING;
+
+	if(next != self) {
+		current = next;
+		pthread_cond_signal(&next->cond);
+
+		while(current != self) {
+			pthread_cond_wait(&self->cond, &cpu);
+		}
+	}
+}
+
+
+/*
+*	Preemption: a thread of higher priority made ready takes the cpu at once.
+*/
+static void sim_reschedule(void) {
+	thread_t *self = current;
+
+	if((self->state == SIM_RUNNING) && !inIsr && (readyList.head != NULL)
+		&& (readyList.head->prio > self->prio)) {
+		self->state = SIM_READY;
+		queue_insert(&readyList, self, TRUE);
+		sim_go(self);
+	}
+}
+
+
+static msg_t sim_block(threads_queue_t *q, systime_t timeout) {
+	thread_t *self = current;
+
+	if(timeout == TIME_IMMEDIATE) {
+		return MSG_TIMEOUT;
+	}
+
+	self->wake = (timeout == TIME_INFINITE) ? SIM_NEVER : now + timeout;
+
+	if(q != NULL) {
+		self->state = SIM_WAITING;
+		self->queue = q;
+		queue_insert(q, self, FALSE);
+	} else {
+		self->state = SIM_SLEEPING;
+	}
+
+	sim_go(self);
+
+	return self->msg;
+}
+
+
+static void sim_wakeup(thread_t *tp, msg_t msg) {
+	if(tp->queue != NULL) {
+		queue_remove(tp->queue, tp);
+		tp->queue = NULL;
+	}
+
+	tp->wake = SIM_NEVER;
+	tp->msg = msg;
+	tp->state = SIM_READY;
+	queue_insert(&readyList, tp, FALSE);
+}
+
+
+static void *sim_thread_main(void *arg) {
+	thread_t *self = arg;
+
+	pthread_mutex_lock(&cpu);
+
+	while(current != self) {
+		pthread_cond_wait(&self->cond, &cpu);
+	}
+
+	self->func(self->arg);
+
+	self->state = SIM_FINAL;
+	sim_go(self);
+
+	return NULL;
+}
+
+
+/*======================================================================================*/
+/* 									 SIMULATION											*/
+/*======================================================================================*/
+
+uint64_t sim_now(void) {
+	return now;
+}
+
+
+double sim_seconds(void) {
+	return (double)now / CH_CFG_ST_FREQUENCY;
+}
+
+
+void sim_set_end(uint64_t ticks) {
+	endTime = ticks;
+}
+
+
+/*
+*	Starts the kernel with mainFunc as first thread, never returns.
+*/
+void sim_kernel_start(tfunc_t mainFunc) {
+	pthread_mutex_lock(&cpu);
+	pthread_cond_init(&idleThread.cond, NULL);
+
+	// Registry in the order of ChibiOS, idle is never scheduled (SIM_FINAL)
+	registry = &idleThread;
+	chThdCreateStatic(NULL, 0, NORMALPRIO, mainFunc, NULL)->name = "main";
+
+	sim_go(&idleThread);
+
+	// The idle context never runs again
+	while(1) {
+		pthread_cond_wait(&idleThread.cond, &cpu);
+	}
+}
+
+
+void sim_stop(int code) {
+	sim_world_report();
+	sim_flash_save();
+	fflush(stdout);
+	exit(code);
+}
+
+
+/*======================================================================================*/
+/* 									 SYSTEM API											*/
+/*======================================================================================*/
+
+void halInit(void) {
+}
+
+
+void chSysInit(void) {
+}
+
+
+void chSysHalt(const char *reason) {
+	fprintf(stderr, "sim: system halted at %.3f s: %s\n", sim_seconds(), reason);
+	fflush(stdout);
+	abort();
+}
+
+
+/*
+*	The realtime counter follows the simulated clock plus the host CPU time of the
+*	process, so the cycles measured around a section of code (profiling.h) are the host
+*	cycles scaled to the core clock. As only one thread runs at a time, the counter is
+*	also consistent between the threads for the latencies of trace.h. Only diagnostics
+*	use it, the runs stay deterministic.
+*/
+rtcnt_t chSysGetRealtimeCounterX(void) {
+	struct timespec ts;
+	uint64_t cpuNs;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	cpuNs = (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+
+	return (rtcnt_t)(now * (STM32_SYSCLK / CH_CFG_ST_FREQUENCY) + cpuNs * (STM32_SYSCLK / 1000000) / 1000);
+}
+
+
+thread_t *chSysGetIdleThreadX(void) {
+	return &idleThread;
+}
+
+
+/*======================================================================================*/
+/* 									 THREADS API										*/
+/*======================================================================================*/
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg) {
+	thread_t *tp = calloc(1, sizeof(thread_t));
+	thread_t **pp = &registry;
+	pthread_attr_t attr;
+
+	(void)wsp;
+	(void)size;
+
+	pthread_cond_init(&tp->cond, NULL);
+	tp->prio = prio;
+	tp->state = SIM_READY;
+	tp->wake = SIM_NEVER;
+	tp->func = pf;
+	tp->arg = arg;
+
+	while(*pp != NULL) {
+		pp = &(*pp)->newer;
+	}
+
+	*pp = tp;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, 1024 * 1024);
+
+	if(pthread_create(&tp->pthread, &attr, sim_thread_main, tp) != 0) {
+		chSysHalt("pthread_create");
+	}
+
+	pthread_attr_destroy(&attr);
+
+	queue_insert(&readyList, tp, FALSE);
+	sim_reschedule();
+
+	return tp;
+}
+
+
+void chRegSetThreadName(const char *name) {
+	current->name = name;
+}
+
+
+thread_t *chThdGetSelfX(void) {
+	return inIsr ? &idleThread : current;
+}
+
+
+tprio_t chThdGetPriorityX(void) {
+	return current->prio;
+}
+
+
+void chThdSleep(systime_t time) {
+	sim_block(NULL, time);
+}
+
+
+void chThdSleepUntil(systime_t time) {
+	sim_block(NULL, (systime_t)(time - chVTGetSystemTime()));
+}
+
+
+systime_t chThdSleepUntilWindowed(systime_t prev, systime_t next) {
+	if(chVTIsSystemTimeWithinX(prev, next)) {
+		chThdSleep((systime_t)(next - chVTGetSystemTime()));
+	}
+
+	return next;
+}
+
+
+void chThdYield(void) {
+	thread_t *self = current;
+
+	self->state = SIM_READY;
+	queue_insert(&readyList, self, FALSE);
+	sim_go(self);
+}
+
+
+thread_t *chRegFirstThread(void) {
+	return registry;
+}
+
+
+thread_t *chRegNextThread(thread_t *tp) {
+	return tp->newer;
+}
+
+
+const char *chRegGetThreadNameX(thread_t *tp) {
+	return tp->name;
+}
+
+
+/*======================================================================================*/
+/* 								 VIRTUAL TIMERS API										*/
+/*======================================================================================*/
+
+systime_t chVTGetSystemTime(void) {
+	return (systime_t)now;
+}
+
+
+void chVTObjectInit(virtual_timer_t *vtp) {
+	vtp->armed = FALSE;
+}
+
+
+void chVTSet(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par) {
+	virtual_timer_t *it = timers;
+
+	while((it != NULL) && (it != vtp)) {
+		it = it->next;
+	}
+
+	if(it == NULL) {
+		vtp->next = timers;
+		timers = vtp;
+	}
+
+	vtp->deadline = now + ((delay > 0) ? delay : 1);
+	vtp->func = vtfunc;
+	vtp->par = par;
+	vtp->armed = TRUE;
+}
+
+
+void chVTReset(virtual_timer_t *vtp) {
+	vtp->armed = FALSE;
+}
+
+
+/*======================================================================================*/
+/* 							MUTEXES AND CONDITION VARIABLES API							*/
+/*======================================================================================*/
+
+void chMtxObjectInit(mutex_t *mp) {
+	memset(mp, 0, sizeof(*mp));
+}
+
+
+void chMtxLock(mutex_t *mp) {
+	thread_t *self = current;
+
+	if(mp->owner == NULL) {
+		mp->owner = self;
+	} else {
+		chDbgAssert(mp->owner != self, "recursive mutex lock");
+		sim_block(&mp->queue, TIME_INFINITE);
+	}
+
+	mp->next = self->mtxlist;
+	self->mtxlist = mp;
+}
+
+
+bool chMtxTryLock(mutex_t *mp) {
+	if(mp->owner != NULL) {
+		return FALSE;
+	}
+
+	chMtxLock(mp);
+
+	return TRUE;
+}
+
+
+/*
+*	Releases a mutex, the ownership goes to the first waiting thread.
+*/
+static void sim_mtx_release(mutex_t *mp) {
+	thread_t *self = current;
+	mutex_t **pp = &self->mtxlist;
+	thread_t *tp;
+
+	chDbgAssert(mp->owner == self, "unlock of a mutex not owned");
+
+	while((*pp != NULL) && (*pp != mp)) {
+		pp = &(*pp)->next;
+	}
+
+	if(*pp != NULL) {
+		*pp = mp->next;
+	}
+
+	tp = queue_pop(&mp->queue);
+	mp->owner = tp;
+
+	if(tp != NULL) {
+		tp->queue = NULL;
+		sim_wakeup(tp, MSG_OK);
+	}
+}
+
+
+void chMtxUnlock(mutex_t *mp) {
+	sim_mtx_release(mp);
+	sim_reschedule();
+}
+
+
+void chCondObjectInit(condition_variable_t *cp) {
+	memset(cp, 0, sizeof(*cp));
+}
+
+
+msg_t chCondWaitTimeout(condition_variable_t *cp, systime_t time) {
+	mutex_t *mp = current->mtxlist;
+	msg_t msg;
+
+	chDbgAssert(mp != NULL, "condition variable wait without mutex");
+
+	sim_mtx_release(mp);
+	msg = sim_block(&cp->queue, time);
+
+	// As on ChibiOS, the mutex is not taken back on timeout
+	if(msg != MSG_TIMEOUT) {
+		chMtxLock(mp);
+	}
+
+	return msg;
+}
+
+
+msg_t chCondWait(condition_variable_t *cp) {
+	return chCondWaitTimeout(cp, TIME_INFINITE);
+}
+
+
+void chCondSignal(condition_variable_t *cp) {
+	thread_t *tp = queue_pop(&cp->queue);
+
+	if(tp != NULL) {
+		tp->queue = NULL;
+		sim_wakeup(tp, MSG_OK);
+		sim_reschedule();
+	}
+}
+
+
+void chCondBroadcastI(condition_variable_t *cp) {
+	thread_t *tp;
+
+	while((tp = queue_pop(&cp->queue)) != NULL) {
+		tp->queue = NULL;
+		sim_wakeup(tp, MSG_RESET);
+	}
+}
+
+
+void chCondBroadcast(condition_variable_t *cp) {
+	chCondBroadcastI(cp);
+	sim_reschedule();
+}
+
+
+/*======================================================================================*/
+/* 									SEMAPHORES API										*/
+/*======================================================================================*/
+
+void chSemObjectInit(semaphore_t *sp, cnt_t n) {
+	sp->queue.head = NULL;
+	sp->queue.tail = NULL;
+	sp->cnt = n;
+}
+
+
+msg_t chSemWaitTimeout(semaphore_t *sp, systime_t time) {
+	if(sp->cnt > 0) {
+		sp->cnt--;
+		return MSG_OK;
+	}
+
+	return sim_block(&sp->queue, time);
+}
+
+
+msg_t chSemWait(semaphore_t *sp) {
+	return chSemWaitTimeout(sp, TIME_INFINITE);
+}
+
+
+void chSemSignalI(semaphore_t *sp) {
+	thread_t *tp = queue_pop(&sp->queue);
+
+	if(tp != NULL) {
+		tp->queue = NULL;
+		sim_wakeup(tp, MSG_OK);
+	} else {
+		sp->cnt++;
+	}
+}
+
+
+void chSemSignal(semaphore_t *sp) {
+	chSemSignalI(sp);
+	sim_reschedule();
+}
+
+
+void chBSemObjectInit(binary_semaphore_t *bsp, bool taken) {
+	chSemObjectInit(&bsp->sem, taken ? 0 : 1);
+}
+
+
+msg_t chBSemWaitTimeout(binary_semaphore_t *bsp, systime_t time) {
+	return chSemWaitTimeout(&bsp->sem, time);
+}
+
+
+msg_t chBSemWait(binary_semaphore_t *bsp) {
+	return chSemWaitTimeout(&bsp->sem, TIME_INFINITE);
+}
+
+
+void chBSemSignalI(binary_semaphore_t *bsp) {
+	if(bsp->sem.queue.head != NULL) {
+		chSemSignalI(&bsp->sem);
+	} else {
+		bsp->sem.cnt = 1;
+	}
+}
+
+
+void chBSemSignal(binary_semaphore_t *bsp) {
+	chBSemSignalI(bsp);
+	sim_reschedule();
+}
+
+
+void chBSemReset(binary_semaphore_t *bsp, bool taken) {
+	thread_t *tp;
+
+	while((tp = queue_pop(&bsp->sem.queue)) != NULL) {
+		tp->queue = NULL;
+		sim_wakeup(tp, MSG_RESET);
+	}
+
+	bsp->sem.cnt = taken ? 0 : 1;
+	sim_reschedule();
+}
+
+
+/*======================================================================================*/
+/* 									 MAILBOXES API										*/
+/*======================================================================================*/
+
+void chMBObjectInit(mailbox_t *mbp, msg_t *buf, size_t n) {
+	mbp->buffer = buf;
+	mbp->top = buf + n;
+	mbp->wrptr = buf;
+	mbp->rdptr = buf;
+	chSemObjectInit(&mbp->fullsem, n);
+	chSemObjectInit(&mbp->emptysem, 0);
+}
+
+
+void chMBReset(mailbox_t *mbp) {
+	thread_t *tp;
+
+	while((tp = queue_pop(&mbp->fullsem.queue)) != NULL) {
+		tp->queue = NULL;
+		sim_wakeup(tp, MSG_RESET);
+	}
+
+	while((tp = queue_pop(&mbp->emptysem.queue)) != NULL) {
+		tp->queue = NULL;
+		sim_wakeup(tp, MSG_RESET);
+	}
+
+	chMBObjectInit(mbp, mbp->buffer, mbp->top - mbp->buffer);
+	sim_reschedule();
+}
+
+
+static void sim_mb_write(mailbox_t *mbp, msg_t msg) {
+	*mbp->wrptr++ = msg;
+
+	if(mbp->wrptr >= mbp->top) {
+		mbp->wrptr = mbp->buffer;
+	}
+
+	chSemSignalI(&mbp->emptysem);
+}
+
+
+static msg_t sim_mb_read(mailbox_t *mbp) {
+	msg_t msg = *mbp->rdptr++;
+
+	if(mbp->rdptr >= mbp->top) {
+		mbp->rdptr = mbp->buffer;
+	}
+
+	chSemSignalI(&mbp->fullsem);
+
+	return msg;
+}
+
+
+msg_t chMBPost(mailbox_t *mbp, msg_t msg, systime_t timeout) {
+	msg_t rdymsg = chSemWaitTimeout(&mbp->fullsem, timeout);
+
+	if(rdymsg == MSG_OK) {
+		sim_mb_write(mbp, msg);
+		sim_reschedule();
+	}
+
+	return rdymsg;
+}
+
+
+msg_t chMBPostI(mailbox_t *mbp, msg_t msg) {
+	if(mbp->fullsem.cnt <= 0) {
+		return MSG_TIMEOUT;
+	}
+
+	mbp->fullsem.cnt--;
+	sim_mb_write(mbp, msg);
+
+	return MSG_OK;
+}
+
+
+msg_t chMBFetch(mailbox_t *mbp, msg_t *msgp, systime_t timeout) {
+	msg_t rdymsg = chSemWaitTimeout(&mbp->emptysem, timeout);
+
+	if(rdymsg == MSG_OK) {
+		*msgp = sim_mb_read(mbp);
+		sim_reschedule();
+	}
+
+	return rdymsg;
+}
+
+
+msg_t chMBFetchI(mailbox_t *mbp, msg_t *msgp) {
+	if(mbp->emptysem.cnt <= 0) {
+		return MSG_TIMEOUT;
+	}
+
+	mbp->emptysem.cnt--;
+	*msgp = sim_mb_read(mbp);
+
+	return MSG_OK;
+}
@@ -0,0 +1,140 @@
+/*
+  \file   	sim_main.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Entry point of the host simulation: runs the firmware main() on the
+  			simulated kernel and world
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+
+#include "sim.h"
+#include "sim_replay.h"
+
+
+// main() of the firmware, renamed by the build
+int firmware_main(void);
+
+sim_options_t simOptions = {
+	.players = 2,
+	.seed = 1,
+	.duration = 600,
+	.verbose = false,
+	.usbOut = NULL,
+	.replay = NULL,
+	.flash = NULL,
+};
+
+
+static void firmware_thd(void *arg) {
+	(void)arg;
+
+	firmware_main();
+}
+
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [--players N] [--duration S] [--seed N] [--avoidance] "
+					"[--usb FILE] [--replay FILE] [--set NAME=VALUE]... [--command LINE]... "
+					"[--flash FILE] [--verbose]\n", name);
+	exit(2);
+}
+
+
+int main(int argc, char **argv) {
+	static const struct option options[] = {
+		{"players", required_argument, NULL, 'p'},
+		{"duration", required_argument, NULL, 'd'},
+		{"seed", required_argument, NULL, 's'},
+		{"avoidance", no_argument, NULL, 'a'},
+		{"usb", required_argument, NULL, 'u'},
+		{"replay", required_argument, NULL, 'r'},
+		{"set", required_argument, NULL, 'S'},
+		{"command", required_argument, NULL, 'c'},
+		{"flash", required_argument, NULL, 'f'},
+		{"verbose", no_argument, NULL, 'v'},
+		{NULL, 0, NULL, 0},
+	};
+	int opt;
+
+	while((opt = getopt_long(argc, argv, "p:d:s:au:r:S:c:f:v", options, NULL)) != -1) {
+		switch(opt) {
+			case 'p':
+				simOptions.players = atoi(optarg);
+				break;
+
+			case 'd':
+				simOptions.duration = atoi(optarg);
+				break;
+
+			case 's':
+				simOptions.seed = strtoul(optarg, NULL, 0);
+				break;
+
+			// Same as --set avoidance=1
+			case 'a':
+				if(simOptions.nbSets == SIM_MAX_SETS) {
+					usage(argv[0]);
+				}
+
+				simOptions.sets[simOptions.nbSets++] = "avoidance=1";
+				break;
+
+			case 'u':
+				simOptions.usbOut = optarg;
+				break;
+
+			case 'r':
+				simOptions.replay = optarg;
+				break;
+
+			case 'S':
+				if((simOptions.nbSets == SIM_MAX_SETS) || (strchr(optarg, '=') == NULL)) {
+					usage(argv[0]);
+				}
+
+				simOptions.sets[simOptions.nbSets++] = optarg;
+				break;
+
+			case 'c':
+				if(simOptions.nbCommands == SIM_MAX_SETS) {
+					usage(argv[0]);
+				}
+
+				simOptions.commands[simOptions.nbCommands++] = optarg;
+				break;
+
+			case 'f':
+				simOptions.flash = optarg;
+				break;
+
+			case 'v':
+				simOptions.verbose = true;
+				break;
+
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if((simOptions.players < 1) || (simOptions.players > 15)) {
+		usage(argv[0]);
+	}
+
+	sim_world_init();
+	sim_flash_load();
+	sim_set_end((uint64_t)simOptions.duration * CH_CFG_ST_FREQUENCY);
+
+	if((simOptions.replay != NULL) && !sim_replay_open(simOptions.replay)) {
+		return 1;
+	}
+	sim_kernel_start(firmware_thd);
+
+	return 0;
+}
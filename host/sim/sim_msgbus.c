@@ -0,0 +1,114 @@
+/*
+  \file   	sim_msgbus.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Message bus of the e-puck2 library on top of the simulated kernel
+*/
+
+#include <string.h>
+
+#include "ch.h"
+
+#include "msgbus/messagebus.h"
+
+
+void messagebus_init(messagebus_t *bus, void *lock, void *condvar) {
+	memset(bus, 0, sizeof(messagebus_t));
+	bus->lock = lock;
+	bus->condvar = condvar;
+}
+
+
+void messagebus_topic_init(messagebus_topic_t *topic, void *topic_lock, void *topic_condvar,
+							void *buffer, size_t buffer_len) {
+	memset(topic, 0, sizeof(messagebus_topic_t));
+	topic->buffer = buffer;
+	topic->buffer_len = buffer_len;
+	topic->lock = topic_lock;
+	topic->condvar = topic_condvar;
+}
+
+
+void messagebus_advertise_topic(messagebus_t *bus, messagebus_topic_t *topic, const char *name) {
+	strncpy(topic->name, name, TOPIC_NAME_MAX_LENGTH);
+	topic->name[TOPIC_NAME_MAX_LENGTH] = '\0';
+
+	chMtxLock(bus->lock);
+	topic->next = bus->topics.head;
+	bus->topics.head = topic;
+	chCondBroadcast(bus->condvar);
+	chMtxUnlock(bus->lock);
+}
+
+
+static messagebus_topic_t *topic_by_name(messagebus_t *bus, const char *name) {
+	for(messagebus_topic_t *t = bus->topics.head; t != NULL; t = t->next) {
+		if(strcmp(t->name, name) == 0) {
+			return t;
+		}
+	}
+
+	return NULL;
+}
+
+
+messagebus_topic_t *messagebus_find_topic(messagebus_t *bus, const char *name) {
+	messagebus_topic_t *res;
+
+	chMtxLock(bus->lock);
+	res = topic_by_name(bus, name);
+	chMtxUnlock(bus->lock);
+
+	return res;
+}
+
+
+messagebus_topic_t *messagebus_find_topic_blocking(messagebus_t *bus, const char *name) {
+	messagebus_topic_t *res;
+
+	chMtxLock(bus->lock);
+
+	while((res = topic_by_name(bus, name)) == NULL) {
+		chCondWait(bus->condvar);
+	}
+
+	chMtxUnlock(bus->lock);
+
+	return res;
+}
+
+
+void messagebus_topic_publish(messagebus_topic_t *topic, void *buf, size_t buf_len) {
+	chDbgAssert(buf_len <= topic->buffer_len, "message larger than the topic buffer");
+
+	chMtxLock(topic->lock);
+	memcpy(topic->buffer, buf, buf_len);
+	topic->published = true;
+	chCondBroadcast(topic->condvar);
+	chMtxUnlock(topic->lock);
+}
+
+
+bool messagebus_topic_read(messagebus_topic_t *topic, void *buf, size_t buf_len) {
+	bool published;
+
+	chMtxLock(topic->lock);
+	published = topic->published;
+
+	if(published) {
+		memcpy(buf, topic->buffer, buf_len);
+	}
+
+	chMtxUnlock(topic->lock);
+
+	return published;
+}
+
+
+void messagebus_topic_wait(messagebus_topic_t *topic, void *buf, size_t buf_len) {
+	chMtxLock(topic->lock);
+	chCondWait(topic->condvar);
+	memcpy(buf, topic->buffer, buf_len);
+	chMtxUnlock(topic->lock);
+}
@@ -0,0 +1,162 @@
+/*
+  \file   	sim_parameter.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Parameter tree of the e-puck2 library (namespaces, scalar and integer
+  			parameters) for the host build
+*/
+
+#include <string.h>
+
+#include "ch.h"
+#include "parameter/parameter.h"
+
+
+#define PARAM_TYPE_SCALAR		1
+#define PARAM_TYPE_INTEGER		2
+
+
+void parameter_namespace_declare(parameter_namespace_t *ns, parameter_namespace_t *parent, const char *id) {
+	memset(ns, 0, sizeof(parameter_namespace_t));
+	ns->id = id;
+	ns->parent = parent;
+
+	if(parent != NULL) {
+		ns->next = parent->subspaces;
+		parent->subspaces = ns;
+	}
+}
+
+
+static void parameter_declare(parameter_t *p, parameter_namespace_t *ns, const char *id, uint8_t type) {
+	memset(p, 0, sizeof(parameter_t));
+	p->id = id;
+	p->ns = ns;
+	p->type = type;
+	p->next = ns->parameter_list;
+	ns->parameter_list = p;
+}
+
+
+// Marks the namespaces up to the root, they count their changed parameters
+static void parameter_set_changed(parameter_t *p) {
+	if(!p->changed) {
+		for(parameter_namespace_t *ns = p->ns; ns != NULL; ns = ns->parent) {
+			ns->changed_cnt++;
+		}
+	}
+
+	p->changed = true;
+	p->defined = true;
+}
+
+
+static void parameter_clear_changed(parameter_t *p) {
+	if(p->changed) {
+		for(parameter_namespace_t *ns = p->ns; ns != NULL; ns = ns->parent) {
+			ns->changed_cnt--;
+		}
+	}
+
+	p->changed = false;
+}
+
+
+/*
+*	Finds a parameter from a path relative to ns, like "sub/id" or "/sub/id".
+*/
+parameter_t *parameter_find(parameter_namespace_t *ns, const char *id) {
+	const char *sep;
+	size_t len;
+
+	while((ns != NULL) && (id != NULL)) {
+		while(*id == '/') {
+			id++;
+		}
+
+		if((sep = strchr(id, '/')) == NULL) {
+			for(parameter_t *p = ns->parameter_list; p != NULL; p = p->next) {
+				if(strcmp(p->id, id) == 0) {
+					return p;
+				}
+			}
+
+			return NULL;
+		}
+
+		len = sep - id;
+		parameter_namespace_t *sub = ns->subspaces;
+
+		while((sub != NULL) && ((strlen(sub->id) != len) || strncmp(sub->id, id, len))) {
+			sub = sub->next;
+		}
+
+		ns = sub;
+		id = sep + 1;
+	}
+
+	return NULL;
+}
+
+
+bool parameter_changed(const parameter_t *p) {
+	return p->changed;
+}
+
+
+bool parameter_namespace_contains_changed(const parameter_namespace_t *ns) {
+	return ns->changed_cnt > 0;
+}
+
+
+void parameter_scalar_declare_with_default(parameter_t *p, parameter_namespace_t *ns, const char *id,
+										   float default_val) {
+	parameter_declare(p, ns, id, PARAM_TYPE_SCALAR);
+	p->value.s = default_val;
+	parameter_set_changed(p);
+}
+
+
+float parameter_scalar_get(parameter_t *p) {
+	parameter_clear_changed(p);
+
+	return p->value.s;
+}
+
+
+float parameter_scalar_read(parameter_t *p) {
+	return p->value.s;
+}
+
+
+void parameter_scalar_set(parameter_t *p, float value) {
+	p->value.s = value;
+	parameter_set_changed(p);
+}
+
+
+void parameter_integer_declare_with_default(parameter_t *p, parameter_namespace_t *ns, const char *id,
+											int32_t default_val) {
+	parameter_declare(p, ns, id, PARAM_TYPE_INTEGER);
+	p->value.i = default_val;
+	parameter_set_changed(p);
+}
+
+
+int32_t parameter_integer_get(parameter_t *p) {
+	parameter_clear_changed(p);
+
+	return p->value.i;
+}
+
+
+int32_t parameter_integer_read(parameter_t *p) {
+	return p->value.i;
+}
+
+
+void parameter_integer_set(parameter_t *p, int32_t value) {
+	p->value.i = value;
+	parameter_set_changed(p);
+}
@@ -0,0 +1,139 @@
+/*
+  \file   	sim_replay.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Replay of a sensor recording (see capture.h): the simulated devices give the
+  			recorded chunks to the firmware at their recorded time instead of sampling
+  			the simulated world
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+
+#include "sim.h"
+#include "sim_replay.h"
+
+
+static uint8_t *data = NULL;
+static uint32_t size = 0;
+static uint32_t *chunks = NULL;			// offset of the valid chunks
+static uint32_t nbChunks = 0;
+
+
+static uint16_t crc16(uint16_t crc, const uint8_t *buf, uint32_t len) {
+	for(uint32_t i = 0; i < len; i++) {
+		crc ^= buf[i] << 8;
+
+		for(uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+
+/*
+*	Loads a recording and indexes its valid chunks, the bytes around a corrupted
+*	chunk are skipped till the next sync byte.
+*/
+bool sim_replay_open(const char *path) {
+	FILE *f = fopen(path, "rb");
+	uint32_t pos = 0, skipped = 0, lastTime = 0;
+
+	if(f == NULL) {
+		perror(path);
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(size + 1);
+	chunks = malloc(sizeof(uint32_t) * (size / sizeof(capture_header_t) + 1));
+
+	if((data == NULL) || (chunks == NULL) || (fread(data, 1, size, f) != size)) {
+		fclose(f);
+		return false;
+	}
+
+	fclose(f);
+
+	while(pos + sizeof(capture_header_t) + 2 <= size) {
+		capture_header_t header;
+		uint16_t crc;
+
+		memcpy(&header, &data[pos], sizeof(header));
+
+		if((header.sync == CAPTURE_SYNC) && (header.stream < CAPTURE_NB_STREAMS)
+			&& (pos + sizeof(header) + header.len + 2 <= size)) {
+			memcpy(&crc, &data[pos + sizeof(header) + header.len], sizeof(crc));
+
+			if(crc16(CAPTURE_CRC_INIT, &data[pos + 1], sizeof(header) - 1 + header.len) == crc) {
+				chunks[nbChunks++] = pos;
+				lastTime = header.time;
+				pos += sizeof(header) + header.len + 2;
+				continue;
+			}
+		}
+
+		pos++;
+		skipped++;
+	}
+
+	printf("replay of %s: %u chunks over %.3f s, %u bytes skipped\n", path, nbChunks,
+		   lastTime / 1e6, skipped);
+
+	// The simulation ends one second after the last sample
+	sim_set_end((uint64_t)lastTime / (1000000 / CH_CFG_ST_FREQUENCY) + S2ST(1));
+
+	return nbChunks > 0;
+}
+
+
+bool sim_replay_active(void) {
+	return data != NULL;
+}
+
+
+/*
+*	Next chunk of the streams of a cursor, NULL at the end of the recording.
+*/
+const capture_header_t *sim_replay_next(sim_replay_cursor_t *cursor) {
+	while(cursor->pos < nbChunks) {
+		const capture_header_t *chunk = (const capture_header_t *)&data[chunks[cursor->pos++]];
+
+		if(cursor->streams & (1 << chunk->stream)) {
+			return chunk;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+*	Sleeps till the recorded time of a chunk.
+*/
+void sim_replay_wait(const capture_header_t *chunk) {
+	systime_t time = chunk->time / (1000000 / CH_CFG_ST_FREQUENCY);
+
+	if((systime_t)(time - chVTGetSystemTime()) < (systime_t)(TIME_INFINITE / 2)) {
+		chThdSleep(time - chVTGetSystemTime());
+	}
+}
+
+
+/*
+*	Copies the payload of a chunk, zero-padded to len bytes.
+*/
+void sim_replay_payload(const capture_header_t *chunk, void *buf, uint16_t len) {
+	uint16_t n = (chunk->len < len) ? chunk->len : len;
+
+	memset(buf, 0, len);
+	memcpy(buf, (const uint8_t *)chunk + sizeof(capture_header_t), n);
+}
@@ -0,0 +1,24 @@
+#ifndef SIM_REPLAY_H
+#define SIM_REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "capture.h"
+
+
+// Position of a device in the recording, it reads the chunks of the given streams
+typedef struct {
+	uint32_t pos;
+	uint16_t streams;
+} sim_replay_cursor_t;
+
+
+bool sim_replay_open(const char *path);
+bool sim_replay_active(void);
+const capture_header_t *sim_replay_next(sim_replay_cursor_t *cursor);
+void sim_replay_wait(const capture_header_t *chunk);
+void sim_replay_payload(const capture_header_t *chunk, void *buf, uint16_t len);
+
+
+#endif /* SIM_REPLAY_H */
@@ -0,0 +1,490 @@
+/*
+  \file   	sim_world.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Simulated arena: kinematics of the e-puck2, walls seen by the sensors, and
+  			the virtual player and operator who answer the LEDs of the robot
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "motor_arbiter.h"
+#include "run_log.h"
+#include "trace.h"
+#include "tuning.h"
+
+#include "sim.h"
+#include "sim_replay.h"
+#include "sim_world.h"
+
+
+#define WORLD_STEP			10			// integration step in [ticks]
+#define NB_PLAYERS_MAX		15
+
+// Arena: closed box around the start line with the striped finish wall at ARENA_MAX_X
+#define ARENA_MIN_X			-20.0
+#define ARENA_MAX_X			120.0
+#define ARENA_HALF_WIDTH	40.0
+#define STRIPES_HALF_WIDTH	30.0
+#define STRIPES_PERIOD		0.9			// [cm]
+#define STRIPES_BLACK		0.6			// [cm]
+#define WALL_GREY			0xF8
+#define STRIPE_GREY			0x00
+
+// Player behavior
+#define PLAYER_BASE_BIN		14			// whistle of the first player (FFT bin)
+#define PLAYER_MAX_SHIFT	4			// max bins off the calibration to steer
+#define PLAYER_GAIN			6.0			// bins per radian of heading error
+#define PLAYER_REACHED		6.0			// waypoint radius in [cm]
+#define PLAYER_STOP_X		106.0		// the player stops whistling in front of the finish
+#define OPERATOR_DELAY		5000		// still time near the start before the selector [ticks]
+
+typedef struct {
+	double x1, y1, x2, y2;
+} segment_t;
+
+typedef enum {
+	PHASE_SETUP,
+	PHASE_CALIBRATION,
+	PHASE_COUNTDOWN,
+	PHASE_GAME,
+	PHASE_RETURN,
+	PHASE_WAIT,
+	PHASE_OVER,
+} phase_t;
+
+typedef struct {
+	double time;
+	double path;
+	double returnTime;
+	uint32_t contacts;
+} player_stats_t;
+
+sim_robot_t robot;
+
+static const segment_t walls[] = {
+	{ARENA_MIN_X, -ARENA_HALF_WIDTH, ARENA_MAX_X, -ARENA_HALF_WIDTH},
+	{ARENA_MAX_X, -ARENA_HALF_WIDTH, ARENA_MAX_X, ARENA_HALF_WIDTH},
+	{ARENA_MAX_X, ARENA_HALF_WIDTH, ARENA_MIN_X, ARENA_HALF_WIDTH},
+	{ARENA_MIN_X, ARENA_HALF_WIDTH, ARENA_MIN_X, -ARENA_HALF_WIDTH},
+	// Obstacle in the middle of the arena
+	{50, -6, 58, -6},
+	{58, -6, 58, 6},
+	{58, 6, 50, 6},
+	{50, 6, 50, -6},
+};
+
+#define NB_WALLS	(sizeof(walls) / sizeof(walls[0]))
+
+// Angle and offset of the IR sensors
+static const float proxAngle[8] = {-0.297f, -0.855f, -1.571f, -2.618f, 2.618f, 1.571f, 0.855f, 0.297f};
+static float proxOffset[8];
+
+static uint32_t randState = 1;
+static phase_t phase = PHASE_SETUP;
+static uint64_t phaseStart = 0;
+static uint64_t stillSince = 0;
+static uint64_t returnStart = 0;
+static bool returning = FALSE;
+static bool countdownFull = FALSE;
+static bool inContact = FALSE;
+static uint8_t finished = 0;
+static uint8_t waypoint = 0;
+static player_stats_t stats[NB_PLAYERS_MAX];
+
+
+/*======================================================================================*/
+/* 										NOISE											*/
+/*======================================================================================*/
+
+uint32_t sim_rand(void) {
+	// xorshift32
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+
+	return randState;
+}
+
+
+/*
+*	Uniform noise in [-amplitude, amplitude].
+*/
+float sim_noise(float amplitude) {
+	return amplitude * (2.0f * (sim_rand() / 4294967296.0f) - 1.0f);
+}
+
+
+/*======================================================================================*/
+/* 									   SENSORS											*/
+/*======================================================================================*/
+
+/*
+*	Distance in [cm] from (x, y) to the first wall in the given direction.
+*/
+static float ray_cast(double x, double y, double angle, const segment_t **hit) {
+	double dx = cos(angle), dy = sin(angle);
+	double best = 1e9;
+
+	*hit = NULL;
+
+	for(uint8_t i = 0; i < NB_WALLS; i++) {
+		const segment_t *w = &walls[i];
+		double ex = w->x2 - w->x1, ey = w->y2 - w->y1;
+		double den = dx * ey - dy * ex;
+		double t, u;
+
+		if(fabs(den) < 1e-12) {
+			continue;
+		}
+
+		t = ((w->x1 - x) * ey - (w->y1 - y) * ex) / den;
+		u = ((w->x1 - x) * dy - (w->y1 - y) * dx) / den;
+
+		if((t >= 0) && (u >= 0) && (u <= 1) && (t < best)) {
+			best = t;
+			*hit = w;
+		}
+	}
+
+	return best;
+}
+
+
+float sim_world_ray(double x, double y, double angle) {
+	const segment_t *hit;
+
+	return ray_cast(x, y, angle, &hit);
+}
+
+
+/*
+*	Grey level seen in the given direction: the finish wall is striped.
+*/
+uint8_t sim_world_color(double x, double y, double angle) {
+	const segment_t *hit;
+	float dist = ray_cast(x, y, angle, &hit);
+	double hitY, stripe;
+
+	if(hit != &walls[1]) {
+		return WALL_GREY;
+	}
+
+	hitY = y + dist * sin(angle);
+
+	if(fabs(hitY) > STRIPES_HALF_WIDTH) {
+		return WALL_GREY;
+	}
+
+	stripe = fmod(hitY + STRIPES_HALF_WIDTH, STRIPES_PERIOD);
+
+	return (stripe < STRIPES_BLACK) ? STRIPE_GREY : WALL_GREY;
+}
+
+
+/*
+*	Delta of the eight IR sensors: reflection decreasing with the square of the
+*	distance, a constant offset per sensor and some noise.
+*/
+void sim_world_proximity(unsigned int delta[8]) {
+	for(uint8_t i = 0; i < 8; i++) {
+		double angle = robot.theta + proxAngle[i];
+		double sx = robot.x + ROBOT_RADIUS * cos(angle);
+		double sy = robot.y + ROBOT_RADIUS * sin(angle);
+		float dist = 1e9, value;
+
+		// Narrow cone of three rays
+		for(int8_t k = -1; k <= 1; k++) {
+			float d = sim_world_ray(sx, sy, angle + k * 0.15);
+
+			if(d < dist) {
+				dist = d;
+			}
+		}
+
+		value = PROX_GAIN / (1 + (dist / PROX_RANGE) * (dist / PROX_RANGE)) + proxOffset[i]
+				+ sim_noise(6);
+		delta[i] = (value < 0) ? 0 : (unsigned int)value;
+	}
+}
+
+
+/*======================================================================================*/
+/* 									  KINEMATICS										*/
+/*======================================================================================*/
+
+/*
+*	Keeps the robot out of the walls, returns TRUE when it touches one.
+*/
+static bool collide(void) {
+	bool contact = FALSE;
+
+	for(uint8_t i = 0; i < NB_WALLS; i++) {
+		const segment_t *w = &walls[i];
+		double ex = w->x2 - w->x1, ey = w->y2 - w->y1;
+		double u = ((robot.x - w->x1) * ex + (robot.y - w->y1) * ey) / (ex * ex + ey * ey);
+		double px, py, dist;
+
+		u = (u < 0) ? 0 : ((u > 1) ? 1 : u);
+		px = w->x1 + u * ex;
+		py = w->y1 + u * ey;
+		dist = hypot(robot.x - px, robot.y - py);
+
+		if((dist < ROBOT_RADIUS) && (dist > 1e-9)) {
+			robot.x = px + (robot.x - px) * ROBOT_RADIUS / dist;
+			robot.y = py + (robot.y - py) * ROBOT_RADIUS / dist;
+			contact = TRUE;
+		}
+	}
+
+	return contact;
+}
+
+
+static void integrate(double dt) {
+	double left = robot.leftSpeed * dt, right = robot.rightSpeed * dt;
+	double leftDist = left * ROBOT_WHEEL_PERIMETER / ROBOT_STEPS_PER_TURN;
+	double rightDist = right * ROBOT_WHEEL_PERIMETER / ROBOT_STEPS_PER_TURN;
+	double dist = (leftDist + rightDist) / 2;
+	double dTheta = (rightDist - leftDist) / ROBOT_WHEEL_DISTANCE;
+	bool contact;
+
+	robot.leftPos += left;
+	robot.rightPos += right;
+	robot.x += dist * cos(robot.theta + dTheta / 2);
+	robot.y += dist * sin(robot.theta + dTheta / 2);
+	robot.theta = remainder(robot.theta + dTheta, 2 * M_PI);
+
+	contact = collide();
+
+	if(phase == PHASE_GAME) {
+		stats[finished].path += fabs(dist);
+
+		if(contact && !inContact) {
+			stats[finished].contacts++;
+		}
+	}
+
+	inContact = contact;
+}
+
+
+/*======================================================================================*/
+/* 								  PLAYER AND OPERATOR									*/
+/*======================================================================================*/
+
+static void set_phase(phase_t next) {
+	static const char *names[] = {"setup", "calibration", "countdown", "game", "return",
+								  "wait", "over"};
+
+	phase = next;
+	phaseStart = sim_now();
+	SIM_LOG("player %u: %s (x %.1f y %.1f theta %.2f)", finished + 1, names[next],
+			robot.x, robot.y, robot.theta);
+}
+
+
+/*
+*	The player whistles lower to turn left and higher to turn right, towards the
+*	next waypoint. Even players go left of the obstacle, odd ones right.
+*/
+static int16_t player_whistle(uint8_t base) {
+	double side = (finished % 2) ? -14 : 14;
+	double tx = (waypoint == 0) ? 54 : 160, ty = (waypoint == 0) ? side : 0;
+	double err;
+	long shift;
+
+	if(robot.x >= PLAYER_STOP_X) {
+		return -1;
+	}
+
+	if((waypoint == 0) && (hypot(tx - robot.x, ty - robot.y) < PLAYER_REACHED)) {
+		waypoint = 1;
+	}
+
+	err = remainder(atan2(ty - robot.y, tx - robot.x) - robot.theta, 2 * M_PI);
+	shift = lround(PLAYER_GAIN * err);
+	shift = (shift > PLAYER_MAX_SHIFT) ? PLAYER_MAX_SHIFT : shift;
+	shift = (shift < -PLAYER_MAX_SHIFT) ? -PLAYER_MAX_SHIFT : shift;
+
+	return base - shift;
+}
+
+
+static void player_update(void) {
+	uint8_t base = PLAYER_BASE_BIN + finished % 3;
+	uint64_t now = sim_now();
+	bool ring = robot.led[0] && robot.led[1] && robot.led[2] && robot.led[3];
+	bool dark = !robot.led[0] && !robot.led[1] && !robot.led[2] && !robot.led[3];
+	tuning_t tuning;
+
+	robot.whistleBin = -1;
+
+	// The e-puck is back once it stands still at the start line
+	if(returning) {
+		if((robot.leftSpeed != 0) || (robot.rightSpeed != 0) || (hypot(robot.x, robot.y) > 5)) {
+			stillSince = now;
+		} else if((now - stillSince) > OPERATOR_DELAY) {
+			stats[finished - 1].returnTime = (stillSince - returnStart) / (double)CH_CFG_ST_FREQUENCY;
+			returning = FALSE;
+		}
+	}
+
+	switch(phase) {
+		case PHASE_SETUP:
+			// Selector to 0 to start the configuration, then the number of players
+			if((now > 5000) && !sim_replay_active()) {
+				robot.selector = simOptions.players;
+			}
+
+			if(robot.frontLed) {
+				set_phase(PHASE_CALIBRATION);
+			}
+			break;
+
+		case PHASE_CALIBRATION:
+			if(robot.frontLed) {
+				robot.whistleBin = base;
+			} else {
+				countdownFull = FALSE;
+				set_phase(PHASE_COUNTDOWN);
+			}
+			break;
+
+		case PHASE_COUNTDOWN:
+			countdownFull |= ring;
+
+			if(countdownFull && dark) {
+				waypoint = 0;
+				set_phase(PHASE_GAME);
+			}
+			break;
+
+		case PHASE_GAME:
+			if(robot.bodyLed) {
+				stats[finished].time = (now - phaseStart) / (double)CH_CFG_ST_FREQUENCY;
+				set_phase(PHASE_RETURN);
+				finished++;
+				returning = (finished < simOptions.players);
+				returnStart = now;
+				stillSince = now;
+
+				if(finished >= simOptions.players) {
+					set_phase(PHASE_OVER);
+					sim_set_end(now + S2ST(4));
+				}
+			} else {
+				robot.whistleBin = player_whistle(base);
+			}
+			break;
+
+		case PHASE_RETURN:
+			// The next player takes the robot once it stands still at the start line, or at
+			// once in a tournament
+			tuning_get(&tuning);
+
+			if(!returning || tuning.tournament) {
+				if(!sim_replay_active()) {
+					robot.selector = simOptions.players - finished;
+				}
+
+				set_phase(PHASE_WAIT);
+			}
+			break;
+
+		case PHASE_WAIT:
+			if(robot.frontLed) {
+				set_phase(PHASE_CALIBRATION);
+			}
+			break;
+
+		case PHASE_OVER:
+			break;
+	}
+}
+
+
+/*======================================================================================*/
+/* 									  SIMULATION										*/
+/*======================================================================================*/
+
+void sim_world_init(void) {
+	memset(&robot, 0, sizeof(robot));
+	robot.whistleBin = -1;
+	robot.selector = 0;
+	randState = simOptions.seed ? simOptions.seed : 1;
+
+	for(uint8_t i = 0; i < 8; i++) {
+		proxOffset[i] = 40 + sim_noise(30);
+	}
+}
+
+
+/*
+*	Integrates the motion of the robot from one kernel event to the next one.
+*/
+void sim_world_advance(uint64_t from, uint64_t to) {
+	while(from < to) {
+		uint64_t step = ((to - from) < WORLD_STEP) ? (to - from) : WORLD_STEP;
+
+		player_update();
+		integrate((double)step / CH_CFG_ST_FREQUENCY);
+		from += step;
+	}
+}
+
+
+void sim_world_report(void) {
+	arena_report_t arena;
+	motor_stats_t motor;
+	trace_stats_t trace;
+	run_log_stats_t log;
+	run_best_t best[3];
+	uint8_t nbBest;
+	uint32_t periods = 0;
+
+	arena_get_report(&arena);
+	motor_arbiter_get_stats(&motor);
+
+	for(uint8_t i = 0; i <= MOTOR_NB_SOURCES; i++) {
+		periods += motor.periods[i];
+	}
+	printf("simulated time %.3f s, %u/%u players finished\n", sim_seconds(), finished,
+		   simOptions.players);
+	printf("robot at x %.1f cm, y %.1f cm, theta %.2f rad\n", robot.x, robot.y, robot.theta);
+
+	for(uint8_t i = 0; i < finished; i++) {
+		printf("player %2u: game %7.3f s, path %6.1f cm, contacts %u, return %6.3f s\n",
+			   i + 1, stats[i].time, stats[i].path, stats[i].contacts, stats[i].returnTime);
+	}
+
+	printf("winner LEDs: %u %u %u\n", robot.rgb[0][0], robot.rgb[0][1], robot.rgb[0][2]);
+	printf("arena: peak %u B of %u B laid out (ARENA_SIZE %u B)\n", arena.peak, arena.size,
+		   ARENA_SIZE);
+	printf("motor arbiter: %u switches, %.1f %% of the periods ramp limited, %u requests clamped\n",
+		   motor.switches, periods ? 100.0 * motor.limited / periods : 0.0, motor.clamped);
+
+	run_log_get_stats(&log);
+	nbBest = run_log_get_best(best, 3);
+	printf("run log: %u records, generation %u, %u erases, %u dropped, %u corrupted, best",
+		   log.records, log.generation, sim_flash_erases(), log.dropped, log.corrupted);
+
+	for(uint8_t i = 0; i < nbBest; i++) {
+		printf(" %.3f s (run %u)", best[i].time / 1e3, best[i].run);
+	}
+
+	printf("\n");
+
+	// Host dependent, as the profiling
+	for(uint8_t i = 0; i < TRACE_NB_PATHS; i++) {
+		trace_get_stats(i, &trace);
+		printf("latency %-10s: %5u traces, mean %7.0f us, max %7u us, %u dropped\n",
+			   trace_path_name(i), trace.count, trace.count ? (double)trace.sum / trace.count : 0.0,
+			   trace.max, trace.dropped);
+	}
+	printf("motor commands digest: %08x\n", sim_motor_digest());
+}
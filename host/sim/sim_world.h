@@ -0,0 +1,61 @@
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// Robot model
+#define ROBOT_RADIUS			3.7f		// [cm]
+#define ROBOT_WHEEL_PERIMETER	12.5f		// [cm]
+#define ROBOT_WHEEL_DISTANCE	5.1f		// [cm]
+#define ROBOT_STEPS_PER_TURN	1000
+#define ROBOT_SPEED_LIMIT		1100		// [steps/s]
+
+// Sensors
+#define CAMERA_FOV				0.785f		// horizontal field of view [rad]
+#define CAMERA_WIDTH			640
+#define CAMERA_PERIOD			67			// [ms]
+#define TOF_PERIOD				50			// [ms]
+#define TOF_MAX_DIST			2000		// [mm]
+#define PROX_PERIOD				10			// [ms]
+#define PROX_GAIN				3800.0f		// delta of a contact
+#define PROX_RANGE				0.9f		// [cm]
+#define MIC_PERIOD				10			// [ms]
+#define MIC_SAMPLES				160			// per microphone and period (16 kHz)
+#define MIC_AMPLITUDE			600			// amplitude of the whistle
+#define MIC_NOISE				40			// amplitude of the background noise
+#define MIC_MOTOR_NOISE			300			// amplitude of the whine of a stepper motor, at its
+											// step rate
+
+// State of the simulated robot, written by the world and the device stand-ins
+typedef struct {
+	// Pose in [cm] and [rad], x ahead of the start line, y to the left
+	double x;
+	double y;
+	double theta;
+
+	// Actuators
+	int16_t leftSpeed;
+	int16_t rightSpeed;
+	double leftPos;
+	double rightPos;
+	uint8_t led[4];
+	uint8_t rgb[4][3];
+	bool bodyLed;
+	bool frontLed;
+
+	// Inputs of the operator
+	uint8_t selector;
+	int16_t whistleBin;			// -1 when the player is silent
+} sim_robot_t;
+
+extern sim_robot_t robot;
+
+
+float sim_world_ray(double x, double y, double angle);
+uint8_t sim_world_color(double x, double y, double angle);
+void sim_world_proximity(unsigned int delta[8]);
+
+
+#endif /* SIM_WORLD_H */
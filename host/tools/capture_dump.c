@@ -0,0 +1,497 @@
+/*
+  \file   	capture_dump.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Checks a sensor recording (see capture.h) and prints the statistics of its
+  			streams, or every chunk with -v. The last profiling report of each site and
+  			the cost of the avoidance are printed with -p, the last report of each thread
+  			with -t, the last latency report of each traced path and of the obstacle
+  			detection with -l, the last counters of each periodic task with -d, the runs
+  			of the log sorted by time with -r.
+  			The values of the parameters, the usage of the arena, the motor arbitration
+  			and the runs are printed with the chunks. The telemetry streams are written to
+  			PREFIX_steering.csv and PREFIX_line.csv with -c PREFIX, the runs to
+  			PREFIX_runs.csv.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+
+#include "arena.h"
+#include "capture.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "periodic.h"
+#include "profiling.h"
+#include "proximity_sensors.h"
+#include "run_log.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "tuning.h"
+
+
+static const char *streamNames[CAPTURE_NB_STREAMS] = {"mic", "cam", "tof", "prox", "selector", "prof",
+													   "threads", "steering", "line", "param", "arena",
+													   "motor", "trace", "run", "periodic", "obstacle"};
+static const char *sourceNames[MOTOR_NB_SOURCES + 1] = {"steering", "wall", "motion", "finish",
+														"safety", "none"};
+
+static const char *siteNames[PROF_NB_SITES] = {
+	"audio_frame", "audio_fft", "audio_mag", "audio_voice", "steering",
+	"image", "prox_filter", "obstacle", "motion", "odometry",
+};
+
+static const char *pathNames[TRACE_NB_PATHS] = {
+	"mic_motor", "cam_finish", "prox_stop",
+};
+
+typedef struct {
+	uint32_t chunks;
+	uint32_t bytes;
+	uint32_t lost;
+	uint64_t firstTime;			// in [us], unwrapped
+	uint64_t lastTime;
+	uint8_t nextSeq;
+} stream_stats_t;
+
+
+/*
+*	Opens a CSV file PREFIX_name.csv and writes its header line.
+*/
+static FILE *csv_open(const char *prefix, const char *name, const char *columns) {
+	char path[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s_%s.csv", prefix, name);
+
+	if((f = fopen(path, "w")) == NULL) {
+		fprintf(stderr, "%s: cannot be written\n", path);
+		exit(1);
+	}
+
+	fprintf(f, "time,%s\n", columns);
+
+	return f;
+}
+
+
+/*
+*	Order of the runs: by time, then by run number.
+*/
+static int run_compare(const void *a, const void *b) {
+	const run_record_t *ra = a, *rb = b;
+
+	if(ra->time != rb->time) {
+		return (ra->time < rb->time) ? -1 : 1;
+	}
+
+	return (ra->run > rb->run) - (ra->run < rb->run);
+}
+
+
+static uint16_t crc16(uint16_t crc, const uint8_t *buf, uint32_t len) {
+	for(uint32_t i = 0; i < len; i++) {
+		crc ^= buf[i] << 8;
+
+		for(uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+
+int main(int argc, char **argv) {
+	stream_stats_t stats[CAPTURE_NB_STREAMS];
+	prof_report_t prof[PROF_NB_SITES];
+	trace_report_t trace[TRACE_NB_PATHS];
+	obst_report_t obstacle;
+	monitor_report_t threads[MONITOR_MAX_THREADS];
+	uint8_t nbThreads = 0;
+	periodic_report_t tasks[MONITOR_MAX_THREADS];
+	uint8_t nbTasks = 0;
+	const char *path = NULL, *csvPrefix = NULL;
+	FILE *steeringCsv = NULL, *lineCsv = NULL, *runsCsv = NULL;
+	run_record_t *runs = NULL;
+	uint32_t nbRuns = 0;
+	int verbose = 0, profile = 0, monitor = 0, latency = 0, deadlines = 0, leaderboard = 0;
+	uint8_t *data;
+	long size, pos = 0, skipped = 0;
+	uint64_t time = 0;
+	uint32_t lastChunkTime = 0;
+	int firstChunk = 1;
+	FILE *f;
+
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "-v") == 0) {
+			verbose = 1;
+		} else if(strcmp(argv[i], "-p") == 0) {
+			profile = 1;
+		} else if(strcmp(argv[i], "-t") == 0) {
+			monitor = 1;
+		} else if(strcmp(argv[i], "-l") == 0) {
+			latency = 1;
+		} else if(strcmp(argv[i], "-d") == 0) {
+			deadlines = 1;
+		} else if(strcmp(argv[i], "-r") == 0) {
+			leaderboard = 1;
+		} else if((strcmp(argv[i], "-c") == 0) && (i + 1 < argc)) {
+			csvPrefix = argv[++i];
+		} else {
+			path = argv[i];
+		}
+	}
+
+	if((path == NULL) || ((f = fopen(path, "rb")) == NULL)) {
+		fprintf(stderr, "usage: %s [-v] [-p] [-t] [-l] [-d] [-r] [-c PREFIX] FILE\n", argv[0]);
+		return 2;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(size + 1);
+
+	if((data == NULL) || ((long)fread(data, 1, size, f) != size)) {
+		fprintf(stderr, "%s: read error\n", path);
+		return 1;
+	}
+
+	fclose(f);
+
+	if(csvPrefix != NULL) {
+		steeringCsv = csv_open(csvPrefix, "steering",
+							   "peak,mid_freq,error,sum_error,deriv_error,speed,left_speed,right_speed");
+		lineCsv = csv_open(csvPrefix, "line", "counter_lines,mean,lines_found,tof_dist");
+		runsCsv = csv_open(csvPrefix, "runs",
+						   "run,player,players,time_ms,calibration_ms,finish_latency_us,penalties,flags");
+	}
+
+	memset(stats, 0, sizeof(stats));
+	memset(prof, 0, sizeof(prof));
+	memset(trace, 0, sizeof(trace));
+	memset(&obstacle, 0, sizeof(obstacle));
+	obstacle.mhz = 1;
+
+	while(pos + (long)sizeof(capture_header_t) + 2 <= size) {
+		capture_header_t header;
+		stream_stats_t *s;
+		uint16_t crc;
+
+		memcpy(&header, &data[pos], sizeof(header));
+
+		if((header.sync != CAPTURE_SYNC) || (header.stream >= CAPTURE_NB_STREAMS)
+			|| (pos + (long)sizeof(header) + header.len + 2 > size)) {
+			pos++;
+			skipped++;
+			continue;
+		}
+
+		memcpy(&crc, &data[pos + sizeof(header) + header.len], sizeof(crc));
+
+		if(crc16(CAPTURE_CRC_INIT, &data[pos + 1], sizeof(header) - 1 + header.len) != crc) {
+			pos++;
+			skipped++;
+			continue;
+		}
+
+		// The time of the chunks wraps after 2^32 us. The chunks sent by concurrent threads
+		// may step a little back in time.
+		time = firstChunk ? header.time : (time + (int32_t)(header.time - lastChunkTime));
+		lastChunkTime = header.time;
+		firstChunk = 0;
+
+		s = &stats[header.stream];
+
+		if(s->chunks == 0) {
+			s->firstTime = time;
+		} else {
+			s->lost += (uint8_t)(header.seq - s->nextSeq);
+		}
+
+		s->chunks++;
+		s->bytes += header.len;
+		s->lastTime = time;
+		s->nextSeq = header.seq + 1;
+
+		if((header.stream == CAPTURE_PROF) && (header.len == sizeof(prof_report_t))) {
+			prof_report_t report;
+
+			memcpy(&report, &data[pos + sizeof(header)], sizeof(report));
+
+			if(report.site < PROF_NB_SITES) {
+				prof[report.site] = report;
+			}
+		}
+
+		if((header.stream == CAPTURE_TRACE) && (header.len == sizeof(trace_report_t))) {
+			trace_report_t report;
+
+			memcpy(&report, &data[pos + sizeof(header)], sizeof(report));
+
+			if(report.path < TRACE_NB_PATHS) {
+				trace[report.path] = report;
+			}
+		}
+
+		if((header.stream == CAPTURE_THREADS) && (header.len == sizeof(monitor_report_t))) {
+			monitor_report_t report;
+			uint8_t i = 0;
+
+			memcpy(&report, &data[pos + sizeof(header)], sizeof(report));
+
+			// One entry per thread name, updated by the later reports
+			while((i < nbThreads) && strncmp(threads[i].name, report.name, MONITOR_NAME_LEN)) {
+				i++;
+			}
+
+			if(i < MONITOR_MAX_THREADS) {
+				threads[i] = report;
+				nbThreads = (i == nbThreads) ? nbThreads + 1 : nbThreads;
+			}
+		}
+
+		if((header.stream == CAPTURE_OBSTACLE) && (header.len == sizeof(obst_report_t))) {
+			memcpy(&obstacle, &data[pos + sizeof(header)], sizeof(obstacle));
+		}
+
+		if((header.stream == CAPTURE_PERIODIC) && (header.len == sizeof(periodic_report_t))) {
+			periodic_report_t report;
+			uint8_t i = 0;
+
+			memcpy(&report, &data[pos + sizeof(header)], sizeof(report));
+
+			// One entry per task name, updated by the later reports
+			while((i < nbTasks) && strncmp(tasks[i].name, report.name, PERIODIC_NAME_LEN)) {
+				i++;
+			}
+
+			if(i < MONITOR_MAX_THREADS) {
+				tasks[i] = report;
+				nbTasks = (i == nbTasks) ? nbTasks + 1 : nbTasks;
+			}
+		}
+
+		if((steeringCsv != NULL) && (header.stream == CAPTURE_STEERING)
+			&& (header.len == sizeof(telemetry_steering_t))) {
+			telemetry_steering_t t;
+
+			memcpy(&t, &data[pos + sizeof(header)], sizeof(t));
+			fprintf(steeringCsv, "%.6f,%d,%u,%d,%d,%d,%.1f,%d,%d\n", time / 1e6, t.peak,
+					t.midFreq, t.error, t.sumError, t.derivError, t.speed, t.leftSpeed, t.rightSpeed);
+		}
+
+		if((lineCsv != NULL) && (header.stream == CAPTURE_LINE) && (header.len == sizeof(telemetry_line_t))) {
+			telemetry_line_t t;
+
+			memcpy(&t, &data[pos + sizeof(header)], sizeof(t));
+			fprintf(lineCsv, "%.6f,%u,%u,%u,%u\n", time / 1e6, t.counterLines, t.mean,
+					t.linesFound, t.tofDist);
+		}
+
+		if((header.stream == CAPTURE_RUN) && (header.len == sizeof(run_record_t))) {
+			run_record_t r;
+			uint32_t i = 0;
+
+			memcpy(&r, &data[pos + sizeof(header)], sizeof(r));
+
+			if(runsCsv != NULL) {
+				fprintf(runsCsv, "%.6f,%u,%u,%u,%u,%u,%u,%u,%u\n", time / 1e6, r.run, r.player,
+						r.players, r.time, r.calibration, r.finishLatency, r.penalties, r.flags);
+			}
+
+			// An exported run may also have been recorded when it was appended
+			while((i < nbRuns) && (runs[i].run != r.run)) {
+				i++;
+			}
+
+			if(i == nbRuns) {
+				if((runs = realloc(runs, (nbRuns + 1) * sizeof(run_record_t))) == NULL) {
+					fprintf(stderr, "out of memory\n");
+					return 1;
+				}
+
+				nbRuns++;
+			}
+
+			runs[i] = r;
+		}
+
+		if(verbose) {
+			printf("%10.4f %-8s seq %3u len %4u", time / 1e6, streamNames[header.stream],
+				   header.seq, header.len);
+
+			if((header.stream == CAPTURE_PARAM) && (header.len == sizeof(tuning_report_t))) {
+				tuning_report_t report;
+
+				memcpy(&report, &data[pos + sizeof(header)], sizeof(report));
+				printf("  %.*s = %g", TUNING_NAME_LEN, report.name, report.value);
+			}
+
+			if((header.stream == CAPTURE_ARENA) && (header.len == sizeof(arena_report_t))) {
+				arena_report_t report;
+
+				memcpy(&report, &data[pos + sizeof(header)], sizeof(report));
+				printf("  phase %u used %u peak %u of %u", report.phase, report.used, report.peak,
+					   report.size);
+			}
+
+			if((header.stream == CAPTURE_MOTOR) && (header.len == sizeof(motor_report_t))) {
+				motor_report_t report;
+
+				memcpy(&report, &data[pos + sizeof(header)], sizeof(report));
+				report.source = (report.source > MOTOR_SRC_NONE) ? MOTOR_SRC_NONE : report.source;
+				report.previous = (report.previous > MOTOR_SRC_NONE) ? MOTOR_SRC_NONE : report.previous;
+				printf("  %s -> %s (%d, %d) limited %u clamped %u", sourceNames[report.previous],
+					   sourceNames[report.source], report.left, report.right, report.limited,
+					   report.clamped);
+			}
+
+			if((header.stream == CAPTURE_RUN) && (header.len == sizeof(run_record_t))) {
+				run_record_t r;
+
+				memcpy(&r, &data[pos + sizeof(header)], sizeof(r));
+				printf("  run %u player %u/%u time %.3f s calibration %.3f s penalties %u",
+					   r.run, r.player, r.players, r.time / 1e3, r.calibration / 1e3, r.penalties);
+			}
+
+			printf("\n");
+		}
+
+		pos += sizeof(header) + header.len + 2;
+	}
+
+	printf("%-8s %8s %10s %6s %10s %10s %8s\n", "stream", "chunks", "bytes", "lost", "first [s]",
+		   "last [s]", "rate [Hz]");
+
+	for(uint8_t i = 0; i < CAPTURE_NB_STREAMS; i++) {
+		stream_stats_t *s = &stats[i];
+		double span = (s->lastTime - s->firstTime) / 1e6;
+
+		printf("%-8s %8u %10u %6u %10.3f %10.3f %8.1f\n", streamNames[i], s->chunks, s->bytes,
+			   s->lost, s->firstTime / 1e6, s->lastTime / 1e6,
+			   (span > 0) ? (s->chunks - 1) / span : 0.0);
+	}
+
+	printf("%ld bytes skipped (corrupted or truncated)\n", skipped);
+
+	if(profile) {
+		printf("\n%-12s %8s %10s %10s %10s  %s\n", "site", "count", "min [us]", "mean [us]",
+			   "max [us]", "histogram (cycles: count)");
+
+		for(uint8_t i = 0; i < PROF_NB_SITES; i++) {
+			prof_report_t *r = &prof[i];
+			double mhz = (r->mhz > 0) ? r->mhz : 1;
+
+			if(r->count == 0) {
+				continue;
+			}
+
+			printf("%-12s %8u %10.2f %10.2f %10.2f ", siteNames[i], r->count, r->min / mhz,
+				   r->mean / mhz, r->max / mhz);
+
+			for(uint8_t b = 0; b < PROF_HIST_BINS; b++) {
+				if(r->hist[b] > 0) {
+					printf(" %u+:%u", b ? (1u << b) : 0, r->hist[b]);
+				}
+			}
+
+			printf("\n");
+		}
+
+		if(obstacle.avoidMax > 0) {
+			printf("%-12s %8s %10s %10s %10.2f  last %.2f\n", "avoidance", "-", "-", "-",
+				   obstacle.avoidMax / (double)obstacle.mhz, obstacle.avoidLast / (double)obstacle.mhz);
+		}
+	}
+
+	if(latency) {
+		printf("\n%-12s %8s %8s %10s %10s %10s  %s\n", "path", "count", "dropped", "min [us]",
+			   "mean [us]", "max [us]", "histogram (us: count)");
+
+		for(uint8_t i = 0; i < TRACE_NB_PATHS; i++) {
+			trace_report_t *r = &trace[i];
+
+			if((r->count == 0) && (r->dropped == 0)) {
+				continue;
+			}
+
+			printf("%-12s %8u %8u %10u %10u %10u ", pathNames[i], r->count, r->dropped, r->min,
+				   r->mean, r->max);
+
+			for(uint8_t b = 0; b < TRACE_HIST_BINS; b++) {
+				if(r->hist[b] > 0) {
+					printf(" %u+:%u", b ? (1u << b) : 0, r->hist[b]);
+				}
+			}
+
+			printf("\n");
+		}
+
+		if(obstacle.stops > 0) {
+			printf("%-12s %8u %8s %10s %10u %10u  last %u\n", "obstacle", obstacle.stops, "-", "-",
+				   obstacle.latencyMean, obstacle.latencyMax, obstacle.latencyLast);
+		}
+	}
+
+	if(deadlines) {
+		printf("\n%-12s %11s %8s %8s %8s %10s %11s\n", "task", "period [us]", "cycles",
+			   "overruns", "missed", "jitter max", "jitter mean");
+
+		for(uint8_t i = 0; i < nbTasks; i++) {
+			periodic_report_t *r = &tasks[i];
+
+			printf("%-12.*s %11u %8u %8u %8u %10u %11u\n", PERIODIC_NAME_LEN, r->name, r->period,
+				   r->cycles, r->overruns, r->missed, r->jitterMax, r->jitterMean);
+		}
+	}
+
+	if(leaderboard) {
+		qsort(runs, nbRuns, sizeof(run_record_t), run_compare);
+
+		printf("\n%4s %8s %7s %10s %16s %16s %9s %s\n", "rank", "run", "player", "time [s]",
+			   "calibration [s]", "finish lat [us]", "penalties", "flags");
+
+		for(uint32_t i = 0; i < nbRuns; i++) {
+			run_record_t *r = &runs[i];
+
+			printf("%4u %8u %4u/%-2u %10.3f %16.3f %16u %9u%s%s\n", i + 1, r->run, r->player,
+				   r->players, r->time / 1e3, r->calibration / 1e3, r->finishLatency, r->penalties,
+				   (r->flags & RUN_LOG_TOURNAMENT) ? " tournament" : "",
+				   (r->flags & RUN_LOG_AVOIDANCE) ? " avoidance" : "");
+		}
+	}
+
+	if(monitor) {
+		printf("\n%-16s %4s %7s %12s %12s\n", "thread", "prio", "cpu [%]", "stack [B]", "used [B]");
+
+		for(uint8_t i = 0; i < nbThreads; i++) {
+			monitor_report_t *r = &threads[i];
+
+			printf("%-16.16s %4u %7.1f", r->name, r->prio, r->cpu / 10.0);
+
+			if(r->flags & MONITOR_FLAG_STACK) {
+				printf(" %12u %12u%s\n", r->stackSize, r->stackUsed,
+					   (r->flags & MONITOR_FLAG_LOW) ? "  LOW" : "");
+			} else {
+				printf(" %12s %12s\n", "-", "-");
+			}
+		}
+	}
+
+	if(csvPrefix != NULL) {
+		fclose(steeringCsv);
+		fclose(lineCsv);
+		fclose(runsCsv);
+	}
+
+	free(runs);
+	free(data);
+
+	return (skipped > 0) ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+/*
+  \file   	led_animation.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.1
+  \brief  	Thread playing the LED patterns, the game flow goes on while they are shown.
+  			It is the only writer of the LEDs once started.
+*/
+
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "led_animation.h"
+#include "main.h"
+#include "monitor.h"
+
+#include "leds.h"
+
+
+// Pattern asked by led_anim_play, the counters tell when it is completed
+static const led_pattern_t *requested = NULL;
+static uint32_t requestSeq = 0;
+static uint32_t doneSeq = 0;
+static BSEMAPHORE_DECL(anim_sem, TRUE); // @suppress("Field cannot be resolved")
+static BSEMAPHORE_DECL(done_sem, TRUE); // @suppress("Field cannot be resolved")
+
+// Last value asked with led_anim_set for each LED (player for the RGB LEDs), applied by
+// the thread between the steps of the patterns
+static uint8_t setValues[LED_ANIM_NB_LEDS];
+static uint8_t setPending = 0;		// LED_ANIM_* bit field of the values not applied yet
+
+static bool led_anim_run(const led_pattern_t *pattern, uint32_t seq);
+static void led_anim_apply(const led_step_t *step);
+static void led_anim_apply_sets(void);
+
+
+// Thread playing the patterns
+static THD_WORKING_AREA(led_anim_thd_wa, 256);
+static THD_FUNCTION(led_anim_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	const led_pattern_t *pattern;
+	uint32_t seq;
+	bool interrupted;
+
+	while(1) {
+		chBSemWait(&anim_sem);
+		led_anim_apply_sets();
+
+		// A new pattern interrupts the current one
+		do {
+			chSysLock();
+			pattern = requested;
+			seq = requestSeq;
+			chSysUnlock();
+
+			interrupted = (pattern != NULL) && (seq != doneSeq) && led_anim_run(pattern, seq);
+		} while(interrupted);
+
+		chSysLock();
+		doneSeq = seq;
+		chSysUnlock();
+
+		chBSemSignal(&done_sem);
+	}
+}
+
+
+/*
+*	Function to start the THREAD playing the patterns.
+*/
+void led_anim_start(void) {
+	monitor_thread_create(led_anim_thd_wa, sizeof(led_anim_thd_wa), NORMALPRIO, led_anim_thd, NULL);
+}
+
+
+/*
+*	Function to play a pattern, it replaces the current one and returns at once.
+*
+*	params :
+*	const led_pattern_t *pattern	pattern to play (must stay valid while it is played),
+*									NULL stops the current one
+*/
+void led_anim_play(const led_pattern_t *pattern) {
+	chSysLock();
+	requested = pattern;
+	requestSeq++;
+	chSysUnlock();
+
+	chBSemSignal(&anim_sem);
+}
+
+
+/*
+*	Function to set LEDs like a step, the current pattern goes on. The LEDs are set by
+*	the thread and the function returns at once. Only the last value asked for a LED is
+*	applied if the thread doesn't follow.
+*
+*	params :
+*	uint8_t leds		LED_ANIM_* bit field
+*	uint8_t value		0 off, 1 on, 2 toggle (like set_led)
+*	uint8_t player		selector position shown by the RGB LEDs, 0 for no light
+*/
+void led_anim_set(uint8_t leds, uint8_t value, uint8_t player) {
+	chSysLock();
+
+	for(uint8_t i = 0; i < LED_ANIM_NB_LEDS; i++) {
+		if(leds & (1 << i)) {
+			setValues[i] = ((1 << i) == LED_ANIM_RGB) ? player : value;
+		}
+	}
+
+	setPending |= leds;
+	chSysUnlock();
+
+	chBSemSignal(&anim_sem);
+}
+
+
+/*
+*	Function to wait till the last pattern asked is completed.
+*/
+void led_anim_wait(void) {
+	while(!led_anim_done()) {
+		chBSemWait(&done_sem);
+	}
+}
+
+
+/*
+*	Function to know if the last pattern asked is completed.
+*/
+bool led_anim_done(void) {
+	bool done;
+
+	chSysLock();
+	done = (doneSeq == requestSeq);
+	chSysUnlock();
+
+	return done;
+}
+
+
+/*
+*	Plays the steps of a pattern, the sets asked meanwhile are applied at once.
+*
+*	params :
+*	const led_pattern_t *pattern	pattern played
+*	uint32_t seq					request of the pattern
+*
+*	Returns TRUE if another pattern was asked before the end.
+*/
+static bool led_anim_run(const led_pattern_t *pattern, uint32_t seq) {
+	systime_t next = chVTGetSystemTime();
+	systime_t wait;
+	uint8_t step = 0;
+	bool replaced;
+
+	while(1) {
+		led_anim_apply(&pattern->steps[step]);
+
+		// Absolute times, the steps don't drift
+		next += MS2ST(pattern->steps[step].duration);
+
+		while(1) {
+			wait = next - chVTGetSystemTime();
+
+			if(wait >= (systime_t)(TIME_INFINITE / 2)) {
+				wait = TIME_IMMEDIATE;
+			}
+
+			if(chBSemWaitTimeout(&anim_sem, wait) != MSG_OK) {
+				break;
+			}
+
+			led_anim_apply_sets();
+
+			chSysLock();
+			replaced = (requestSeq != seq);
+			chSysUnlock();
+
+			if(replaced) {
+				return TRUE;
+			}
+		}
+
+		if(++step == pattern->nbSteps) {
+			if(!pattern->loop) {
+				return FALSE;
+			}
+
+			step = 0;
+		}
+	}
+}
+
+
+/*
+*	Sets the LEDs of a step.
+*/
+static void led_anim_apply(const led_step_t *step) {
+	static const led_name_t ring[] = {LED1, LED3, LED5, LED7};
+
+	for(uint8_t i = 0; i < (sizeof(ring) / sizeof(ring[0])); i++) {
+		if(step->leds & (LED_ANIM_LED1 << i)) {
+			set_led(ring[i], step->value);
+		}
+	}
+
+	if(step->leds & LED_ANIM_BODY) {
+		set_body_led(step->value);
+	}
+
+	if(step->leds & LED_ANIM_FRONT) {
+		set_front_led(step->value);
+	}
+
+	if(step->leds & LED_ANIM_RGB) {
+		led_selector_management(step->player);
+	}
+}
+
+
+/*
+*	Applies the last values asked with led_anim_set.
+*/
+static void led_anim_apply_sets(void) {
+	uint8_t values[LED_ANIM_NB_LEDS];
+	uint8_t pending;
+	led_step_t step = {0, 0, 0, 0};
+
+	chSysLock();
+	pending = setPending;
+	setPending = 0;
+
+	for(uint8_t i = 0; i < LED_ANIM_NB_LEDS; i++) {
+		values[i] = setValues[i];
+	}
+
+	chSysUnlock();
+
+	for(uint8_t i = 0; i < LED_ANIM_NB_LEDS; i++) {
+		if(pending & (1 << i)) {
+			step.leds = 1 << i;
+			step.value = values[i];
+			step.player = values[i];
+			led_anim_apply(&step);
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef LED_ANIMATION_H
+#define LED_ANIMATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// LEDs set by a step
+#define LED_ANIM_LED1			0x01
+#define LED_ANIM_LED3			0x02
+#define LED_ANIM_LED5			0x04
+#define LED_ANIM_LED7			0x08
+#define LED_ANIM_RING			0x0F	// The four red LEDs
+#define LED_ANIM_BODY			0x10
+#define LED_ANIM_FRONT			0x20
+#define LED_ANIM_RGB			0x40	// Color of a player (see led_selector_management)
+
+#define LED_ANIM_NB_LEDS		7		// Bits of the LED_ANIM_* field
+
+// One step of a pattern: the LEDs are set, then the next step comes after duration
+typedef struct {
+	uint8_t leds;			// LED_ANIM_* bit field
+	uint8_t value;			// 0 off, 1 on, 2 toggle (like set_led)
+	uint8_t player;			// selector position shown by the RGB LEDs, 0 for no light
+	uint16_t duration;		// in [ms]
+} led_step_t;
+
+typedef struct {
+	const led_step_t *steps;
+	uint8_t nbSteps;
+	bool loop;				// played again till another pattern, it never completes
+} led_pattern_t;
+
+#define LED_PATTERN(steps, loop)	{(steps), sizeof(steps) / sizeof((steps)[0]), (loop)}
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void led_anim_start(void);
+void led_anim_play(const led_pattern_t *pattern);
+void led_anim_set(uint8_t leds, uint8_t value, uint8_t player);
+void led_anim_wait(void);
+bool led_anim_done(void);
+
+
+#endif /* LED_ANIMATION_H */
@@ -2,7 +2,7 @@
   \file   	main.c
   \author 	Antoine Duret & Carla Schmid (Group G08)
   \date   	16.05.2021
-  \version	3.3
+  \version	3.4
   \brief  	Main functions and LED management
 */
 
@@ -17,10 +17,25 @@
 #include "chprintf.h"
 #include "hal.h"
 
+#include "arena.h"
 #include "audio_processing.h"
+#include "capture.h"
+#include "game.h"
+#include "led_animation.h"
 #include "main.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "motion.h"
+#include "odometry.h"
 #include "process_image.h"
+#include "profiling.h"
+#include "proximity_filter.h"
 #include "proximity_sensors.h"
+#include "run_log.h"
+#include "selector_input.h"
+#include "trajectory.h"
+#include "trace.h"
+#include "tuning.h"
 
 #include "audio/microphone.h"
 #include "camera/po8030.h"
@@ -33,6 +48,7 @@
 #include "parameter/parameter.h"
 #include "spi_comm.h"
 #include "selector.h"
+#include "usbcfg.h"
 
 
 messagebus_t bus;
@@ -40,10 +56,39 @@ MUTEX_DECL(bus_lock); // @suppress("Field cannot be resolved")
 CONDVAR_DECL(bus_condvar);
 parameter_namespace_t parameter_root, aseba_ns;
 
+// LED patterns of the game, played by led_animation.c
+static const led_step_t waitingSteps[] = {
+	{LED_ANIM_RING, 2, 0, 1000},
+};
+static const led_step_t ringOffSteps[] = {
+	{LED_ANIM_RING, 0, 0, 0},
+};
+static const led_step_t confirmSteps[] = {
+	{LED_ANIM_BODY, 0, 0, 1000},
+	{LED_ANIM_BODY, 1, 0, 1000},
+	{LED_ANIM_BODY, 0, 0, 0},
+};
+static const led_step_t countdownSteps[] = {
+	{LED_ANIM_BODY, 0, 0, 0},
+	{LED_ANIM_RING, 1, 0, 1000},
+	{LED_ANIM_LED7, 0, 0, 1000},
+	{LED_ANIM_LED5, 0, 0, 1000},
+	{LED_ANIM_LED3, 0, 0, 1000},
+	{LED_ANIM_LED1, 0, 0, 0},
+};
+
+static const led_pattern_t waitingBlink = LED_PATTERN(waitingSteps, TRUE);
+static const led_pattern_t ringOff = LED_PATTERN(ringOffSteps, FALSE);
+static const led_pattern_t bodyConfirm = LED_PATTERN(confirmSteps, FALSE);
+static const led_pattern_t countdown = LED_PATTERN(countdownSteps, FALSE);
+
 
 int main(void) {
 	uint8_t nbPlayers = 0;
     uint8_t currentPlayer = 0;
+    uint8_t selectorPos = 0;
+    bool tournament = FALSE, calibrated = FALSE;
+    tuning_t tuning;
     uint tabPlayers[NB_PLAYERS_MAX];
 
 	// System initialization
@@ -53,53 +98,102 @@ int main(void) {
 
     // Inter Process Communication bus initialization
     messagebus_init(&bus, &bus_lock, &bus_condvar);
+    parameter_namespace_declare(&parameter_root, NULL, NULL);
+    capture_init();
+    run_log_init();					// erases the flash if needed, before the threads start
+    game_start();					// state machine of the game
+    arena_start();					// buffers of the game phases
 
     // Peripherals initialization
     clear_leds();
+    led_anim_start();				// LED patterns
 	dcmi_start();					// camera
 	po8030_start();					// camera
 	motors_init();
+	motor_arbiter_start();			// single output to the motors
+	odometry_start();
+	trajectory_start();
+	steering_start();
+	motion_start();
 	proximity_start();				// IR proximity sensors
+	proximity_filter_start();
+	selector_input_start();			// debounced selector
 	obstacle_det_start();
 	spi_comm_start();
 	VL53L0X_start();				// ToF init
 	mic_start(&process_audio_data); // starts the microphones processing thread
     process_image_start();
+    usb_start();
+    capture_start();				// sensor recording over the USB serial
+    profiling_start();
+    trace_start();					// sample-to-event latencies
+    run_log_start();				// runs and best times kept in the flash
+    monitor_start();				// CPU and stack usage of the threads
+    tuning_start();					// parameters set over the USB serial
 
     /* Infinite loop. */
     while(1) {
     	nbPlayers = game_setting();
     	currentPlayer = nbPlayers;
+    	tuning_get(&tuning);
+    	tournament = tuning.tournament;
+    	calibrated = FALSE;
 
     	while(currentPlayer != 0) {
     		currentPlayer--;
 
-    		player_voice_config();
+    		// In a tournament the next players are calibrated during the return
+    		if(!calibrated) {
+    			arena_enter(ARENA_CALIBRATION);
+    			player_voice_config();
+    		}
+
+    		arena_enter(ARENA_RACE);
     		tabPlayers[currentPlayer] = game_running();
+    		player_run_log(currentPlayer + 1, nbPlayers, tournament);
 
-    		set_body_led(1);
+    		led_anim_set(LED_ANIM_BODY, 1, 0);
 
     		if(currentPlayer > 0) {
+    			game_post(GAME_EV_RETURN);
+    			arena_enter(tournament ? ARENA_RETURN_CALIBRATION : ARENA_RETURN);
     			return_to_start_line();
 
+    			if(!tournament) {
+    				game_wait_state(GAME_WAITING);
+    				arena_enter(ARENA_SETUP);
+    			}
+
     			// Wait till next player is ready
-    			do {
-    				chThdSleepMilliseconds(150);
-    				led_selector_management(get_selector());
-    			} while(get_selector() != currentPlayer);
+    			selectorPos = selector_input_get();
+    			led_anim_set(LED_ANIM_RGB, 1, selectorPos);
+
+    			while(selectorPos != currentPlayer) {
+    				selector_input_wait_change(&selectorPos, TIME_INFINITE);
+    				led_anim_set(LED_ANIM_RGB, 1, selectorPos);
+    			}
 
     			// Confirm selector state
     			body_led_confirm();
 
+    			// The voice of the next player is measured while the e-puck drives back
+    			if(tournament) {
+    				player_voice_config();
+    			}
+
+    			calibrated = tournament;
+
     		} else { // Display the winner!
+    			game_post(GAME_EV_GAME_OVER);
+    			arena_enter(ARENA_SETUP);
+
     			for(uint8_t i = 1; i < nbPlayers; i++) {
     				if(tabPlayers[i] < tabPlayers[currentPlayer]) {
     					currentPlayer = i;
     				}
     			}
 
-    			led_selector_management(currentPlayer + 1);
-    			set_body_led(1);
+    			led_anim_set(LED_ANIM_RGB | LED_ANIM_BODY, 1, currentPlayer + 1);
     			currentPlayer = 0;
     		}
     	}
@@ -107,9 +201,7 @@ int main(void) {
     	chThdSleepSeconds(3);
 
     	// Wait till next game is started
-    	while(get_selector() != 0) {
-    		chThdSleepMilliseconds(100);
-    	}
+    	selector_input_wait(0);
     }
 }
 
@@ -121,40 +213,25 @@ int main(void) {
 *	Returns the number of players.
 */
 uint8_t game_setting(void) {
-	uint8_t selectorState = 0, i = 0;
+	uint8_t selectorState = 0;
 
 	// Waiting for the user to turn the game setting ON (Selector on position 0)
-	while(get_selector() != 0) {
-		set_led(LED1, 2);
-		set_led(LED3, 2);
-		set_led(LED5, 2);
-		set_led(LED7, 2);
-		chThdSleepSeconds(1);
+	if(selector_input_get() != 0) {
+		led_anim_play(&waitingBlink);
+		selector_input_wait(0);
 	}
 
-	if(get_selector() == 0) {
-		set_led(LED1, 0);
-		set_led(LED3, 0);
-		set_led(LED5, 0);
-		set_led(LED7, 0);
-	}
+	led_anim_play(&ringOff);
 
 	// Ready to start the player configuration and selector management
-	set_body_led(1);
-
-	// Wait for the user to select the number of players
-	do {
-		selectorState = get_selector();
-
-		// Refreshes the LEDs and waits till selector doesn't change anymore
-		do {
-			led_selector_management(get_selector());
-			chThdSleepMilliseconds(150);
-			i++;
-		} while (i < PLAYER_SELECT_DELAY);
+	led_anim_set(LED_ANIM_BODY | LED_ANIM_RGB, 1, selectorState);
 
-		i = 0;
-	} while((selectorState != get_selector()) || (get_selector() == 0));
+	// Wait for the user to select the number of players. The LEDs follow the selector and
+	// the number is taken once it stays still for PLAYER_SELECT_TIME.
+	while(selector_input_wait_change(&selectorState, MS2ST(PLAYER_SELECT_TIME))
+		  || (selectorState == 0)) {
+		led_anim_set(LED_ANIM_RGB, 1, selectorState);
+	}
 
 	body_led_confirm();
 
@@ -164,17 +241,19 @@ uint8_t game_setting(void) {
 
 /*
 *	Function to display the player voice configuration before each game and for each player.
+*	Returns when the audio processing has calibrated the voice and the e-puck stands at the
+*	start line.
 */
 void player_voice_config(void) {
 	chThdSleepMilliseconds(500);
-    set_front_led(1);
-    status_voice_calibration(TRUE);
+    led_anim_set(LED_ANIM_FRONT, 1, 0);
 
-    while(get_status_voice_calibration()) {
-    	chThdSleepMilliseconds(300);
-    }
+    game_post(GAME_EV_PLAYER_READY);
+    game_wait(GAME_IN(GAME_COUNTDOWN) | GAME_IN(GAME_RETURN_READY));
 
-    set_front_led(0);
+    // In a tournament the player may wait for the end of the return
+    led_anim_set(LED_ANIM_FRONT, 0, 0);
+    game_wait_state(GAME_COUNTDOWN);
 }
 
 
@@ -184,31 +263,59 @@ void player_voice_config(void) {
 */
 uint game_running(void) {
 	systime_t time;
-	set_led(LED1, 1);
-	set_led(LED3, 1);
-	set_led(LED5, 1);
-	set_led(LED7, 1);
-
-	chThdSleepSeconds(1);
-	set_led(LED7, 0);
-	chThdSleepSeconds(1);
-	set_led(LED5, 0);
-	chThdSleepSeconds(1);
-	set_led(LED3, 0);
-	chThdSleepSeconds(1);
-	set_led(LED1, 0);
-
-	status_audio_command(TRUE);
-    status_obst_detection(TRUE);
-    status_goal_detection(TRUE);
+
+	led_anim_play(&countdown);
+
+	// The start line is the origin of the recorded path, the robot stands still during
+	// the countdown
+	odometry_set_pose(0, 0, 0);
+
+	led_anim_wait();
+	trajectory_record(TRUE);
 
     time = chVTGetSystemTime();
 
-    while (!verify_finish_line()) {
-    	chThdSleepMilliseconds(200);
-    }
+    // The state machine turns on the audio command, the obstacle and goal detection
+    game_post(GAME_EV_START);
+    time = game_wait_state(GAME_FINISHED) - time;
+
+    trajectory_record(FALSE);
 
-	return (chVTGetSystemTime() - time);
+	return time;
+}
+
+
+/*
+*	Function to append the split times of the run which just ended to the run log.
+*	The record is written in the flash later, the function returns at once.
+*
+*	params :
+*	uint8_t player			number of the player (1 to nbPlayers)
+*	uint8_t nbPlayers		players of the game
+*	bool tournament			game played in tournament mode
+*/
+void player_run_log(uint8_t player, uint8_t nbPlayers, bool tournament) {
+	game_run_t run;
+	trace_stats_t finish;
+	run_record_t record;
+	uint32_t calibration;
+
+	game_get_run(&run);
+	trace_get_stats(TRACE_CAM_FINISH, &finish);
+
+	// In [ms], without the overflow of ST2MS for the long calibrations
+	calibration = run.calibration / MS2ST(1);
+
+	record.time = run.race / MS2ST(1);
+	record.calibration = (calibration < UINT16_MAX) ? calibration : UINT16_MAX;
+	record.finishLatency = (finish.last < UINT16_MAX) ? finish.last : UINT16_MAX;
+	record.player = player;
+	record.players = nbPlayers;
+	record.penalties = run.penalties;
+	record.flags = (tournament ? RUN_LOG_TOURNAMENT : 0)
+				 | ((get_obst_mode() == OBST_AVOIDANCE) ? RUN_LOG_AVOIDANCE : 0);
+
+	run_log_append(&record);
 }
 
 
@@ -318,13 +425,10 @@ void set_player_led_configuration(led_conf_name_t ledConf,
 /*
 * Simple function defined to apply the abstraction and reuse principle.
 * Desired display to confirm something to the player with the body led.
+* The blink is played by the LED thread, the function returns at once.
 */
 void body_led_confirm(void) {
-	set_body_led(0);
-	chThdSleepSeconds(1);
-	set_body_led(1);
-	chThdSleepSeconds(1);
-	set_body_led(0);
+	led_anim_play(&bodyConfirm);
 }
 
 
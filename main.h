@@ -7,6 +7,7 @@ extern "C" {
 
 
 #include <arm_math.h>
+#include <stdbool.h>
 
 #include "camera/dcmi_camera.h"
 #include "msgbus/messagebus.h"
@@ -16,9 +17,13 @@ extern "C" {
 // The game can be played with 1 to 15 players
 #define	NB_PLAYERS_MAX			15
 
-// User has a delay to stay on a selector position before nbPlayers is set and saved.
-// This delay is given by: 		delay = (PLAYER_SELECT_DELAY*0.1) [s]	(see game_setting function)
-#define	PLAYER_SELECT_DELAY		17
+// User has to stay on a selector position for this time before nbPlayers is set and saved
+// (see game_setting function), in [ms]
+#define	PLAYER_SELECT_TIME		1000
+
+// In tournament mode the next player takes the e-puck at the finish line and is calibrated
+// during the return (default of the parameter "tournament" in tuning.c)
+#define	TOURNAMENT_MODE			FALSE
 
 // List of the RGB LED colors
 #define		NO_LIGHT		  0,   0,   0
@@ -43,6 +48,7 @@ typedef enum {
 uint8_t game_setting(void);
 void player_voice_config(void);
 uint game_running(void);
+void player_run_log(uint8_t player, uint8_t nbPlayers, bool tournament);
 void led_selector_management(int selector_pos);
 void set_player_led_configuration(led_conf_name_t led_conf,
 										uint8_t red_i, uint8_t green_i, uint8_t blue_i);
@@ -0,0 +1,221 @@
+/*
+  \file   	monitor.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	CPU share and stack high-water mark of the threads, reported over the USB serial
+*/
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "capture.h"
+#include "monitor.h"
+
+
+typedef struct {
+	thread_t *thread;
+	uint8_t *wa;			// working area, NULL for the threads of the library
+	size_t size;
+	tprio_t prio;
+	uint32_t samples;		// CPU samples in the current report period
+} monitor_entry_t;
+
+static monitor_entry_t entries[MONITOR_MAX_THREADS];
+static uint8_t nbEntries = 0;
+static uint32_t otherSamples = 0;
+static uint32_t totalSamples = 0;
+static virtual_timer_t sampleTimer;
+
+static void monitor_sample(void *arg);
+static void monitor_discover(void);
+
+
+// Thread reporting the threads every MONITOR_REPORT_PERIOD
+static THD_WORKING_AREA(monitor_thd_wa, 512);
+static THD_FUNCTION(monitor_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	uint32_t samples[MONITOR_MAX_THREADS];
+	uint32_t total;
+	uint8_t count;
+	monitor_report_t report;
+	const char *name;
+
+	while(1) {
+		chThdSleepMilliseconds(MONITOR_REPORT_PERIOD);
+
+		monitor_discover();
+
+		// Samples of the period, the counters restart from zero
+		chSysLock();
+		count = nbEntries;
+		total = totalSamples;
+
+		for(uint8_t i = 0; i < count; i++) {
+			samples[i] = entries[i].samples;
+			entries[i].samples = 0;
+		}
+
+		otherSamples = 0;
+		totalSamples = 0;
+		chSysUnlock();
+
+		for(uint8_t i = 0; i < count; i++) {
+			monitor_entry_t *e = &entries[i];
+
+			memset(&report, 0, sizeof(report));
+			name = chRegGetThreadNameX(e->thread);
+			strncpy(report.name, (name != NULL) ? name : "?", MONITOR_NAME_LEN);
+			report.prio = e->prio;
+			report.cpu = (total > 0) ? (samples[i] * 1000 + total / 2) / total : 0;
+
+			if(e->wa != NULL) {
+				report.flags |= MONITOR_FLAG_STACK;
+				report.stackSize = e->size;
+				report.stackUsed = monitor_stack_used(e->wa, e->size);
+
+				if((e->size - report.stackUsed) < MONITOR_STACK_MARGIN) {
+					report.flags |= MONITOR_FLAG_LOW;
+				}
+			}
+
+			capture_send(CAPTURE_THREADS, &report, sizeof(report));
+		}
+	}
+}
+
+
+/*
+*	Function to start the CPU sampling and the THREAD reporting the threads.
+*/
+void monitor_start(void) {
+	monitor_thread_create(monitor_thd_wa, sizeof(monitor_thd_wa), LOWPRIO, monitor_thd, NULL);
+
+	chVTObjectInit(&sampleTimer);
+	chVTSet(&sampleTimer, MONITOR_SAMPLE_TICKS, monitor_sample, NULL);
+}
+
+
+/*
+*	Creates a thread like chThdCreateStatic, with its stack filled by the pattern
+*	used to find the high-water mark.
+*
+*	params :
+*	void *wa			working area of the thread
+*	size_t size			size of the working area in bytes
+*	tprio_t prio		priority
+*	tfunc_t func		function of the thread
+*	void *arg			argument given to the function
+*/
+thread_t *monitor_thread_create(void *wa, size_t size, tprio_t prio, tfunc_t func, void *arg) {
+	thread_t *tp;
+
+	memset(wa, MONITOR_STACK_FILL, size);
+	tp = chThdCreateStatic(wa, size, prio, func, arg);
+
+	chSysLock();
+
+	if(nbEntries < MONITOR_MAX_THREADS) {
+		entries[nbEntries].thread = tp;
+		entries[nbEntries].wa = wa;
+		entries[nbEntries].size = size;
+		entries[nbEntries].prio = prio;
+		entries[nbEntries].samples = 0;
+		nbEntries++;
+	}
+
+	chSysUnlock();
+
+	return tp;
+}
+
+
+/*
+*	Function to measure the stack used by a thread since its creation, the stack
+*	grows down towards the thread structure at the base of the working area.
+*
+*	params :
+*	const void *wa		working area of the thread
+*	size_t size			size of the working area in bytes
+*
+*	Returns the high-water mark in bytes.
+*/
+uint16_t monitor_stack_used(const void *wa, size_t size) {
+	const uint8_t *bottom = (const uint8_t *)wa + sizeof(thread_t);
+	const uint8_t *top = (const uint8_t *)wa + size;
+	const uint8_t *p = bottom;
+
+	while((p < top) && (*p == MONITOR_STACK_FILL)) {
+		p++;
+	}
+
+	return top - p;
+}
+
+
+/*
+*	Virtual timer callback counting which thread was interrupted.
+*/
+static void monitor_sample(void *arg) {
+	thread_t *tp = chThdGetSelfX();
+	bool found = FALSE;
+
+	(void) arg;
+
+	chSysLockFromISR();
+
+	for(uint8_t i = 0; i < nbEntries; i++) {
+		if(entries[i].thread == tp) {
+			entries[i].samples++;
+			found = TRUE;
+			break;
+		}
+	}
+
+	if(!found) {
+		otherSamples++;
+	}
+
+	totalSamples++;
+	chVTSetI(&sampleTimer, MONITOR_SAMPLE_TICKS, monitor_sample, NULL);
+
+	chSysUnlockFromISR();
+}
+
+
+/*
+*	Adds the threads of the registry not created by monitor_thread_create
+*	(library threads, main and idle).
+*/
+static void monitor_discover(void) {
+	thread_t *tp = chRegFirstThread();
+	bool known;
+
+	while(tp != NULL) {
+		known = FALSE;
+
+		for(uint8_t i = 0; i < nbEntries; i++) {
+			if(entries[i].thread == tp) {
+				known = TRUE;
+				break;
+			}
+		}
+
+		chSysLock();
+
+		if(!known && (nbEntries < MONITOR_MAX_THREADS)) {
+			memset(&entries[nbEntries], 0, sizeof(monitor_entry_t));
+			entries[nbEntries].thread = tp;
+			nbEntries++;
+		}
+
+		chSysUnlock();
+
+		tp = chRegNextThread(tp);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stdint.h>
+
+
+#define MONITOR_MAX_THREADS		24		// Threads followed by the monitor
+#define MONITOR_NAME_LEN		16		// Characters of the thread names in the reports
+#define MONITOR_SAMPLE_TICKS	7		// CPU sampling period in [system ticks], prime to avoid
+										// sampling in phase with the periodic threads
+#define MONITOR_REPORT_PERIOD	2000	// Period of the reports in [ms]
+#define MONITOR_STACK_FILL		0x55	// Fill pattern of the unused stack (like CH_DBG_FILL_THREADS)
+#define MONITOR_STACK_MARGIN	64		// Free stack in bytes under which a thread is flagged
+
+#define MONITOR_FLAG_STACK		0x01	// The stack of the thread is measured
+#define MONITOR_FLAG_LOW		0x02	// Free stack under MONITOR_STACK_MARGIN
+
+// Report of a thread sent in the CAPTURE_THREADS stream
+typedef struct __attribute__((packed)) {
+	char name[MONITOR_NAME_LEN];
+	uint8_t prio;			// 0 for the threads of the library
+	uint8_t flags;			// MONITOR_FLAG_*
+	uint16_t cpu;			// CPU share over the last report period in [0.1 %]
+	uint16_t stackSize;		// in bytes, 0 if not measured
+	uint16_t stackUsed;		// high-water mark in bytes
+} monitor_report_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void monitor_start(void);
+thread_t *monitor_thread_create(void *wa, size_t size, tprio_t prio, tfunc_t func, void *arg);
+uint16_t monitor_stack_used(const void *wa, size_t size);
+
+
+#endif /* MONITOR_H */
@@ -0,0 +1,423 @@
+/*
+  \file   	motion.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Non-blocking motion engine executing queued turns and straight moves
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+#include <arm_math.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "audio_processing.h"
+#include "main.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "motion.h"
+#include "odometry.h"
+#include "periodic.h"
+#include "profiling.h"
+#include "process_image.h"
+
+#include "motors.h"
+
+
+// Pool of commands: free slots are kept in a mailbox, posted commands in another one
+static motion_cmd_t cmdPool[MOTION_QUEUE_SIZE];
+static msg_t freeBuffer[MOTION_QUEUE_SIZE];
+static msg_t queueBuffer[MOTION_QUEUE_SIZE];
+static MAILBOX_DECL(motion_free, freeBuffer, MOTION_QUEUE_SIZE);
+static MAILBOX_DECL(motion_queue, queueBuffer, MOTION_QUEUE_SIZE);
+
+// Completion of the commands, commands are executed (and completed) in the order of their id
+static MUTEX_DECL(motion_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(motion_condvar);
+static uint32_t lastId = 0;
+static uint32_t doneId = 0;
+static uint32_t abortId = 0;
+
+static periodic_task_t motionTask;
+
+static uint32_t motion_post(const motion_cmd_t *request);
+static void motion_execute(const motion_cmd_t *cmd);
+static void motion_rotate_to(const motion_cmd_t *cmd, float heading);
+static void motion_drive_to(const motion_cmd_t *cmd);
+static int32_t motion_profile(int32_t remaining, int32_t cruise);
+static void motion_complete(uint32_t id);
+
+
+// Thread executing the queued motion commands one after the other
+static THD_WORKING_AREA(motion_thd_wa, 512);
+static THD_FUNCTION(motion_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	msg_t msg;
+	motion_cmd_t *cmd;
+	bool idle;
+
+	periodic_init(&motionTask, "motion", MOTION_PERIOD);
+
+	while(1) {
+		if(chMBFetch(&motion_queue, &msg, TIME_INFINITE) == MSG_OK) {
+			cmd = (motion_cmd_t *)msg;
+
+			if(cmd->id > abortId) {
+				motion_execute(cmd);
+			}
+
+			motion_complete(cmd->id);
+			chMBPost(&motion_free, msg, TIME_INFINITE);
+
+			// The other sources get the motors back once the queue is empty
+			chSysLock();
+			idle = (chMBGetUsedCountI(&motion_queue) == 0);
+			chSysUnlock();
+
+			if(idle) {
+				motor_arbiter_release(MOTOR_SRC_MOTION);
+			}
+		}
+	}
+}
+
+
+/*
+*	Function to start the THREAD of the motion engine.
+*/
+void motion_start(void) {
+	for(uint8_t i = 0; i < MOTION_QUEUE_SIZE; i++) {
+		chMBPost(&motion_free, (msg_t)&cmdPool[i], TIME_INFINITE);
+	}
+
+	monitor_thread_create(motion_thd_wa, sizeof(motion_thd_wa), NORMALPRIO + 1, motion_thd, NULL);
+}
+
+
+/*
+*	Function to queue a rotation on the spot.
+*
+*	params :
+*	int16_t degrees		angle of the rotation in degrees (positive to the left)
+*
+*	Returns the id of the command.
+*/
+uint32_t motion_turn(int16_t degrees) {
+	motion_cmd_t cmd = {.type = MOTION_TURN, .value = degrees};
+
+	return motion_post(&cmd);
+}
+
+
+/*
+*	Function to queue a straight move.
+*
+*	params :
+*	int16_t mm			distance in mm (positive forward)
+*
+*	Returns the id of the command.
+*/
+uint32_t motion_move(int16_t mm) {
+	motion_cmd_t cmd = {.type = MOTION_MOVE, .value = mm};
+
+	return motion_post(&cmd);
+}
+
+
+/*
+*	Function to queue a pause, the robot stays still during the given time.
+*
+*	params :
+*	uint16_t ms			duration of the pause in ms
+*
+*	Returns the id of the command.
+*/
+uint32_t motion_pause(uint16_t ms) {
+	motion_cmd_t cmd = {.type = MOTION_PAUSE, .value = ms};
+
+	return motion_post(&cmd);
+}
+
+
+/*
+*	Function to queue a move to a target position given in the odometry frame.
+*	The robot turns towards the target and drives straight to it.
+*
+*	params :
+*	float x, float y	target position in cm
+*
+*	Returns the id of the command.
+*/
+uint32_t motion_goto(float x, float y) {
+	motion_cmd_t cmd = {.type = MOTION_GOTO, .x = x, .y = y};
+
+	return motion_post(&cmd);
+}
+
+
+/*
+*	Function to queue a move to a target pose given in the odometry frame.
+*	Same as motion_goto, then the robot turns on the spot to the final heading.
+*
+*	params :
+*	float x, float y	target position in cm
+*	float theta			final heading in rad
+*
+*	Returns the id of the command.
+*/
+uint32_t motion_goto_pose(float x, float y, float theta) {
+	motion_cmd_t cmd = {.type = MOTION_GOTO_POSE, .x = x, .y = y, .theta = theta};
+
+	return motion_post(&cmd);
+}
+
+
+/*
+*	Function to stop the robot. The current command and every command queued
+*	before this call are cancelled (and completed).
+*/
+void motion_stop(void) {
+	chMtxLock(&motion_lock);
+	abortId = lastId;
+	chMtxUnlock(&motion_lock);
+}
+
+
+/*
+*	Function to know if a command is completed (or cancelled).
+*
+*	params :
+*	uint32_t id			id of the command returned when it was queued
+*/
+bool motion_done(uint32_t id) {
+	return (doneId >= id);
+}
+
+
+/*
+*	Function to wait until a command is completed (or cancelled).
+*
+*	params :
+*	uint32_t id			id of the command returned when it was queued
+*/
+void motion_wait(uint32_t id) {
+	chMtxLock(&motion_lock);
+
+	while(doneId < id) {
+		chCondWait(&motion_condvar);
+	}
+
+	chMtxUnlock(&motion_lock);
+}
+
+
+/*
+*	Function to queue a command. Blocks only if MOTION_QUEUE_SIZE commands are pending.
+*/
+static uint32_t motion_post(const motion_cmd_t *request) {
+	msg_t msg;
+	motion_cmd_t *cmd;
+	uint32_t id;
+
+	chMBFetch(&motion_free, &msg, TIME_INFINITE);
+	cmd = (motion_cmd_t *)msg;
+	*cmd = *request;
+
+	// The id is given under the lock so that the queue stays sorted by id.
+	// Posting never blocks here since a free slot was taken.
+	chMtxLock(&motion_lock);
+	id = ++lastId;
+	cmd->id = id;
+	chMBPost(&motion_queue, msg, TIME_INFINITE);
+	chMtxUnlock(&motion_lock);
+
+	return id;
+}
+
+
+/*
+*	Closed-loop execution of a command, the wheel positions are checked every
+*	MOTION_PERIOD ms and the speed decreases linearly near the target.
+*/
+static void motion_execute(const motion_cmd_t *cmd) {
+	int32_t leftStart = left_motor_get_pos();
+	int32_t rightStart = right_motor_get_pos();
+	int32_t target = 0, remaining = 0, speed = 0, cruise = 0;
+	pose_msg_t pose;
+	int8_t leftDir = 1, rightDir = 1;
+	systime_t start = chVTGetSystemTime();
+
+	switch(cmd->type) {
+		case MOTION_TURN:
+			target = (PERIMETER_EPUCK * NSTEP_ONE_TURN/360 / WHEEL_PERIMETER) * abs(cmd->value);
+			cruise = MOTION_TURN_SPEED;
+			leftDir = (cmd->value > 0) ? -1 : 1;
+			rightDir = -leftDir;
+			break;
+
+		case MOTION_MOVE:
+			target = (abs(cmd->value) * NSTEP_ONE_TURN) / (10 * WHEEL_PERIMETER);
+			cruise = MOTION_MOVE_SPEED;
+			leftDir = (cmd->value > 0) ? 1 : -1;
+			rightDir = leftDir;
+			break;
+
+		case MOTION_PAUSE:
+			motor_arbiter_request(MOTOR_SRC_MOTION, 0, 0);
+
+			while((chVTGetSystemTime() - start) < MS2ST(cmd->value) && (cmd->id > abortId)) {
+				chThdSleepMilliseconds(MOTION_PERIOD);
+			}
+
+			return;
+
+		case MOTION_GOTO:
+		case MOTION_GOTO_POSE:
+			odometry_get_pose(&pose);
+
+			if(hypotf(cmd->x - pose.x, cmd->y - pose.y) > MOTION_DIST_TOLERANCE) {
+				motion_rotate_to(cmd, atan2f(cmd->y - pose.y, cmd->x - pose.x));
+				motion_drive_to(cmd);
+			}
+
+			if(cmd->type == MOTION_GOTO_POSE) {
+				motion_rotate_to(cmd, cmd->theta);
+			}
+
+			motor_arbiter_request(MOTOR_SRC_MOTION, 0, 0);
+			return;
+	}
+
+	periodic_restart(&motionTask);
+
+	while(cmd->id > abortId) {
+		remaining = target - (abs(left_motor_get_pos() - leftStart)
+								+ abs(right_motor_get_pos() - rightStart)) / 2;
+
+		if(remaining <= 0) {
+			break;
+		}
+
+		speed = motion_profile(remaining, cruise);
+		motor_arbiter_request(MOTOR_SRC_MOTION, leftDir * speed, rightDir * speed);
+
+		periodic_wait(&motionTask);
+	}
+
+	motor_arbiter_request(MOTOR_SRC_MOTION, 0, 0);
+}
+
+
+/*
+*	Closed-loop rotation on the spot until the odometry heading reaches the given heading.
+*/
+static void motion_rotate_to(const motion_cmd_t *cmd, float heading) {
+	pose_msg_t pose;
+	float error;
+	int32_t speed;
+
+	periodic_restart(&motionTask);
+
+	while(cmd->id > abortId) {
+		PROF_START(PROF_MOTION);
+
+		odometry_get_pose(&pose);
+		error = odometry_wrap_angle(heading - pose.theta);
+
+		// Every exit of the cycle closes its measure
+		if(fabsf(error) < MOTION_ANGLE_TOLERANCE) {
+			PROF_STOP(PROF_MOTION);
+			break;
+		}
+
+		// Remaining angle converted in steps of each wheel
+		speed = motion_profile(fabsf(error) * WHEEL_DISTANCE/2 * NSTEP_ONE_TURN / WHEEL_PERIMETER,
+								MOTION_TURN_SPEED);
+
+		if(error > 0) {
+			motor_arbiter_request(MOTOR_SRC_MOTION, -speed, speed);
+		} else {
+			motor_arbiter_request(MOTOR_SRC_MOTION, speed, -speed);
+		}
+
+		PROF_STOP(PROF_MOTION);
+		periodic_wait(&motionTask);
+	}
+
+	motor_arbiter_request(MOTOR_SRC_MOTION, 0, 0);
+}
+
+
+/*
+*	Closed-loop straight move to the target position of the command, with a correction
+*	of the heading. Ends when the target is reached or passed.
+*/
+static void motion_drive_to(const motion_cmd_t *cmd) {
+	pose_msg_t pose;
+	float dx, dy, error, ahead;
+	int32_t speed, steer;
+
+	periodic_restart(&motionTask);
+
+	while(cmd->id > abortId) {
+		PROF_START(PROF_MOTION);
+
+		odometry_get_pose(&pose);
+		dx = cmd->x - pose.x;
+		dy = cmd->y - pose.y;
+		error = odometry_wrap_angle(atan2f(dy, dx) - pose.theta);
+
+		// Distance left to the target along the current heading
+		ahead = hypotf(dx, dy) * cosf(error);
+
+		if(ahead < MOTION_DIST_TOLERANCE) {
+			PROF_STOP(PROF_MOTION);
+			break;
+		}
+
+		speed = motion_profile(ahead * NSTEP_ONE_TURN / WHEEL_PERIMETER, MOTION_MOVE_SPEED);
+		steer = MOTION_HEADING_GAIN * error;
+
+		motor_arbiter_request(MOTOR_SRC_MOTION, speed - steer, speed + steer);
+
+		PROF_STOP(PROF_MOTION);
+		periodic_wait(&motionTask);
+	}
+
+	motor_arbiter_request(MOTOR_SRC_MOTION, 0, 0);
+}
+
+
+/*
+*	Speed profile of the motion engine: cruise speed far from the target,
+*	then linear deceleration down to MOTION_MIN_SPEED.
+*
+*	params :
+*	int32_t remaining	remaining steps to the target
+*	int32_t cruise		cruise speed in steps/s
+*/
+static int32_t motion_profile(int32_t remaining, int32_t cruise) {
+	int32_t speed = MOTION_MIN_SPEED + (remaining * (cruise - MOTION_MIN_SPEED)) / MOTION_DECEL_STEPS;
+
+	if(speed > cruise) {
+		speed = cruise;
+	}
+
+	return speed;
+}
+
+
+/*
+*	Function to signal the completion of a command to the waiting threads.
+*/
+static void motion_complete(uint32_t id) {
+	chMtxLock(&motion_lock);
+	doneId = id;
+	chCondBroadcast(&motion_condvar);
+	chMtxUnlock(&motion_lock);
+}
@@ -0,0 +1,47 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+
+#define MOTION_PERIOD			1		// Closed-loop period of the motion engine in [ms]
+#define MOTION_QUEUE_SIZE		8		// Maximum number of pending motion commands
+#define MOTION_TURN_SPEED		(GAME_SPEED/2)
+#define MOTION_MOVE_SPEED		GAME_SPEED
+#define MOTION_MIN_SPEED		150		// Speed reached at the target in [steps/s]
+#define MOTION_DECEL_STEPS		150		// Remaining steps under which the robot decelerates
+#define MOTION_DIST_TOLERANCE	0.2f	// Distance to a target position considered reached in [cm]
+#define MOTION_ANGLE_TOLERANCE	0.02f	// Angle to a target heading considered reached in [rad]
+#define MOTION_HEADING_GAIN		400		// Heading correction while driving in [steps/s/rad]
+
+typedef enum {
+	MOTION_TURN = 0,	// value: angle in [degrees], positive to the left
+	MOTION_MOVE,		// value: distance in [mm], positive forward
+	MOTION_PAUSE,		// value: duration in [ms]
+	MOTION_GOTO,		// x, y: target position in [cm] (odometry frame)
+	MOTION_GOTO_POSE,	// x, y, theta: target position in [cm] and final heading in [rad]
+} motion_cmd_type_t;
+
+typedef struct {
+	motion_cmd_type_t type;
+	int32_t value;
+	float x;
+	float y;
+	float theta;
+	uint32_t id;
+} motion_cmd_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void motion_start(void);
+uint32_t motion_turn(int16_t degrees);
+uint32_t motion_move(int16_t mm);
+uint32_t motion_pause(uint16_t ms);
+uint32_t motion_goto(float x, float y);
+uint32_t motion_goto_pose(float x, float y, float theta);
+void motion_stop(void);
+bool motion_done(uint32_t id);
+void motion_wait(uint32_t id);
+
+
+#endif /* MOTION_H */
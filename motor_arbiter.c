@@ -0,0 +1,256 @@
+/*
+  \file   	motor_arbiter.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Single output to the motors: the requests of the modules are arbitrated by
+  			priority, clamped and ramped at a fixed rate
+*/
+
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "capture.h"
+#include "main.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "periodic.h"
+#include "trace.h"
+
+#include "motors.h"
+
+
+typedef struct {
+	bool active;
+	int16_t left;
+	int16_t right;
+	trace_t trace;			// sample at the origin of the request, ended once applied
+} motor_request_t;
+
+// Requests of the sources and output, under the lock
+static motor_request_t requests[MOTOR_NB_SOURCES];
+static uint8_t winner = MOTOR_SRC_NONE;
+static int16_t outLeft = 0;
+static int16_t outRight = 0;
+static motor_stats_t stats;
+static uint32_t lastLimited = 0;
+static uint32_t lastClamped = 0;
+static MUTEX_DECL(motor_lock); // @suppress("Field cannot be resolved")
+
+static periodic_task_t motorTask;
+
+static void motor_arbitrate(void);
+static int16_t motor_ramp(int16_t current, int16_t target, bool *limited);
+static int16_t motor_clamp(int32_t speed);
+
+
+// Thread applying the winning request to the motors
+static THD_WORKING_AREA(motor_arb_thd_wa, 256);
+static THD_FUNCTION(motor_arb_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	periodic_init(&motorTask, "motor", MOTOR_ARB_PERIOD);
+
+	while(1) {
+		chMtxLock(&motor_lock);
+		motor_arbitrate();
+		chMtxUnlock(&motor_lock);
+
+		periodic_wait(&motorTask);
+	}
+}
+
+
+/*
+*	Function to start the THREAD driving the motors. motors_init() must be called before.
+*/
+void motor_arbiter_start(void) {
+	monitor_thread_create(motor_arb_thd_wa, sizeof(motor_arb_thd_wa), NORMALPRIO + 1,
+						  motor_arb_thd, NULL);
+}
+
+
+/*
+*	Function to set the speeds asked by a source, they are kept till the next request
+*	or the release of the source.
+*
+*	params :
+*	motor_source_t source		requesting module
+*	int32_t left, right			speeds in [steps/s], clamped to MOTOR_SPEED_LIMIT
+*/
+void motor_arbiter_request(motor_source_t source, int32_t left, int32_t right) {
+	motor_arbiter_request_traced(source, left, right, NULL);
+}
+
+
+/*
+*	Same as motor_arbiter_request, the latency of the trace ends when the request is
+*	applied to the motors. The trace is taken over by the arbiter.
+*
+*	params :
+*	motor_source_t source		requesting module
+*	int32_t left, right			speeds in [steps/s], clamped to MOTOR_SPEED_LIMIT
+*	trace_t *trace				trace of the sample causing the request, or NULL
+*/
+void motor_arbiter_request_traced(motor_source_t source, int32_t left, int32_t right,
+								  trace_t *trace) {
+	chMtxLock(&motor_lock);
+
+	// A request not applied yet is replaced
+	if((trace != NULL) && (trace->id != 0)) {
+		trace_drop(&requests[source].trace);
+		requests[source].trace = *trace;
+		trace->id = 0;
+	}
+
+	requests[source].left = motor_clamp(left);
+	requests[source].right = motor_clamp(right);
+	requests[source].active = TRUE;
+
+	// The safety stop does not wait for the next period
+	if(source == MOTOR_SRC_SAFETY) {
+		motor_arbitrate();
+	}
+
+	chMtxUnlock(&motor_lock);
+}
+
+
+/*
+*	Function to give the motors back to the sources of lower priority.
+*
+*	params :
+*	motor_source_t source		releasing module
+*/
+void motor_arbiter_release(motor_source_t source) {
+	chMtxLock(&motor_lock);
+	requests[source].active = FALSE;
+	trace_drop(&requests[source].trace);
+	chMtxUnlock(&motor_lock);
+}
+
+
+/*
+*	Function to get a consistent copy of the arbitration counters.
+*
+*	params :
+*	motor_stats_t *out		pointer to the structure to fill
+*/
+void motor_arbiter_get_stats(motor_stats_t *out) {
+	chMtxLock(&motor_lock);
+	*out = stats;
+	chMtxUnlock(&motor_lock);
+}
+
+
+/*
+*	Function to get the speeds applied to the motors.
+*
+*	params :
+*	int16_t *left, *right		filled with the speeds in [steps/s]
+*/
+void motor_arbiter_get_output(int16_t *left, int16_t *right) {
+	chMtxLock(&motor_lock);
+	*left = outLeft;
+	*right = outRight;
+	chMtxUnlock(&motor_lock);
+}
+
+
+/*
+*	Chooses the active source of highest priority and moves the output towards its
+*	request, the caller holds the lock.
+*/
+static void motor_arbitrate(void) {
+	uint8_t source = MOTOR_NB_SOURCES;
+	int16_t left = 0, right = 0;
+	int16_t lastLeft = outLeft, lastRight = outRight;
+	bool limited = FALSE;
+	motor_report_t report;
+
+	while((source > 0) && !requests[source - 1].active) {
+		source--;
+	}
+
+	source = (source == 0) ? MOTOR_SRC_NONE : source - 1;
+
+	if(source != MOTOR_SRC_NONE) {
+		left = requests[source].left;
+		right = requests[source].right;
+	}
+
+	if(source != winner) {
+		report.source = source;
+		report.previous = winner;
+		report.left = left;
+		report.right = right;
+		report.limited = stats.limited - lastLimited;
+		report.clamped = stats.clamped - lastClamped;
+		capture_send(CAPTURE_MOTOR, &report, sizeof(report));
+
+		lastLimited = stats.limited;
+		lastClamped = stats.clamped;
+		winner = source;
+		stats.switches++;
+	}
+
+	if(source == MOTOR_SRC_SAFETY) {
+		outLeft = left;
+		outRight = right;
+	} else {
+		outLeft = motor_ramp(outLeft, left, &limited);
+		outRight = motor_ramp(outRight, right, &limited);
+	}
+
+	stats.periods[source]++;
+	stats.limited += limited;
+
+	if((outLeft != lastLeft) || (outRight != lastRight)) {
+		left_motor_set_speed(outLeft);
+		right_motor_set_speed(outRight);
+	}
+
+	// The traced requests end when they drive the motors, the others are overridden
+	for(uint8_t i = 0; i < MOTOR_NB_SOURCES; i++) {
+		if(i == source) {
+			trace_end(&requests[i].trace);
+		} else {
+			trace_drop(&requests[i].trace);
+		}
+	}
+}
+
+
+/*
+*	Moves a wheel speed towards its target by MOTOR_ARB_STEP at most.
+*/
+static int16_t motor_ramp(int16_t current, int16_t target, bool *limited) {
+	if(target > current + MOTOR_ARB_STEP) {
+		*limited = TRUE;
+		return current + MOTOR_ARB_STEP;
+	} else if(target < current - MOTOR_ARB_STEP) {
+		*limited = TRUE;
+		return current - MOTOR_ARB_STEP;
+	}
+
+	return target;
+}
+
+
+/*
+*	Limits a requested speed to the range of the motors, the caller holds the lock.
+*/
+static int16_t motor_clamp(int32_t speed) {
+	if(speed > MOTOR_SPEED_LIMIT) {
+		stats.clamped++;
+		return MOTOR_SPEED_LIMIT;
+	} else if(speed < -MOTOR_SPEED_LIMIT) {
+		stats.clamped++;
+		return -MOTOR_SPEED_LIMIT;
+	}
+
+	return speed;
+}
@@ -0,0 +1,57 @@
+#ifndef MOTOR_ARBITER_H
+#define MOTOR_ARBITER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trace.h"
+
+
+#define MOTOR_ARB_PERIOD		1		// Period of the output to the motors in [ms]
+#define MOTOR_ARB_MAX_ACCEL		20000	// Max change of a wheel speed in [steps/s^2]
+#define MOTOR_ARB_STEP			(MOTOR_ARB_MAX_ACCEL * MOTOR_ARB_PERIOD / 1000)
+
+// Sources of the speed requests, sorted by priority: the active source with the highest
+// value drives the motors
+typedef enum {
+	MOTOR_SRC_STEERING = 0,	// audio command
+	MOTOR_SRC_WALL,			// wall following of the return through the hallway
+	MOTOR_SRC_MOTION,		// motion engine, while commands are queued
+	MOTOR_SRC_FINISH,		// stop on the finish line
+	MOTOR_SRC_SAFETY,		// stop on an obstacle, applied at once without ramp
+	MOTOR_NB_SOURCES,
+} motor_source_t;
+
+#define MOTOR_SRC_NONE		MOTOR_NB_SOURCES	// No active source, the motors are stopped
+
+// Arbitration decision sent in the CAPTURE_MOTOR stream when the winning source changes
+typedef struct __attribute__((packed)) {
+	uint8_t source;			// motor_source_t or MOTOR_SRC_NONE
+	uint8_t previous;
+	int16_t left;			// request of the new source in [steps/s]
+	int16_t right;
+	uint32_t limited;		// periods limited by the ramp since the previous decision
+	uint32_t clamped;		// requests clamped since the previous decision
+} motor_report_t;
+
+typedef struct {
+	uint32_t periods[MOTOR_NB_SOURCES + 1];	// periods won by each source (and by none)
+	uint32_t switches;
+	uint32_t limited;
+	uint32_t clamped;
+} motor_stats_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void motor_arbiter_start(void);
+void motor_arbiter_request(motor_source_t source, int32_t left, int32_t right);
+void motor_arbiter_request_traced(motor_source_t source, int32_t left, int32_t right,
+								  trace_t *trace);
+void motor_arbiter_release(motor_source_t source);
+void motor_arbiter_get_stats(motor_stats_t *stats);
+void motor_arbiter_get_output(int16_t *left, int16_t *right);
+
+
+#endif /* MOTOR_ARBITER_H */
@@ -0,0 +1,153 @@
+/*
+  \file   	odometry.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Wheel odometry estimating the pose of the e-puck
+*/
+
+#include <stdbool.h>
+#include <math.h>
+#include <arm_math.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "main.h"
+#include "monitor.h"
+#include "odometry.h"
+#include "periodic.h"
+#include "profiling.h"
+#include "process_image.h"
+
+#include "motors.h"
+
+
+// Integrated pose and last wheel positions used to compute the displacement
+static MUTEX_DECL(odometry_lock); // @suppress("Field cannot be resolved")
+static pose_msg_t pose = {0};
+static int32_t lastLeftPos = 0;
+static int32_t lastRightPos = 0;
+
+// Topic on which the pose is published
+static MUTEX_DECL(pose_topic_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(pose_topic_condvar);
+static messagebus_topic_t pose_topic;
+static pose_msg_t pose_topic_value;
+
+static periodic_task_t odometryTask;
+
+static void odometry_update(void);
+
+
+// Thread integrating the wheel positions at a fixed rate
+static THD_WORKING_AREA(odometry_thd_wa, 512);
+static THD_FUNCTION(odometry_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	pose_msg_t current;
+
+	periodic_init(&odometryTask, "odometry", ODOMETRY_PERIOD);
+
+	while(1) {
+		odometry_get_pose(&current);
+		messagebus_topic_publish(&pose_topic, &current, sizeof(current));
+
+		periodic_wait(&odometryTask);
+	}
+}
+
+
+/*
+*	Function to start the THREAD of the odometry and to advertise the "/pose" topic.
+*/
+void odometry_start(void) {
+	lastLeftPos = left_motor_get_pos();
+	lastRightPos = right_motor_get_pos();
+
+	messagebus_topic_init(&pose_topic, &pose_topic_lock, &pose_topic_condvar,
+							&pose_topic_value, sizeof(pose_topic_value));
+	messagebus_advertise_topic(&bus, &pose_topic, "/pose");
+
+	monitor_thread_create(odometry_thd_wa, sizeof(odometry_thd_wa), NORMALPRIO + 1, odometry_thd, NULL);
+}
+
+
+/*
+*	Function to get the current pose. The wheel positions are integrated up to now,
+*	so the pose is never older than the call.
+*
+*	params :
+*	pose_msg_t *pose_out	pointer to the structure to fill
+*/
+void odometry_get_pose(pose_msg_t *pose_out) {
+	chMtxLock(&odometry_lock);
+	odometry_update();
+	*pose_out = pose;
+	chMtxUnlock(&odometry_lock);
+}
+
+
+/*
+*	Function to set the current pose, for example to define the start line as the origin.
+*
+*	params :
+*	float x, float y	position in cm
+*	float theta			orientation in rad
+*/
+void odometry_set_pose(float x, float y, float theta) {
+	chMtxLock(&odometry_lock);
+	odometry_update();
+	pose.x = x;
+	pose.y = y;
+	pose.theta = odometry_wrap_angle(theta);
+	chMtxUnlock(&odometry_lock);
+}
+
+
+/*
+*	Function to bring an angle back in [-PI, PI].
+*
+*	params :
+*	float angle			angle in rad
+*/
+float odometry_wrap_angle(float angle) {
+	while(angle > PI) {
+		angle -= 2 * PI;
+	}
+
+	while(angle < -PI) {
+		angle += 2 * PI;
+	}
+
+	return angle;
+}
+
+
+/*
+*	Integration of the wheel displacements since the last update (midpoint method).
+*	Must be called with odometry_lock held.
+*/
+static void odometry_update(void) {
+	int32_t leftPos = left_motor_get_pos();
+	int32_t rightPos = right_motor_get_pos();
+	float leftDist, rightDist, dist, dTheta;
+
+	PROF_START(PROF_ODOMETRY);
+
+	leftDist = (leftPos - lastLeftPos) * WHEEL_PERIMETER / NSTEP_ONE_TURN;
+	rightDist = (rightPos - lastRightPos) * WHEEL_PERIMETER / NSTEP_ONE_TURN;
+	lastLeftPos = leftPos;
+	lastRightPos = rightPos;
+
+	dist = (leftDist + rightDist) / 2;
+	dTheta = (rightDist - leftDist) / WHEEL_DISTANCE;
+
+	pose.x += dist * cosf(pose.theta + dTheta/2);
+	pose.y += dist * sinf(pose.theta + dTheta/2);
+	pose.theta = odometry_wrap_angle(pose.theta + dTheta);
+	pose.time = chVTGetSystemTime();
+
+	PROF_STOP(PROF_ODOMETRY);
+}
@@ -0,0 +1,25 @@
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+
+#define ODOMETRY_PERIOD			10		// Integration and publication period in [ms]
+
+// Pose of the e-puck, published on the "/pose" topic
+typedef struct {
+	float x;				// in [cm]
+	float y;				// in [cm]
+	float theta;			// in [rad], positive to the left, in [-PI, PI]
+	systime_t time;			// system time of the last integration
+} pose_msg_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void odometry_start(void);
+void odometry_get_pose(pose_msg_t *pose);
+void odometry_set_pose(float x, float y, float theta);
+float odometry_wrap_angle(float angle);
+
+
+#endif /* ODOMETRY_H */
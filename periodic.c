@@ -0,0 +1,156 @@
+/*
+  \file   	periodic.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.1
+  \brief  	Fixed-rate loops with absolute deadlines and deadline-miss counters
+*/
+
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "periodic.h"
+
+
+// List of the declared tasks, to read their counters at runtime
+static periodic_task_t *firstTask = NULL;
+
+
+/*
+*	Function to declare a periodic task. The first activation is the time of the call.
+*
+*	params :
+*	periodic_task_t *task	task to initialize (static, it stays in the list of tasks)
+*	const char *name		name used when the counters are reported
+*	uint32_t periodMs		period in ms
+*/
+void periodic_init(periodic_task_t *task, const char *name, uint32_t periodMs) {
+	task->name = name;
+	task->period = MS2ST(periodMs);
+	task->release = chVTGetSystemTime();
+	task->cycles = 0;
+	task->overruns = 0;
+	task->missed = 0;
+	task->jitterMax = 0;
+	task->jitterSum = 0;
+	task->jitterCount = 0;
+
+	chSysLock();
+	task->next = firstTask;
+	firstTask = task;
+	chSysUnlock();
+}
+
+
+/*
+*	Function to call at the end of each cycle of a time-triggered loop. Sleeps until
+*	the next activation, which is always a multiple of the period after the first one.
+*	If the work lasted longer than a period, the passed activations are skipped and counted.
+*/
+void periodic_wait(periodic_task_t *task) {
+	systime_t now = chVTGetSystemTime();
+	systime_t elapsed = now - task->release;
+	systime_t late;
+	uint32_t skipped = elapsed / task->period;
+
+	chSysLock();
+	task->cycles++;
+
+	if(skipped > 0) {
+		task->overruns++;
+		task->missed += skipped;
+	}
+
+	chSysUnlock();
+
+	task->release += (skipped + 1) * task->period;
+	chThdSleepUntilWindowed(now, task->release);
+
+	// Wake-up jitter
+	late = chVTGetSystemTime() - task->release;
+
+	chSysLock();
+	task->jitterSum += late;
+	task->jitterCount++;
+
+	if(late > task->jitterMax) {
+		task->jitterMax = late;
+	}
+
+	chSysUnlock();
+}
+
+
+/*
+*	Function to restart a task after an idle time, the next activation is one
+*	period after the call and the idle time is not counted as missed activations.
+*/
+void periodic_restart(periodic_task_t *task) {
+	task->release = chVTGetSystemTime();
+}
+
+
+/*
+*	Function to call each time an event-triggered loop wakes up on a new sample which
+*	is expected every period. The jitter is the difference to the expected time and the
+*	missed counter gives the number of samples which did not arrive in time.
+*	The overrun counter is not used by event-triggered loops.
+*/
+void periodic_event(periodic_task_t *task) {
+	systime_t now = chVTGetSystemTime();
+	systime_t elapsed = now - task->release;
+	systime_t late = (elapsed > task->period) ? (elapsed - task->period)
+											  : (task->period - elapsed);
+	uint32_t skipped = (elapsed + task->period/2) / task->period;
+
+	task->release = now;
+
+	chSysLock();
+
+	// The first event only starts the measurements
+	if(task->cycles++ == 0) {
+		chSysUnlock();
+		return;
+	}
+
+	if(skipped > 1) {
+		task->missed += skipped - 1;
+	}
+
+	task->jitterSum += late;
+	task->jitterCount++;
+
+	if(late > task->jitterMax) {
+		task->jitterMax = late;
+	}
+
+	chSysUnlock();
+}
+
+
+/*
+*	Function to read the counters of a task.
+*
+*	params :
+*	const periodic_task_t *task		task to read
+*	periodic_stats_t *stats			pointer to the structure to fill
+*/
+void periodic_get_stats(const periodic_task_t *task, periodic_stats_t *stats) {
+	chSysLock();
+	stats->cycles = task->cycles;
+	stats->overruns = task->overruns;
+	stats->missed = task->missed;
+	stats->jitterMax = ST2US(task->jitterMax);
+	stats->jitterMean = (task->jitterCount > 0) ? ST2US(task->jitterSum / task->jitterCount) : 0;
+	chSysUnlock();
+}
+
+
+/*
+*	Function to get the first declared task, the others follow with task->next.
+*/
+periodic_task_t *periodic_first(void) {
+	return firstTask;
+}
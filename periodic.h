@@ -0,0 +1,55 @@
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include <stdint.h>
+
+
+#define PERIODIC_NAME_LEN		12		// Characters of the name in a report
+
+// Fixed-rate task. The fields are updated by the task itself, use periodic_get_stats
+// to read the counters from another thread.
+typedef struct periodic_task_s {
+	const char *name;
+	systime_t period;
+	systime_t release;			// activation time of the current cycle
+	uint32_t cycles;
+	uint32_t overruns;			// cycles whose work lasted longer than one period
+	uint32_t missed;			// activations skipped because of an overrun
+	systime_t jitterMax;		// max delay between the activation time and the wake-up
+	uint32_t jitterSum;
+	uint32_t jitterCount;		// jitters summed, the first event of a task has none
+	struct periodic_task_s *next;
+} periodic_task_t;
+
+typedef struct {
+	uint32_t cycles;
+	uint32_t overruns;
+	uint32_t missed;
+	uint32_t jitterMax;			// in [us]
+	uint32_t jitterMean;		// in [us]
+} periodic_stats_t;
+
+// Counters of a task sent in the CAPTURE_PERIODIC stream
+typedef struct __attribute__((packed)) {
+	char name[PERIODIC_NAME_LEN];	// terminated, longer names are cut
+	uint32_t period;		// in [us]
+	uint32_t cycles;
+	uint32_t overruns;
+	uint32_t missed;
+	uint32_t jitterMax;		// in [us]
+	uint32_t jitterMean;	// in [us]
+} periodic_report_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void periodic_init(periodic_task_t *task, const char *name, uint32_t periodMs);
+void periodic_wait(periodic_task_t *task);
+void periodic_restart(periodic_task_t *task);
+void periodic_event(periodic_task_t *task);
+void periodic_get_stats(const periodic_task_t *task, periodic_stats_t *stats);
+periodic_task_t *periodic_first(void);
+
+
+#endif /* PERIODIC_H */
@@ -2,7 +2,7 @@
   \file   	process_image.c
   \author 	Antoine Duret & Carla Schmid (Group G08)
   \date   	16.05.2021
-  \version	4.0
+  \version	4.1
   \brief  	Code for image processing related tasks
 */
 
@@ -14,10 +14,24 @@
 #include <stdbool.h>
 #include <math.h>
 
+#include "arena.h"
 #include "audio_processing.h"
+#include "capture.h"
+#include "game.h"
 #include "main.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "motion.h"
+#include "odometry.h"
+#include "periodic.h"
+#include "profiling.h"
 #include "process_image.h"
+#include "proximity_filter.h"
 #include "proximity_sensors.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "trajectory.h"
+#include "tuning.h"
 
 #include "camera/po8030.h"
 #include "sensors/proximity.h"
@@ -26,7 +40,15 @@
 
 
 static bool linesFound = FALSE;
-static bool goalDetection = FALSE;
+static bool goalDetection = FALSE;		// set by the game state machine
+
+// Wall following loop of the return through the hallway
+static periodic_task_t hallwayTask;
+static BSEMAPHORE_DECL(return_sem, TRUE); // @suppress("Field cannot be resolved")
+
+static bool finish_line_reached(uint16_t dist, const tuning_t *tuning);
+static bool return_replay(void);
+static void return_through_hallway(void);
 
 
 /*======================================================================================*/
@@ -36,12 +58,15 @@ static bool goalDetection = FALSE;
 
 // Semaphore
 static BSEMAPHORE_DECL(image_ready_sem, TRUE); // @suppress("Field cannot be resolved")
+static trace_t frameTrace;			// last captured frame, under the system lock
 
 static THD_WORKING_AREA(waCaptureImage, 256);
 static THD_FUNCTION(CaptureImage, arg) {
     chRegSetThreadName(__FUNCTION__);
     (void)arg;
 
+	trace_t trace;
+
 	// Takes pixels 0 to IMAGE_BUFFER_SIZE of the line 10 + 11 (minimum 2 lines because reasons)
 	po8030_advanced_config(FORMAT_RGB565, 0, 10, IMAGE_BUFFER_SIZE, 2,
 															SUBSAMPLING_X1, SUBSAMPLING_X1);
@@ -56,6 +81,12 @@ static THD_FUNCTION(CaptureImage, arg) {
 		// Waits for the capture to be done
 		wait_image_ready();
 
+		// A frame not processed in time is replaced by the next one
+		trace_stamp(&trace, TRACE_CAM_FINISH);
+		chSysLock();
+		frameTrace = trace;
+		chSysUnlock();
+
 		// Signals an image has been captured
 		chBSemSignal(&image_ready_sem);
     }
@@ -68,12 +99,26 @@ static THD_FUNCTION(ProcessImage, arg) {
     (void)arg;
 
 	uint8_t *img_buff_ptr;
-	uint8_t image[IMAGE_BUFFER_SIZE] = {0};
+	uint8_t *image;
+	trace_t trace;
+	tuning_t tuning;
+	uint32_t tuningVersion = 0;
+	telemetry_line_t line;
 
     while(1) {
     	// Waits until an image has been captured
         chBSemWait(&image_ready_sem);
 
+        chSysLock();
+        trace = frameTrace;
+        chSysUnlock();
+
+        // The lines are only searched during the race and the return
+        if((image = arena_acquire(ARENA_IMAGE)) == NULL) {
+        	linesFound = FALSE;
+        	continue;
+        }
+
         // Gets the pointer to the array filled with the last image in RGB565
         img_buff_ptr = dcmi_get_last_image_ptr();
 
@@ -81,22 +126,63 @@ static THD_FUNCTION(ProcessImage, arg) {
    			image[i/2] = ((uint8_t) img_buff_ptr[i] & 0xF8); // red
    		}
 
+  		capture_send(CAPTURE_CAM, image, IMAGE_BUFFER_SIZE);
+  		tuning_update(&tuning, &tuningVersion);
+
   		// Search for line in the image and gets its width in pixels
-  		detect_line(image);
+  		PROF_START(PROF_IMAGE);
+  		linesFound = detect_line(image, tuning.minLineWidth, &line);
+  		PROF_STOP(PROF_IMAGE);
+
+  		arena_release(ARENA_IMAGE);
+
+  		line.tofDist = VL53L0X_get_dist_mm();
+  		capture_send(CAPTURE_LINE, &line, sizeof(line));
+
+  		// Checked on every image, the state machine ends the race
+  		if(goalDetection && finish_line_reached(line.tofDist, &tuning)) {
+  			game_post_traced(GAME_EV_FINISH_LINE, &trace);
+  		}
+    }
+}
+
+
+// Thread driving the e-puck back to the start line, the game flow goes on meanwhile
+static THD_WORKING_AREA(waReturn, 1024);
+static THD_FUNCTION(Return, arg) {
+    chRegSetThreadName(__FUNCTION__);
+    (void)arg;
+
+    while(1) {
+    	chBSemWait(&return_sem);
+
+    	if(!(RETURN_REPLAY && return_replay())) {
+    		return_through_hallway();
+    	}
+
+    	game_post(GAME_EV_RETURNED);
     }
 }
 
 
 void process_image_start(void) {
-	chThdCreateStatic(waProcessImage, sizeof(waProcessImage), NORMALPRIO, ProcessImage, NULL);
-	chThdCreateStatic(waCaptureImage, sizeof(waCaptureImage), NORMALPRIO, CaptureImage, NULL);
+	periodic_init(&hallwayTask, "hallway", RETURN_PERIOD);
+
+	monitor_thread_create(waProcessImage, sizeof(waProcessImage), NORMALPRIO, ProcessImage, NULL);
+	monitor_thread_create(waCaptureImage, sizeof(waCaptureImage), NORMALPRIO, CaptureImage, NULL);
+	monitor_thread_create(waReturn, sizeof(waReturn), NORMALPRIO, Return, NULL);
 }
 
 
 /*
-* 	Counts the amount of lines found in picture and changes bool if enough lines are in detected.
+* 	Counts the amount of lines found in picture and returns TRUE if enough lines are detected.
+*
+*	params :
+*	uint8_t *buffer				row of the image
+*	uint16_t minLineWidth		narrowest line counted in pixels
+*	telemetry_line_t *line		lines found and mean of the row, tofDist is left to the caller
 */
-void detect_line(uint8_t *buffer) {
+bool detect_line(uint8_t *buffer, uint16_t minLineWidth, telemetry_line_t *line) {
 	volatile uint16_t i = 0, begin = 0, end = 0;
 	uint8_t stop = 0, wrongLine = 0, lineNotFound = 0;
 	uint32_t mean = 0;
@@ -144,7 +230,7 @@ void detect_line(uint8_t *buffer) {
 			}
 
 			// If a too small line has been detected, continue the search.
-			if(!lineNotFound && ((end-begin) < MIN_LINE_WIDTH)) {
+			if(!lineNotFound && ((end-begin) < minLineWidth)) {
 				i = end;
 				begin = 0;
 				end = 0;
@@ -158,11 +244,11 @@ void detect_line(uint8_t *buffer) {
 		}
 	}
 
-	if(counterLines >= MIN_GOAL_LINES) {
-		linesFound = TRUE;
-	} else {
-		linesFound = FALSE;
-	}
+	line->counterLines = counterLines;
+	line->mean = mean;
+	line->linesFound = (counterLines >= MIN_GOAL_LINES);
+
+	return line->linesFound;
 }
 
 
@@ -171,26 +257,15 @@ void detect_line(uint8_t *buffer) {
 /*======================================================================================*/
 
 /*
-*	Function used to check if the finish line is reached.
+*	Function used to check if the finish line is reached, with the lines of the last
+*	image and the distance to the wall behind them.
+*
+*	params :
+*	uint16_t dist				ToF distance in [mm] read with the image
+*	const tuning_t *tuning		parameters read with the image
 */
-bool verify_finish_line(void) {
-	bool goalDetected = FALSE;
-	if(goalDetection) {
-		if((VL53L0X_get_dist_mm() <= GOAL_DIST_MAX) && (VL53L0X_get_dist_mm() >= GOAL_DIST_MIN)) {
-			if(linesFound) {
-				goalDetected = TRUE;
-
-				status_audio_command(FALSE);
-				status_obst_detection(FALSE);
-				status_goal_detection(FALSE);
-
-				left_motor_set_speed(0);
-				right_motor_set_speed(0);
-			}
-		}
-	}
-
-	return goalDetected;
+static bool finish_line_reached(uint16_t dist, const tuning_t *tuning) {
+	return linesFound && (dist <= tuning->goalDistMax) && (dist >= tuning->goalDistMin);
 }
 
 
@@ -208,109 +283,127 @@ void status_goal_detection(bool status) {
 /*
 *	Function used to return to the start line when a player is done with the game
 *	(when the finish line is reached).
+*	The recorded path of the game is followed backwards when available (fast return),
+*	otherwise the e-puck goes back through the hallway. The return is driven by its own
+*	thread, this function does not block: GAME_EV_RETURNED is posted at the start line.
 */
 void return_to_start_line(void) {
-	messagebus_topic_t *prox_topic = messagebus_find_topic_blocking(&bus, "/proximity");
-	proximity_msg_t proxValues;
+	chBSemSignal(&return_sem);
+}
+
+
+/*
+*	Fast return to the start pose along the simplified recorded path of the game.
+*
+*	Returns FALSE if no complete recording is available.
+*/
+static bool return_replay(void) {
+	traj_point_t *route;
+	uint16_t nbPoints;
+
+	if((route = arena_acquire(ARENA_ROUTE)) == NULL) {
+		return FALSE;
+	}
+
+	nbPoints = trajectory_plan_return(route, RETURN_MAX_POINTS);
+
+	if(nbPoints == 0) {
+		arena_release(ARENA_ROUTE);
+		return FALSE;
+	}
+
+	for(uint16_t i = 0; i < (nbPoints - 1); i++) {
+		motion_goto(route[i].x, route[i].y);
+	}
+
+	motion_wait(motion_goto_pose(route[nbPoints - 1].x, route[nbPoints - 1].y,
+								 route[nbPoints - 1].theta));
+
+	arena_release(ARENA_ROUTE);
+
+	return TRUE;
+}
+
+
+/*
+*	Return to the start line by following the walls of the hallway till the lines
+*	are detected.
+*/
+static void return_through_hallway(void) {
+	messagebus_topic_t *prox_topic = messagebus_find_topic_blocking(&bus, "/proximity_filtered");
+	proximity_filtered_msg_t proxValues;
 	int16_t leftSpeed = 0, rightSpeed = 0;
 	systime_t time;
-
-	left_motor_set_speed(0);
-	right_motor_set_speed(0);
+	pose_msg_t pose;
+	float viaX, viaY, heading;
 
 	// Go towards hallway
 	go_forward_cm(2);
 	turn_left_degrees(50);
 
-	// Goes through hallway till detects lines
+	// Goes through hallway till detects lines, with the last proximity sample
 	time = chVTGetSystemTime();
+	periodic_restart(&hallwayTask);
+	messagebus_topic_wait(prox_topic, &proxValues, sizeof(proxValues));
+
 	while ((linesFound == FALSE) || (VL53L0X_get_dist_mm() > RETURN_LINE_DETECTION_DISTANCE) ||
 		   ((chVTGetSystemTime() - time) < MINIMAL_TIME_RETURN)) {
-		messagebus_topic_wait(prox_topic, &proxValues, sizeof(proxValues));
-		leftSpeed = MOTOR_SPEED_LIMIT - proxValues.delta[0]*3 - 2*proxValues.delta[1];
-		rightSpeed = MOTOR_SPEED_LIMIT - proxValues.delta[7]*3 - 2*proxValues.delta[6];
-		right_motor_set_speed(rightSpeed);
-		left_motor_set_speed(leftSpeed);
-		chThdSleepUntilWindowed(time, time + MS2ST(15)); // refresh @ 100 Hz
+		messagebus_topic_read(prox_topic, &proxValues, sizeof(proxValues));
+		leftSpeed = MOTOR_SPEED_LIMIT - WALL_GAIN_FRONT*proxValues.value[0]
+									  - WALL_GAIN_DIAG*proxValues.value[1];
+		rightSpeed = MOTOR_SPEED_LIMIT - WALL_GAIN_FRONT*proxValues.value[7]
+									   - WALL_GAIN_DIAG*proxValues.value[6];
+		motor_arbiter_request(MOTOR_SRC_WALL, leftSpeed, rightSpeed);
+		periodic_wait(&hallwayTask);
 	}
 
-	left_motor_set_speed(0);
-	right_motor_set_speed(0);
+	motor_arbiter_release(MOTOR_SRC_WALL);
 
-	// Goes to starting position
-	go_forward_cm(7);
-	turn_right_degrees(77);
-	go_forward_cm(28);
-	turn_right_degrees(80);
+	// Goes to starting position. Its pose is defined relatively to the pose at the end of
+	// the hallway and reached with the odometry.
+	odometry_get_pose(&pose);
+	viaX = pose.x + RETURN_EXIT_DIST * cosf(pose.theta);
+	viaY = pose.y + RETURN_EXIT_DIST * sinf(pose.theta);
+	heading = pose.theta - RETURN_EXIT_TURN * PI / 180;
 
-	status_audio_command(FALSE);
-	status_voice_calibration(FALSE);
+	motion_goto(viaX, viaY);
+	motion_wait(motion_goto_pose(viaX + RETURN_START_DIST * cosf(heading),
+								 viaY + RETURN_START_DIST * sinf(heading),
+								 heading - RETURN_START_TURN * PI / 180));
 }
 
 
 /*
 *	Function to turn right of a given angle in degrees.
+*	Blocks the caller until the motion engine has completed the rotation.
 *
 *	params :
 *	uint8_t degrees		value of the desired rotation angle in degrees
 */
 void turn_right_degrees(uint8_t degrees) {
-	left_motor_set_pos(0);
-	right_motor_set_pos(0);
-
-	left_motor_set_speed(GAME_SPEED/2);
-	right_motor_set_speed(-GAME_SPEED/2);
-
-	while(abs(right_motor_get_pos()) <=
-			(PERIMETER_EPUCK * NSTEP_ONE_TURN/360 / WHEEL_PERIMETER) * degrees) {
-		chThdSleepMilliseconds(100);
-	}
-
-	left_motor_set_speed(0);
-	right_motor_set_speed(0);
+	motion_wait(motion_turn(-degrees));
 }
 
 
 /*
 *	Function to turn left of a given angle in degrees.
+*	Blocks the caller until the motion engine has completed the rotation.
 *
 *	params :
 *	uint8_t degrees		value of the desired rotation angle in degrees
 */
 void turn_left_degrees(uint8_t degrees) {
-	left_motor_set_pos(0);
-	right_motor_set_pos(0);
-
-	left_motor_set_speed(-GAME_SPEED/2);
-	right_motor_set_speed(GAME_SPEED/2);
-
-	while(abs(right_motor_get_pos()) <=
-			(PERIMETER_EPUCK * NSTEP_ONE_TURN/360 / WHEEL_PERIMETER) * degrees) {
-		chThdSleepMilliseconds(100);
-	}
-
-	left_motor_set_speed(0);
-	right_motor_set_speed(0);
+	motion_wait(motion_turn(degrees));
 }
 
 
 /*
 *	Function to move forward a given distance in cm.
+*	Blocks the caller until the motion engine has completed the move.
 *
 *	params :
 *	uint8_t cm		value of the desired distance in cm
 */
 void go_forward_cm(uint8_t cm) {
-	left_motor_set_pos(0);
-	right_motor_set_pos(0);
-
-	left_motor_set_speed(GAME_SPEED);
-	right_motor_set_speed(GAME_SPEED);
-
-	while(abs(right_motor_get_pos()) <= (cm * NSTEP_ONE_TURN / WHEEL_PERIMETER)) {
-		chThdSleepMilliseconds(100);
-	}
-
-	left_motor_set_speed(0);
-	right_motor_set_speed(0);
+	motion_wait(motion_move(10 * cm));
 }
@@ -1,8 +1,10 @@
 #ifndef PROCESS_IMAGE_H
 #define PROCESS_IMAGE_H
 
+#include "telemetry.h"
 
-// Parameters for line detection with embedded camera
+// Parameters for line detection with embedded camera (MIN_LINE_WIDTH and GOAL_DIST_*
+// are the defaults of the parameters in tuning.c)
 #define IMAGE_BUFFER_SIZE		640
 #define WIDTH_SLOPE				5
 #define MIN_LINE_WIDTH			40
@@ -19,16 +21,26 @@
 // Setting used for the automatic return
 #define RETURN_LINE_DETECTION_DISTANCE		160		// in [mm]
 #define MINIMAL_TIME_RETURN					8000	// in [system ticks]
+#define RETURN_PERIOD						10		// Wall following period in [ms]
+#define WALL_GAIN_FRONT						3		// Speed decrease per unit of front proximity
+#define WALL_GAIN_DIAG						2		// Speed decrease per unit of diagonal proximity
+#define RETURN_REPLAY						TRUE	// Fast return along the recorded path
+#define RETURN_MAX_POINTS					64		// Max number of points of the fast return
+
+// Path from the end of the hallway to the start line
+#define RETURN_EXIT_DIST			7		// in [cm]
+#define RETURN_EXIT_TURN			77		// to the right, in [degrees]
+#define RETURN_START_DIST			28		// in [cm]
+#define RETURN_START_TURN			80		// to the right, in [degrees]
 
 
 void process_image_start(void);
-void detect_line(uint8_t *buffer);
+bool detect_line(uint8_t *buffer, uint16_t minLineWidth, telemetry_line_t *line);
 
 
 /*======================================================================================*/
 /* 								NEW FUNCTIONS DEFINED									*/
 /*======================================================================================*/
-bool verify_finish_line(void);
 void status_goal_detection(bool status);
 void return_to_start_line(void);
 void turn_right_degrees(uint8_t degrees);
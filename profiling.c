@@ -0,0 +1,174 @@
+/*
+  \file   	profiling.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Cycle count statistics of the hot paths, counters of the periodic tasks and
+  			latency and cost of the obstacle handling, reported over the USB serial
+*/
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "capture.h"
+#include "monitor.h"
+#include "periodic.h"
+#include "profiling.h"
+#include "proximity_sensors.h"
+
+
+static prof_stats_t stats[PROF_NB_SITES];
+
+static const char *siteNames[PROF_NB_SITES] = {
+	"audio_frame", "audio_fft", "audio_mag", "audio_voice", "steering",
+	"image", "prox_filter", "obstacle", "motion", "odometry",
+};
+
+
+// Thread sending the statistics of the measured sites, the counters of the periodic tasks
+// and the latency and cost of the obstacle handling in the capture streams
+static THD_WORKING_AREA(profiling_thd_wa, 512);
+static THD_FUNCTION(profiling_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	prof_stats_t current;
+	prof_report_t report;
+	periodic_stats_t taskStats;
+	periodic_report_t taskReport;
+	obst_latency_t latency;
+	obst_report_t obstReport;
+	uint32_t avoidLast, avoidMax;
+
+	while(1) {
+		chThdSleepMilliseconds(PROF_REPORT_PERIOD);
+
+		for(uint8_t i = 0; i < PROF_NB_SITES; i++) {
+			profiling_get_stats(i, &current);
+
+			if(current.count == 0) {
+				continue;
+			}
+
+			report.site = i;
+			report.bins = PROF_HIST_BINS;
+			report.mhz = STM32_SYSCLK / 1000000;
+			report.count = current.count;
+			report.min = current.min;
+			report.mean = current.sum / current.count;
+			report.max = current.max;
+			memcpy(report.hist, current.hist, sizeof(report.hist));
+
+			capture_send(CAPTURE_PROF, &report, sizeof(report));
+		}
+
+		// The tasks are never removed from the list
+		for(periodic_task_t *task = periodic_first(); task != NULL; task = task->next) {
+			periodic_get_stats(task, &taskStats);
+
+			memset(taskReport.name, 0, PERIODIC_NAME_LEN);
+			strncpy(taskReport.name, task->name, PERIODIC_NAME_LEN - 1);
+			taskReport.period = ST2US(task->period);
+			taskReport.cycles = taskStats.cycles;
+			taskReport.overruns = taskStats.overruns;
+			taskReport.missed = taskStats.missed;
+			taskReport.jitterMax = taskStats.jitterMax;
+			taskReport.jitterMean = taskStats.jitterMean;
+
+			capture_send(CAPTURE_PERIODIC, &taskReport, sizeof(taskReport));
+		}
+
+		get_obst_latency(&latency);
+		get_avoidance_cost(&avoidLast, &avoidMax);
+
+		if((latency.count > 0) || (avoidMax > 0)) {
+			obstReport.latencyLast = latency.last;
+			obstReport.latencyMax = latency.max;
+			obstReport.latencyMean = (latency.count > 0) ? latency.sum / latency.count : 0;
+			obstReport.stops = latency.count;
+			obstReport.avoidLast = avoidLast;
+			obstReport.avoidMax = avoidMax;
+			obstReport.mhz = STM32_SYSCLK / 1000000;
+
+			capture_send(CAPTURE_OBSTACLE, &obstReport, sizeof(obstReport));
+		}
+	}
+}
+
+
+/*
+*	Function to start the THREAD reporting the statistics.
+*/
+void profiling_start(void) {
+	profiling_reset();
+
+	monitor_thread_create(profiling_thd_wa, sizeof(profiling_thd_wa), LOWPRIO, profiling_thd, NULL);
+}
+
+
+/*
+*	Function adding a measure to the statistics of a site, called by PROF_STOP.
+*
+*	params :
+*	prof_site_t site		measured site
+*	uint32_t cycles			duration in cycles
+*/
+void profiling_record(prof_site_t site, uint32_t cycles) {
+	prof_stats_t *s = &stats[site];
+	uint8_t bin = (cycles > 1) ? (31 - __builtin_clz(cycles)) : 0;
+
+	if(bin >= PROF_HIST_BINS) {
+		bin = PROF_HIST_BINS - 1;
+	}
+
+	chSysLock();
+
+	if((s->count == 0) || (cycles < s->min)) {
+		s->min = cycles;
+	}
+
+	if(cycles > s->max) {
+		s->max = cycles;
+	}
+
+	s->count++;
+	s->sum += cycles;
+	s->hist[bin]++;
+
+	chSysUnlock();
+}
+
+
+/*
+*	Function to get a consistent copy of the statistics of a site.
+*
+*	params :
+*	prof_site_t site		measured site
+*	prof_stats_t *out		pointer to the structure to fill
+*/
+void profiling_get_stats(prof_site_t site, prof_stats_t *out) {
+	chSysLock();
+	*out = stats[site];
+	chSysUnlock();
+}
+
+
+/*
+*	Function to clear the statistics of every site.
+*/
+void profiling_reset(void) {
+	chSysLock();
+	memset(stats, 0, sizeof(stats));
+	chSysUnlock();
+}
+
+
+/*
+*	Function to get the name of a site.
+*/
+const char *profiling_site_name(prof_site_t site) {
+	return (site < PROF_NB_SITES) ? siteNames[site] : "?";
+}
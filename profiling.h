@@ -0,0 +1,70 @@
+#ifndef PROFILING_H
+#define PROFILING_H
+
+#include <stdint.h>
+
+
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED		TRUE	// FALSE removes every measure from the code
+#endif
+
+#define PROF_HIST_BINS			24		// Bin i counts the durations in [2^i, 2^(i+1)) cycles
+#define PROF_REPORT_PERIOD		1000	// Period of the reports on the USB serial in [ms]
+
+// Measured code sections
+typedef enum {
+	PROF_AUDIO_FRAME = 0,	// whole FFT frame of process_audio_data
+	PROF_AUDIO_FFT,			// the four FFTs
+	PROF_AUDIO_MAG,			// the four magnitudes
+	PROF_AUDIO_VOICE,		// average, voice calibration and sound_remote
+	PROF_STEERING,			// PID and avoidance of one steering period
+	PROF_IMAGE,				// detect_line
+	PROF_PROX_FILTER,		// calibration and filter of one proximity sample
+	PROF_OBSTACLE,			// obstacle detection of one proximity sample
+	PROF_MOTION,			// one cycle of the closed-loop motions
+	PROF_ODOMETRY,			// integration of the wheel positions
+	PROF_NB_SITES,
+} prof_site_t;
+
+// Statistics of a site in cycles of the core clock
+typedef struct {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[PROF_HIST_BINS];
+} prof_stats_t;
+
+// Report of a site sent in the CAPTURE_PROF stream
+typedef struct __attribute__((packed)) {
+	uint8_t site;			// prof_site_t
+	uint8_t bins;			// PROF_HIST_BINS
+	uint16_t mhz;			// core clock in [MHz]
+	uint32_t count;
+	uint32_t min;
+	uint32_t mean;
+	uint32_t max;
+	uint32_t hist[PROF_HIST_BINS];
+} prof_report_t;
+
+#if PROFILING_ENABLED
+// The cycle counter is the DWT CYCCNT on the Cortex-M4
+#define PROF_START(site)		rtcnt_t prof_start_##site = chSysGetRealtimeCounterX()
+#define PROF_STOP(site)			profiling_record(site, chSysGetRealtimeCounterX() - prof_start_##site)
+#else
+#define PROF_START(site)
+#define PROF_STOP(site)
+#endif
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void profiling_start(void);
+void profiling_record(prof_site_t site, uint32_t cycles);
+void profiling_get_stats(prof_site_t site, prof_stats_t *stats);
+void profiling_reset(void);
+const char *profiling_site_name(prof_site_t site);
+
+
+#endif /* PROFILING_H */
@@ -0,0 +1,148 @@
+/*
+  \file   	proximity_filter.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.1
+  \brief  	Calibration and filtering of the proximity sensors
+*/
+
+#include <stdbool.h>
+#include <arm_math.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "main.h"
+#include "monitor.h"
+#include "proximity_filter.h"
+#include "profiling.h"
+#include "trace.h"
+
+#include "sensors/proximity.h"
+
+
+// Baseline of each sensor (value without obstacle) and state of the filters
+static int32_t baseline[PROXIMITY_NB_CHANNELS] = {0};
+static int32_t filtered[PROXIMITY_NB_CHANNELS] = {0};
+static int32_t calibSum[PROXIMITY_NB_CHANNELS] = {0};
+static uint16_t calibCount = 0;
+static bool calibrated = FALSE;
+static bool measured = FALSE;			// a baseline was measured since the start
+
+// Topic on which the filtered values are published
+static MUTEX_DECL(prox_filtered_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(prox_filtered_condvar);
+static messagebus_topic_t prox_filtered_topic;
+static proximity_filtered_msg_t prox_filtered_value;
+
+static void proximity_filter_update(const unsigned int *delta, proximity_filtered_msg_t *msg);
+
+
+// Thread processing every sample of the "/proximity" topic
+static THD_WORKING_AREA(prox_filter_thd_wa, 512);
+static THD_FUNCTION(prox_filter_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	messagebus_topic_t *prox_topic = messagebus_find_topic_blocking(&bus, "/proximity");
+	proximity_msg_t proxValues;
+	proximity_filtered_msg_t msg;
+
+	while(1) {
+		messagebus_topic_wait(prox_topic, &proxValues, sizeof(proxValues));
+		trace_stamp(&msg.trace, TRACE_PROX_STOP);
+
+		PROF_START(PROF_PROX_FILTER);
+		proximity_filter_update(proxValues.delta, &msg);
+		PROF_STOP(PROF_PROX_FILTER);
+
+		if(calibrated) {
+			messagebus_topic_publish(&prox_filtered_topic, &msg, sizeof(msg));
+		}
+	}
+}
+
+
+/*
+*	Function to start the THREAD filtering the proximity sensors and to advertise the
+*	"/proximity_filtered" topic. The baseline is measured on the first samples, and again
+*	by the state machine before each voice calibration.
+*/
+void proximity_filter_start(void) {
+	messagebus_topic_init(&prox_filtered_topic, &prox_filtered_lock, &prox_filtered_condvar,
+							&prox_filtered_value, sizeof(prox_filtered_value));
+	messagebus_advertise_topic(&bus, &prox_filtered_topic, "/proximity_filtered");
+
+	monitor_thread_create(prox_filter_thd_wa, sizeof(prox_filter_thd_wa), NORMALPRIO + 1,
+						prox_filter_thd, NULL);
+}
+
+
+/*
+*	Function to measure again the baseline of the sensors on the next samples.
+*	The filtered values are not published during the calibration. A sensor keeps its
+*	previous baseline if the new one is more than PROX_CALIB_MAX_RISE above it: an
+*	obstacle stands in front of it, like a wall after the return.
+*/
+void proximity_filter_calibrate(void) {
+	chSysLock();
+	calibrated = FALSE;
+	calibCount = 0;
+
+	for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+		calibSum[i] = 0;
+	}
+
+	chSysUnlock();
+}
+
+
+/*
+*	Function to know if the baseline is measured and the filtered values published.
+*/
+bool proximity_filter_ready(void) {
+	return calibrated;
+}
+
+
+/*
+*	Calibration and filtering of the eight channels in one pass.
+*	The filter state keeps PROX_FILTER_FRAC fractional bits so that small
+*	variations are not lost by the shift.
+*/
+static void proximity_filter_update(const unsigned int *delta, proximity_filtered_msg_t *msg) {
+	int32_t value;
+
+	chSysLock();
+
+	if(!calibrated) {
+		for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+			calibSum[i] += delta[i];
+		}
+
+		if(++calibCount == PROX_CALIB_SAMPLES) {
+			for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+				value = calibSum[i] / PROX_CALIB_SAMPLES;
+
+				if(!measured || (value <= baseline[i] + PROX_CALIB_MAX_RISE)) {
+					baseline[i] = value;
+				}
+
+				filtered[i] = 0;
+			}
+
+			calibrated = TRUE;
+			measured = TRUE;
+		}
+	}
+
+	chSysUnlock();
+
+	for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+		value = ((int32_t)delta[i] - baseline[i]) << PROX_FILTER_FRAC;
+		filtered[i] += (value - filtered[i]) >> PROX_FILTER_SHIFT;
+
+		value = filtered[i] >> PROX_FILTER_FRAC;
+		msg->value[i] = (value > 0) ? value : 0;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef PROXIMITY_FILTER_H
+#define PROXIMITY_FILTER_H
+
+
+#include "sensors/proximity.h"
+
+#include "trace.h"
+
+#define PROX_CALIB_SAMPLES		32		// Samples averaged for the baseline of each sensor
+#define PROX_CALIB_MAX_RISE		100		// Rise of a baseline above the previous one taken as an obstacle
+#define PROX_FILTER_SHIFT		1		// IIR filter: y += (x - y) / 2^PROX_FILTER_SHIFT
+#define PROX_FILTER_FRAC		4		// Fractional bits of the filter state
+
+// Calibrated and filtered proximity values, published on the "/proximity_filtered" topic
+typedef struct {
+	int16_t value[PROXIMITY_NB_CHANNELS];	// delta minus the baseline of the sensor
+	trace_t trace;							// reception of the "/proximity" sample
+} proximity_filtered_msg_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void proximity_filter_start(void);
+void proximity_filter_calibrate(void);
+bool proximity_filter_ready(void);
+
+
+#endif /* PROXIMITY_FILTER_H */
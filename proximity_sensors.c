@@ -2,7 +2,7 @@
   \file   	proximity_sensors.c
   \author 	Antoine Duret & Carla Schmid (Group G08)
   \date   	16.05.2021
-  \version	3.0
+  \version	3.3
   \brief  	Code for obstacle avoidance with proximity sensors
 */
 
@@ -12,32 +12,102 @@
 #include "ch.h"
 #include "hal.h"
 
-#include "audio_processing.h"
+#include "game.h"
+#include "led_animation.h"
 #include "main.h"
+#include "monitor.h"
+#include "motor_arbiter.h"
+#include "motion.h"
+#include "odometry.h"
+#include "periodic.h"
 #include "process_image.h"
+#include "proximity_filter.h"
 #include "proximity_sensors.h"
+#include "profiling.h"
+#include "trace.h"
 
 #include "sensors/proximity.h"
-#include "leds.h"
 #include "motors.h"
 
-static bool obstacleDet = FALSE;
+static bool obstacleDet = FALSE;		// set by the game state machine
+static obst_mode_t obstMode = OBST_PENALTY;
 
-// Thread to detect if an obstacle is close to the IR Sensors in the front of the e-puck.
+// Per-sensor thresholds on the proximity delta. A threshold of 0 disables the sensor.
+// By default only the four sensors in the front of the e-puck are used.
+static uint16_t obstThreshold[PROXIMITY_NB_CHANNELS] = {MIN_DIST_OBST, MIN_DIST_OBST, 0, 0,
+														0, 0, MIN_DIST_OBST, MIN_DIST_OBST};
+static uint16_t obstHysteresis[PROXIMITY_NB_CHANNELS] = {OBST_HYSTERESIS, OBST_HYSTERESIS, 0, 0,
+														 0, 0, OBST_HYSTERESIS, OBST_HYSTERESIS};
+static bool obstArmed[PROXIMITY_NB_CHANNELS] = {TRUE, TRUE, TRUE, TRUE, TRUE, TRUE, TRUE, TRUE};
+
+// Latency measurement between the reception of a sample and the stop of the motors, and
+// trace of the sample from the "/proximity" topic
+static trace_t sampleTrace;
+static obst_latency_t obstLatency = {0};
+
+// Stop held till the state machine has left the race, then the penalty executed by the
+// motion engine (id of its last command)
+static bool safetyStop = FALSE;
+static bool penaltyRunning = FALSE;
+static uint32_t penaltyEnd = 0;
+
+// Instrumentation of the arrival of the samples
+static periodic_task_t obstacleTask;
+
+// Last sample used by the avoidance, and direction of each sensor (0 = front, positive
+// to the left) given by its cosine and sine
+static int16_t lastValue[PROXIMITY_NB_CHANNELS] = {0};
+static const float sensorCos[PROXIMITY_NB_CHANNELS] = { 0.956f,  0.656f,  0.000f, -0.866f,
+													   -0.866f,  0.000f,  0.656f,  0.956f};
+static const float sensorSin[PROXIMITY_NB_CHANNELS] = {-0.292f, -0.755f, -1.000f, -0.500f,
+														0.500f,  1.000f,  0.755f,  0.292f};
+
+// Cost of one call to obstacle_avoidance in [cycles], under the system lock
+static uint32_t avoidCostLast = 0;
+static uint32_t avoidCostMax = 0;
+
+static bool obstacle_in_range(const int16_t *value);
+static void obstacle_penalty_end(void);
+
+
+// Thread to detect if an obstacle is close to the IR Sensors of the e-puck.
+// Wakes up on every new sample published on the "/proximity_filtered" topic.
 static THD_WORKING_AREA(prox_sens_thd_wa, 512);
 static THD_FUNCTION(prox_sens_thd, arg) {
 	(void) arg;
     chRegSetThreadName(__FUNCTION__);
 
+    messagebus_topic_t *prox_topic = messagebus_find_topic_blocking(&bus, "/proximity_filtered");
+    proximity_filtered_msg_t proxValues;
+
+    periodic_init(&obstacleTask, "obstacle", OBST_SAMPLE_PERIOD);
+
     while(1) {
-    	if(obstacleDet) {
-    		if((get_prox(0) > MIN_DIST_OBST) || (get_prox(1) > MIN_DIST_OBST) ||
-    		   (get_prox(6) > MIN_DIST_OBST) || (get_prox(7) > MIN_DIST_OBST)) {
-    			obstacle_detection();
-    		}
+    	messagebus_topic_wait(prox_topic, &proxValues, sizeof(proxValues));
+    	sampleTrace = proxValues.trace;
+    	periodic_event(&obstacleTask);
+    	PROF_START(PROF_OBSTACLE);
+
+    	for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+    		lastValue[i] = proxValues.value[i];
+    	}
+
+    	if(safetyStop && (game_get_state() != GAME_RACE)) {
+    		safetyStop = FALSE;
+    		motor_arbiter_release(MOTOR_SRC_SAFETY);
+    	}
+
+    	if(penaltyRunning && motion_done(penaltyEnd)) {
+    		obstacle_penalty_end();
     	}
 
-    	chThdSleepMilliseconds(100);
+    	// The hysteresis state is tracked even when the detection is disabled, the sensors
+    	// are re-armed when it is enabled
+    	if(obstacle_in_range(proxValues.value) && obstacleDet && (obstMode == OBST_PENALTY)) {
+    		obstacle_detection();
+    	}
+
+    	PROF_STOP(PROF_OBSTACLE);
     }
 }
 
@@ -46,49 +116,227 @@ static THD_FUNCTION(prox_sens_thd, arg) {
 *	Function to start the THREAD controlling the obstacle detection.
 */
 void obstacle_det_start(void) {
-	chThdCreateStatic(prox_sens_thd_wa, sizeof(prox_sens_thd_wa), NORMALPRIO, prox_sens_thd, NULL);
+	monitor_thread_create(prox_sens_thd_wa, sizeof(prox_sens_thd_wa), NORMALPRIO, prox_sens_thd, NULL);
 }
 
 
 /*
 *	Function to control the e-puck when an obstacle was detected.
+*	The e-puck is stopped at once, the penalty is started by the state machine which also
+*	turns off the audio command / obstacle detection / goal detection.
 */
 void obstacle_detection(void) {
-	// Stop e-puck and turn off audio command / obstacle detection / goal detection
-	status_audio_command(FALSE);
-	left_motor_set_speed(0);
-	right_motor_set_speed(0);
-	status_goal_detection(FALSE);
-	obstacleDet = FALSE;
+	uint32_t latency;
+	rtcnt_t sampleStart = sampleTrace.start;
+
+	motor_arbiter_request_traced(MOTOR_SRC_SAFETY, 0, 0, &sampleTrace);
+	safetyStop = TRUE;
+
+	// Sample-to-stop latency, from the capture of the sample
+	latency = RTC2US(STM32_SYSCLK, chSysGetRealtimeCounterX() - sampleStart);
+
+	chSysLock();
+	obstLatency.last = latency;
+	obstLatency.sum += latency;
+	obstLatency.count++;
+
+	if(latency > obstLatency.max) {
+		obstLatency.max = latency;
+	}
+
+	chSysUnlock();
+
+	// Without the event the race goes on
+	if(!game_post(GAME_EV_OBSTACLE)) {
+		safetyStop = FALSE;
+		motor_arbiter_release(MOTOR_SRC_SAFETY);
+	}
+}
+
+
+/*
+*	Function called by the state machine when the penalty begins.
+*	The turn and the penalty are queued to the motion engine, this function does not block.
+*/
+void obstacle_penalty_start(void) {
+	pose_msg_t pose;
 
 	// Show 4 red LEDs to indicate that the minimal distance to objects were not kept
-	set_led(LED1,1);
-    set_led(LED3,1);
-    set_led(LED5,1);
-    set_led(LED7,1);
+	led_anim_set(LED_ANIM_RING, 1, 0);
 
     // Turn 180 in order to have a free path in front of robot
-    turn_left_degrees(180);
+    odometry_get_pose(&pose);
+    motion_goto_pose(pose.x, pose.y, pose.theta + PI);
 
     // Wait 2 seconds additionally as penalty
-    chThdSleepMilliseconds(2000);
+    penaltyEnd = motion_pause(OBST_PENALTY_TIME);
+    penaltyRunning = TRUE;
+}
+
+
+/*
+*	Function called by the proximity thread once the penalty is over.
+*/
+static void obstacle_penalty_end(void) {
+	penaltyRunning = FALSE;
 
     // Turn off LEDs to indicate that player can continue to play
-    set_led(LED1,0);
-    set_led(LED3,0);
-    set_led(LED5,0);
-    set_led(LED7,0);
-
-    // Turn on audio command
-    status_audio_command(TRUE);
-    status_goal_detection(TRUE);
-   	obstacleDet = TRUE;
+    led_anim_set(LED_ANIM_RING, 0, 0);
+
+    // The state machine turns on the audio command if the race goes on
+    game_post(GAME_EV_PENALTY_DONE);
 }
 
 
 /*
-*	Function to control the obstacle detection command.
+*	Function to control the obstacle detection command. The sensors are re-armed when
+*	it is turned on, an obstacle already in range is detected on the next sample.
 */
 void status_obst_detection(bool status) {
+	if(status && !obstacleDet) {
+		for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+			obstArmed[i] = TRUE;
+		}
+	}
+
 	obstacleDet = status;
 }
+
+
+/*
+*	Function to configure the obstacle detection of one proximity sensor.
+*
+*	params :
+*	uint8_t sensor			index of the proximity sensor (0 to 7)
+*	uint16_t threshold		delta value above which an obstacle is detected (0 disables the sensor)
+*	uint16_t hysteresis		decrease of the delta below the threshold needed to re-arm the sensor
+*/
+void set_obst_threshold(uint8_t sensor, uint16_t threshold, uint16_t hysteresis) {
+	if(sensor < PROXIMITY_NB_CHANNELS) {
+		obstThreshold[sensor] = threshold;
+		obstHysteresis[sensor] = (hysteresis < threshold) ? hysteresis : threshold;
+		obstArmed[sensor] = TRUE;
+	}
+}
+
+
+/*
+*	Function to get the sample-to-stop latency statistics of the obstacle detection.
+*
+*	params :
+*	obst_latency_t *latency		pointer to the structure to fill
+*/
+void get_obst_latency(obst_latency_t *latency) {
+	chSysLock();
+	*latency = obstLatency;
+	chSysUnlock();
+}
+
+
+/*
+*	Function to choose the rules applied when an obstacle is close.
+*
+*	params :
+*	obst_mode_t mode	OBST_PENALTY or OBST_AVOIDANCE
+*/
+void set_obst_mode(obst_mode_t mode) {
+	obstMode = mode;
+}
+
+
+/*
+*	Function to get the rules applied when an obstacle is close.
+*/
+obst_mode_t get_obst_mode(void) {
+	return obstMode;
+}
+
+
+/*
+*	Potential field avoidance: each proximity sensor pushes the e-puck away from its
+*	direction proportionally to its delta. The forward part of the force slows down
+*	(or backs up) the e-puck and the lateral part makes it turn. Called at the control
+*	rate by the steering with the speeds of the audio command.
+*
+*	params :
+*	int16_t *leftSpeed		speed of the left motor, corrected in place
+*	int16_t *rightSpeed		speed of the right motor, corrected in place
+*/
+void obstacle_avoidance(int16_t *leftSpeed, int16_t *rightSpeed) {
+	rtcnt_t start = chSysGetRealtimeCounterX();
+	uint32_t cost;
+	float forward = 0, lateral = 0, repulsion;
+	int32_t left, right;
+
+	for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+		if(lastValue[i] > AVOID_DELTA_MIN) {
+			repulsion = lastValue[i] - AVOID_DELTA_MIN;
+			forward -= repulsion * sensorCos[i];
+			lateral -= repulsion * sensorSin[i];
+		}
+	}
+
+	left = *leftSpeed + AVOID_GAIN_FORWARD * forward - AVOID_GAIN_TURN * lateral;
+	right = *rightSpeed + AVOID_GAIN_FORWARD * forward + AVOID_GAIN_TURN * lateral;
+
+	*leftSpeed = (left > MOTOR_SPEED_LIMIT) ? MOTOR_SPEED_LIMIT :
+				 ((left < -MOTOR_SPEED_LIMIT) ? -MOTOR_SPEED_LIMIT : left);
+	*rightSpeed = (right > MOTOR_SPEED_LIMIT) ? MOTOR_SPEED_LIMIT :
+				  ((right < -MOTOR_SPEED_LIMIT) ? -MOTOR_SPEED_LIMIT : right);
+
+	cost = chSysGetRealtimeCounterX() - start;
+
+	chSysLock();
+	avoidCostLast = cost;
+
+	if(cost > avoidCostMax) {
+		avoidCostMax = cost;
+	}
+
+	chSysUnlock();
+}
+
+
+/*
+*	Function to get the cost of the avoidance.
+*
+*	params :
+*	uint32_t *last		cost of the last call in cycles
+*	uint32_t *max		highest cost since the start in cycles
+*/
+void get_avoidance_cost(uint32_t *last, uint32_t *max) {
+	chSysLock();
+	*last = avoidCostLast;
+	*max = avoidCostMax;
+	chSysUnlock();
+}
+
+
+/*
+*	Function to check every sensor against its threshold with hysteresis.
+*	A sensor triggers once when its threshold is crossed and is re-armed when its value
+*	drops below (threshold - hysteresis).
+*
+*	params :
+*	const int16_t *value		filtered values of the eight proximity sensors
+*
+*	Returns TRUE if at least one armed sensor crossed its threshold.
+*/
+static bool obstacle_in_range(const int16_t *value) {
+	bool detected = FALSE;
+
+	for(uint8_t i = 0; i < PROXIMITY_NB_CHANNELS; i++) {
+		if(obstThreshold[i] == 0) {
+			continue;
+		}
+
+		if(obstArmed[i] && (value[i] > obstThreshold[i])) {
+			obstArmed[i] = FALSE;
+			detected = TRUE;
+		} else if(!obstArmed[i] && (value[i] < (obstThreshold[i] - obstHysteresis[i]))) {
+			obstArmed[i] = TRUE;
+		}
+	}
+
+	return detected;
+}
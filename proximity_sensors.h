@@ -3,11 +3,55 @@
 
 
 #define MIN_DIST_OBST		950			// Experimental value
+#define OBST_HYSTERESIS		150			// Drop below (threshold - hysteresis) needed to re-arm a sensor
+#define OBST_PENALTY_TIME	2000		// Penalty after a collision in [ms]
+#define OBST_SAMPLE_PERIOD	10			// Expected period of the proximity samples in [ms]
+
+// Potential field of the avoidance mode
+#define AVOID_DELTA_MIN		150			// Delta under which a sensor does not repulse
+#define AVOID_GAIN_FORWARD	0.4f		// Speed decrease per unit of delta in front in [steps/s]
+#define AVOID_GAIN_TURN		0.6f		// Turn speed per unit of lateral delta in [steps/s]
+
+// Rules applied when an obstacle is close
+typedef enum {
+	OBST_PENALTY = 0,		// Stop, turn 180 degrees and wait OBST_PENALTY_TIME
+	OBST_AVOIDANCE,			// Obstacles repulse the e-puck, blended into the audio command
+} obst_mode_t;
+
+// Sample-to-stop latency of the obstacle detection (in [us])
+typedef struct {
+	uint32_t last;
+	uint32_t max;
+	uint32_t sum;
+	uint32_t count;
+} obst_latency_t;
+
+// Report of the obstacle detection and avoidance sent in the CAPTURE_OBSTACLE stream
+typedef struct __attribute__((packed)) {
+	uint32_t latencyLast;	// sample-to-stop latency in [us]
+	uint32_t latencyMax;
+	uint32_t latencyMean;
+	uint32_t stops;			// stops measured
+	uint32_t avoidLast;		// cost of the last call to obstacle_avoidance in [cycles]
+	uint32_t avoidMax;
+	uint16_t mhz;			// core clock in [MHz]
+} obst_report_t;
 
 
 void obstacle_det_start(void);
 void obstacle_detection(void);
+void obstacle_penalty_start(void);
 void status_obst_detection(bool status);
 
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void set_obst_threshold(uint8_t sensor, uint16_t threshold, uint16_t hysteresis);
+void get_obst_latency(obst_latency_t *latency);
+void set_obst_mode(obst_mode_t mode);
+obst_mode_t get_obst_mode(void);
+void obstacle_avoidance(int16_t *leftSpeed, int16_t *rightSpeed);
+void get_avoidance_cost(uint32_t *last, uint32_t *max);
+
 
 #endif /* PROXIMITY_SENSORS_H */
@@ -0,0 +1,485 @@
+/*
+  \file   	run_log.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.1
+  \brief  	Append-only log of the runs in the on-chip flash, with the leaderboard of the
+  			best times and the export over the USB serial
+*/
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "capture.h"
+#include "game.h"
+#include "monitor.h"
+#include "run_log.h"
+
+#include "flash/flash.h"
+
+
+#ifndef RUN_LOG_ADDR
+// Sectors reserved for the log by run_log.ld
+extern uint8_t _run_log_start[];
+#define RUN_LOG_ADDR			((uintptr_t)_run_log_start)
+#endif
+
+typedef struct __attribute__((packed)) {
+	uint32_t magic;			// RUN_LOG_MAGIC
+	uint32_t generation;	// incremented at each change of sector, the highest one is in use
+} run_log_header_t;
+
+#define RUN_LOG_RECORDS		((RUN_LOG_SECTOR_SIZE - sizeof(run_log_header_t)) / sizeof(run_record_t))
+#define RUN_LOG_SECTOR(i)	((uint8_t *)(RUN_LOG_ADDR + (i) * RUN_LOG_SECTOR_SIZE))
+
+// Erasing a sector stalls the flash, so the code, for one or two seconds: it is only
+// done at boot, before the threads start. Programming a record stalls it for a few
+// tens of us: nothing is written during the race.
+#define RUN_LOG_BUSY_STATES	(GAME_IN(GAME_RACE) | GAME_IN(GAME_PENALTY))
+
+// Pool of records: free slots are kept in a mailbox, appended records in another one
+static run_record_t recordPool[RUN_LOG_QUEUE];
+static msg_t freeBuffer[RUN_LOG_QUEUE];
+static msg_t queueBuffer[RUN_LOG_QUEUE];
+static MAILBOX_DECL(run_log_free, freeBuffer, RUN_LOG_QUEUE);
+static MAILBOX_DECL(run_log_queue, queueBuffer, RUN_LOG_QUEUE);
+
+// Index of the sectors, only used by the writer thread. The records of the other sector
+// are the older ones, till it is erased to become the next sector in use.
+static uint8_t active = 0;
+static uint16_t used[2] = {0, 0};
+static bool spareBlank = FALSE;
+static uint32_t generation = 0;
+static uint32_t nextRun = 1;
+static bool exportRequested = FALSE;
+
+// Leaderboard and statistics, under the lock
+static run_best_t best[RUN_LOG_BEST];
+static uint8_t nbBest = 0;
+static run_log_stats_t stats;
+static MUTEX_DECL(run_log_lock); // @suppress("Field cannot be resolved")
+
+static void run_log_mount(void);
+static void run_log_index(void);
+static void run_log_erase_spare(void);
+static bool run_log_write(run_record_t *record);
+static void run_log_send_all(void);
+static void run_log_rank(const run_record_t *record);
+static void run_log_new_sector(uint8_t sector);
+static const run_record_t *run_log_slot(uint8_t sector, uint16_t i);
+static uint16_t run_log_used(uint8_t sector);
+static bool run_log_blank(uint8_t sector);
+static bool run_log_valid(const run_record_t *record);
+
+
+// Thread writing the records in the flash when the game allows it
+static THD_WORKING_AREA(run_log_thd_wa, 512);
+static THD_FUNCTION(run_log_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	msg_t msg;
+
+	while(1) {
+		if(chMBFetch(&run_log_queue, &msg, MS2ST(RUN_LOG_POLL)) == MSG_OK) {
+			// The record waits while the game is busy
+			while(GAME_IN(game_get_state()) & RUN_LOG_BUSY_STATES) {
+				chThdSleepMilliseconds(RUN_LOG_POLL);
+			}
+
+			// The log is full till the next boot erases a sector
+			if(!run_log_write((run_record_t *)msg)) {
+				chMtxLock(&run_log_lock);
+				stats.dropped++;
+				chMtxUnlock(&run_log_lock);
+			}
+
+			chMBPost(&run_log_free, msg, TIME_INFINITE);
+		}
+
+		if(exportRequested) {
+			exportRequested = FALSE;
+			run_log_send_all();
+		}
+	}
+}
+
+
+/*
+*	Function to read the log at boot: builds the index of the sectors and the
+*	leaderboard, and erases a sector if the log needs it. Erasing stalls the CPU for
+*	one or two seconds, so it must be called before the threads start. capture_init()
+*	must be called before.
+*/
+void run_log_init(void) {
+	run_log_mount();
+	run_log_erase_spare();
+}
+
+
+/*
+*	Function to start the THREAD of the log. run_log_init(), game_start() and
+*	capture_start() must be called before.
+*/
+void run_log_start(void) {
+	for(uint8_t i = 0; i < RUN_LOG_QUEUE; i++) {
+		chMBPost(&run_log_free, (msg_t)&recordPool[i], TIME_INFINITE);
+	}
+
+	monitor_thread_create(run_log_thd_wa, sizeof(run_log_thd_wa), LOWPRIO, run_log_thd, NULL);
+}
+
+
+/*
+*	Function to append a record to the log, it never blocks. The run number and the CRC
+*	are set by the log.
+*
+*	Returns FALSE if RUN_LOG_QUEUE records are already waiting and the record is lost.
+*
+*	params :
+*	const run_record_t *record		record of the run
+*/
+bool run_log_append(const run_record_t *record) {
+	msg_t msg;
+
+	if(chMBFetch(&run_log_free, &msg, TIME_IMMEDIATE) != MSG_OK) {
+		chMtxLock(&run_log_lock);
+		stats.dropped++;
+		chMtxUnlock(&run_log_lock);
+
+		return FALSE;
+	}
+
+	*(run_record_t *)msg = *record;
+
+	// Posting never blocks here since a free slot was taken
+	chMBPost(&run_log_queue, msg, TIME_INFINITE);
+
+	return TRUE;
+}
+
+
+/*
+*	Function to send all the records of the log in the CAPTURE_RUN stream, the thread
+*	sends them after the pending writes.
+*/
+void run_log_export(void) {
+	exportRequested = TRUE;
+}
+
+
+/*
+*	Function to get the best times of the log.
+*
+*	Returns the number of entries filled, the fastest first.
+*
+*	params :
+*	run_best_t *out			array to fill
+*	uint8_t size			entries of the array
+*/
+uint8_t run_log_get_best(run_best_t *out, uint8_t size) {
+	uint8_t n;
+
+	chMtxLock(&run_log_lock);
+
+	n = (size < nbBest) ? size : nbBest;
+
+	for(uint8_t i = 0; i < n; i++) {
+		out[i] = best[i];
+	}
+
+	chMtxUnlock(&run_log_lock);
+
+	return n;
+}
+
+
+/*
+*	Function to get a consistent copy of the statistics of the log.
+*
+*	params :
+*	run_log_stats_t *out	pointer to the structure to fill
+*/
+void run_log_get_stats(run_log_stats_t *out) {
+	chMtxLock(&run_log_lock);
+	*out = stats;
+	chMtxUnlock(&run_log_lock);
+}
+
+
+/*
+*	Finds the sector in use and the end of the records. The records of a sector are
+*	written from its start, so the end is found by a binary search.
+*/
+static void run_log_mount(void) {
+	const run_log_header_t *header[2];
+	bool valid[2];
+	uint8_t other;
+
+	for(uint8_t i = 0; i < 2; i++) {
+		header[i] = (const run_log_header_t *)RUN_LOG_SECTOR(i);
+		valid[i] = (header[i]->magic == RUN_LOG_MAGIC);
+	}
+
+	// New log, the game is not started yet
+	if(!valid[0] && !valid[1]) {
+		if(!run_log_blank(0)) {
+			flash_unlock();
+			flash_sector_erase(RUN_LOG_SECTOR(0));
+			flash_lock();
+		}
+
+		generation = 0;
+		run_log_new_sector(0);
+		valid[0] = TRUE;
+	}
+
+	if(valid[0] && valid[1]) {
+		active = (header[1]->generation > header[0]->generation) ? 1 : 0;
+	} else {
+		active = valid[0] ? 0 : 1;
+	}
+
+	other = 1 - active;
+	generation = header[active]->generation;
+	used[active] = run_log_used(active);
+
+	// The other sector holds the previous records if it was in use just before
+	if(valid[other] && (header[other]->generation + 1 == generation)) {
+		used[other] = run_log_used(other);
+	} else {
+		used[other] = 0;
+	}
+
+	spareBlank = run_log_blank(other);
+
+	run_log_index();
+}
+
+
+/*
+*	Builds the leaderboard and the statistics from the records of both sectors.
+*/
+static void run_log_index(void) {
+	uint8_t sector;
+	const run_record_t *record;
+
+	chMtxLock(&run_log_lock);
+
+	nbBest = 0;
+	stats.records = 0;
+	stats.corrupted = 0;
+	stats.generation = generation;
+
+	// Older sector first
+	for(uint8_t s = 0; s < 2; s++) {
+		sector = s ? active : (1 - active);
+
+		for(uint16_t i = 0; i < used[sector]; i++) {
+			record = run_log_slot(sector, i);
+
+			if(!run_log_valid(record)) {
+				stats.corrupted++;
+				continue;
+			}
+
+			stats.records++;
+			run_log_rank(record);
+
+			if(record->run >= nextRun) {
+				nextRun = record->run + 1;
+			}
+		}
+	}
+
+	chMtxUnlock(&run_log_lock);
+}
+
+
+/*
+*	Erases the other sector at boot, once the sector in use is almost full or if the
+*	other sector holds no records of the log.
+*/
+static void run_log_erase_spare(void) {
+	uint8_t other = 1 - active;
+
+	if(spareBlank) {
+		return;
+	}
+
+	if((used[other] == 0) || (used[active] + RUN_LOG_SPARE >= RUN_LOG_RECORDS)) {
+		flash_unlock();
+		flash_sector_erase(RUN_LOG_SECTOR(other));
+		flash_lock();
+
+		used[other] = 0;
+		spareBlank = TRUE;
+
+		// The oldest records are gone
+		run_log_index();
+	}
+}
+
+
+/*
+*	Programs a record at the end of the log, in the next sector if the sector in use
+*	is full.
+*
+*	Returns FALSE if the log is full till the next sector is erased at boot.
+*/
+static bool run_log_write(run_record_t *record) {
+	if(used[active] == RUN_LOG_RECORDS) {
+		if(!spareBlank) {
+			return FALSE;
+		}
+
+		active = 1 - active;
+		spareBlank = FALSE;
+		run_log_new_sector(active);
+		used[active] = 0;
+	}
+
+	record->run = nextRun++;
+	record->reserved = 0xFFFF;
+	record->crc = capture_crc16(CAPTURE_CRC_INIT, (const uint8_t *)record,
+								offsetof(run_record_t, crc));
+
+	flash_unlock();
+	flash_write((void *)run_log_slot(active, used[active]), record, sizeof(*record));
+	flash_lock();
+
+	used[active]++;
+
+	chMtxLock(&run_log_lock);
+
+	if(run_log_valid(run_log_slot(active, used[active] - 1))) {
+		stats.records++;
+		run_log_rank(record);
+	} else {
+		stats.corrupted++;
+	}
+
+	stats.generation = generation;
+
+	chMtxUnlock(&run_log_lock);
+
+	capture_send(CAPTURE_RUN, record, sizeof(*record));
+
+	return TRUE;
+}
+
+
+/*
+*	Sends the valid records of both sectors, older first, without filling the ring of
+*	the capture.
+*/
+static void run_log_send_all(void) {
+	uint8_t sector;
+	uint16_t sent = 0;
+	const run_record_t *record;
+
+	for(uint8_t s = 0; s < 2; s++) {
+		sector = s ? active : (1 - active);
+
+		for(uint16_t i = 0; i < used[sector]; i++) {
+			record = run_log_slot(sector, i);
+
+			if(!run_log_valid(record)) {
+				continue;
+			}
+
+			capture_send(CAPTURE_RUN, record, sizeof(*record));
+
+			if(++sent % RUN_LOG_EXPORT_BURST == 0) {
+				chThdSleepMilliseconds(1);
+			}
+		}
+	}
+}
+
+
+/*
+*	Inserts a record in the leaderboard if it is fast enough, the caller holds the lock.
+*	At equal times the older run stays ahead.
+*/
+static void run_log_rank(const run_record_t *record) {
+	uint8_t i;
+
+	if((nbBest == RUN_LOG_BEST) && (record->time >= best[RUN_LOG_BEST - 1].time)) {
+		return;
+	}
+
+	i = (nbBest < RUN_LOG_BEST) ? nbBest++ : (RUN_LOG_BEST - 1);
+
+	while((i > 0) && (best[i - 1].time > record->time)) {
+		best[i] = best[i - 1];
+		i--;
+	}
+
+	best[i].run = record->run;
+	best[i].time = record->time;
+	best[i].player = record->player;
+	best[i].players = record->players;
+}
+
+
+/*
+*	Programs the header of an erased sector, which then receives the records.
+*/
+static void run_log_new_sector(uint8_t sector) {
+	run_log_header_t header = {RUN_LOG_MAGIC, ++generation};
+
+	flash_unlock();
+	flash_write(RUN_LOG_SECTOR(sector), &header, sizeof(header));
+	flash_lock();
+}
+
+
+static const run_record_t *run_log_slot(uint8_t sector, uint16_t i) {
+	return (const run_record_t *)(RUN_LOG_SECTOR(sector) + sizeof(run_log_header_t)
+								  + i * sizeof(run_record_t));
+}
+
+
+/*
+*	Number of records of a sector: the run number of a slot stays erased till the slot
+*	is written.
+*/
+static uint16_t run_log_used(uint8_t sector) {
+	uint16_t low = 0, high = RUN_LOG_RECORDS;
+	uint16_t mid;
+
+	while(low < high) {
+		mid = (low + high) / 2;
+
+		if(run_log_slot(sector, mid)->run != 0xFFFFFFFF) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+
+static bool run_log_blank(uint8_t sector) {
+	const uint32_t *word = (const uint32_t *)RUN_LOG_SECTOR(sector);
+
+	for(uint32_t i = 0; i < RUN_LOG_SECTOR_SIZE / sizeof(uint32_t); i++) {
+		if(word[i] != 0xFFFFFFFF) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+
+static bool run_log_valid(const run_record_t *record) {
+	return capture_crc16(CAPTURE_CRC_INIT, (const uint8_t *)record,
+						 offsetof(run_record_t, crc)) == record->crc;
+}
@@ -0,0 +1,64 @@
+#ifndef RUN_LOG_H
+#define RUN_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define RUN_LOG_SECTOR_SIZE		(128 * 1024)	// Two sectors of the STM32F407 (run_log.ld), used in turn
+#define RUN_LOG_MAGIC			0x474F4C52		// "RLOG", first word of a sector in use
+#define RUN_LOG_QUEUE			4				// Records waiting for the writer thread
+#define RUN_LOG_SPARE			64				// Free records left when the next sector is erased
+#define RUN_LOG_BEST			8				// Entries of the leaderboard
+#define RUN_LOG_POLL			100				// Period of the checks of the game state in [ms]
+#define RUN_LOG_EXPORT_BURST	16				// Records sent on the USB serial per [ms]
+
+// Flags of a record
+#define RUN_LOG_TOURNAMENT		0x01
+#define RUN_LOG_AVOIDANCE		0x02
+
+/*
+*	Record of a run, appended to the log and sent in the CAPTURE_RUN stream. The fields
+*	are programmed in their order, a record with a wrong CRC was cut by a reset.
+*/
+typedef struct __attribute__((packed)) {
+	uint32_t run;			// number of the run since the log was created, set by the log
+	uint32_t time;			// race time in [ms], penalties included
+	uint16_t calibration;	// voice calibration in [ms]
+	uint16_t finishLatency;	// camera frame to finish transition in [us]
+	uint8_t player;			// 1 to players
+	uint8_t players;
+	uint8_t penalties;
+	uint8_t flags;			// RUN_LOG_TOURNAMENT, RUN_LOG_AVOIDANCE
+	uint16_t reserved;		// left erased (0xFFFF)
+	uint16_t crc;			// CRC-16 of the previous fields
+} run_record_t;
+
+// Entry of the leaderboard, sorted by time
+typedef struct {
+	uint32_t run;
+	uint32_t time;			// in [ms]
+	uint8_t player;
+	uint8_t players;
+} run_best_t;
+
+typedef struct {
+	uint32_t records;		// valid records in the log
+	uint32_t generation;	// sectors used since the log was created
+	uint32_t dropped;		// records lost with the queue or the log full
+	uint32_t corrupted;		// records cut by a reset
+} run_log_stats_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void run_log_init(void);
+void run_log_start(void);
+bool run_log_append(const run_record_t *record);
+void run_log_export(void);
+uint8_t run_log_get_best(run_best_t *best, uint8_t size);
+void run_log_get_stats(run_log_stats_t *stats);
+
+
+#endif /* RUN_LOG_H */
@@ -0,0 +1,146 @@
+/*
+  \file   	selector_input.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Debounced selector, the game waits for its changes instead of polling it
+*/
+
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "main.h"
+#include "monitor.h"
+#include "periodic.h"
+#include "selector_input.h"
+#include "tuning.h"
+
+#include "msgbus/messagebus.h"
+#include "selector.h"
+
+
+// Debounced position, only written by the selector thread
+static selector_msg_t current = {0, 0, 0};
+static MUTEX_DECL(selector_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(selector_condvar);
+
+static MUTEX_DECL(selector_topic_lock); // @suppress("Field cannot be resolved")
+static CONDVAR_DECL(selector_topic_condvar);
+static messagebus_topic_t selector_topic;
+static selector_msg_t selector_topic_value;
+
+static periodic_task_t selectorTask;
+
+
+// Thread sampling the selector. A new position is taken once it was read for the
+// stability time without interruption.
+static THD_WORKING_AREA(selector_thd_wa, 256);
+static THD_FUNCTION(selector_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	uint8_t position, candidate = current.position;
+	systime_t since = chVTGetSystemTime();
+	tuning_t tuning;
+	uint32_t tuningVersion = 0;
+
+	periodic_restart(&selectorTask);
+
+	while(1) {
+		periodic_wait(&selectorTask);
+		position = get_selector();
+		tuning_update(&tuning, &tuningVersion);
+
+		if(position != candidate) {
+			candidate = position;
+			since = chVTGetSystemTime();
+		}
+
+		if((candidate != current.position)
+			&& ((chVTGetSystemTime() - since) >= MS2ST(tuning.selectorStableTime))) {
+			chMtxLock(&selector_lock);
+			current.previous = current.position;
+			current.position = candidate;
+			current.time = chVTGetSystemTime();
+			chCondBroadcast(&selector_condvar);
+			chMtxUnlock(&selector_lock);
+
+			messagebus_topic_publish(&selector_topic, &current, sizeof(current));
+		}
+	}
+}
+
+
+/*
+*	Function to start the THREAD debouncing the selector and to advertise the
+*	"/selector" topic. The position at start is taken as it is.
+*/
+void selector_input_start(void) {
+	periodic_init(&selectorTask, "selector", SELECTOR_PERIOD);
+
+	messagebus_topic_init(&selector_topic, &selector_topic_lock, &selector_topic_condvar,
+						  &selector_topic_value, sizeof(selector_topic_value));
+	messagebus_advertise_topic(&bus, &selector_topic, "/selector");
+
+	current.position = get_selector();
+	current.previous = current.position;
+	current.time = chVTGetSystemTime();
+	messagebus_topic_publish(&selector_topic, &current, sizeof(current));
+
+	monitor_thread_create(selector_thd_wa, sizeof(selector_thd_wa), NORMALPRIO, selector_thd, NULL);
+}
+
+
+/*
+*	Function to get the debounced position of the selector.
+*/
+uint8_t selector_input_get(void) {
+	return current.position;
+}
+
+
+/*
+*	Function to wait till the debounced position differs from a given one.
+*
+*	Returns FALSE on timeout.
+*
+*	params :
+*	uint8_t *position		position known by the caller, updated with the new one
+*	systime_t timeout		max wait in system ticks, or TIME_INFINITE
+*/
+bool selector_input_wait_change(uint8_t *position, systime_t timeout) {
+	msg_t msg = MSG_OK;
+
+	chMtxLock(&selector_lock);
+
+	while((current.position == *position) && (msg != MSG_TIMEOUT)) {
+		msg = chCondWaitTimeout(&selector_condvar, timeout);
+	}
+
+	// chCondWaitTimeout doesn't take the mutex back on timeout
+	if(msg != MSG_TIMEOUT) {
+		*position = current.position;
+		chMtxUnlock(&selector_lock);
+	}
+
+	return msg != MSG_TIMEOUT;
+}
+
+
+/*
+*	Function to wait till the selector is on a given position.
+*
+*	params :
+*	uint8_t position		position to wait for
+*/
+void selector_input_wait(uint8_t position) {
+	chMtxLock(&selector_lock);
+
+	while(current.position != position) {
+		chCondWait(&selector_condvar);
+	}
+
+	chMtxUnlock(&selector_lock);
+}
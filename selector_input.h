@@ -0,0 +1,30 @@
+#ifndef SELECTOR_INPUT_H
+#define SELECTOR_INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ch.h"
+
+
+#define SELECTOR_PERIOD			10		// Sampling period of the selector in [ms]
+#define SELECTOR_STABLE_TIME	50		// Time a new position is held before it is taken in [ms]
+
+// Debounced position of the selector, published on the "/selector" topic on every change
+typedef struct {
+	uint8_t position;
+	uint8_t previous;
+	systime_t time;			// of the change
+} selector_msg_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void selector_input_start(void);
+uint8_t selector_input_get(void);
+bool selector_input_wait_change(uint8_t *position, systime_t timeout);
+void selector_input_wait(uint8_t position);
+
+
+#endif /* SELECTOR_INPUT_H */
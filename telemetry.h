@@ -0,0 +1,33 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+
+/*
+*	Internals of the control loops sent over the capture link (see capture.h), to tune
+*	the PID and the thresholds from a recording. All fields are little-endian.
+*/
+
+// Audio steering, sent in the CAPTURE_STEERING stream for each new peak
+typedef struct __attribute__((packed)) {
+	int16_t peak;			// index of the peak, -1 if none was found
+	uint8_t midFreq;		// calibrated frequency index
+	int16_t error;			// peak - midFreq
+	int32_t sumError;		// integral term after the ARW
+	int16_t derivError;		// derivative term
+	float speed;			// output of the PID in [steps/s]
+	int16_t leftSpeed;		// motor commands in [steps/s]
+	int16_t rightSpeed;
+} telemetry_steering_t;
+
+// Line detection, sent in the CAPTURE_LINE stream for each image
+typedef struct __attribute__((packed)) {
+	uint8_t counterLines;	// lines found in the row
+	uint8_t mean;			// mean intensity of the row
+	uint8_t linesFound;		// counterLines >= MIN_GOAL_LINES
+	uint16_t tofDist;		// ToF distance in [mm]
+} telemetry_line_t;
+
+
+#endif /* TELEMETRY_H */
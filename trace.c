@@ -0,0 +1,191 @@
+/*
+  \file   	trace.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Latency from the capture of a sample to the motor command or game event it
+  			causes, reported over the USB serial
+*/
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "capture.h"
+#include "monitor.h"
+#include "trace.h"
+
+
+static trace_stats_t stats[TRACE_NB_PATHS];
+static uint32_t lastId = 0;
+
+static const char *pathNames[TRACE_NB_PATHS] = {
+	"mic_motor", "cam_finish", "prox_stop",
+};
+
+
+// Thread sending the statistics of the traced paths in the capture stream
+static THD_WORKING_AREA(trace_thd_wa, 512);
+static THD_FUNCTION(trace_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	trace_stats_t current;
+	trace_report_t report;
+
+	while(1) {
+		chThdSleepMilliseconds(TRACE_REPORT_PERIOD);
+
+		for(uint8_t i = 0; i < TRACE_NB_PATHS; i++) {
+			trace_get_stats(i, &current);
+
+			if((current.count == 0) && (current.dropped == 0)) {
+				continue;
+			}
+
+			report.path = i;
+			report.bins = TRACE_HIST_BINS;
+			report.reserved = 0;
+			report.count = current.count;
+			report.dropped = current.dropped;
+			report.min = current.min;
+			report.mean = current.count ? (current.sum / current.count) : 0;
+			report.max = current.max;
+			memcpy(report.hist, current.hist, sizeof(report.hist));
+
+			capture_send(CAPTURE_TRACE, &report, sizeof(report));
+		}
+	}
+}
+
+
+/*
+*	Function to start the THREAD reporting the latencies.
+*/
+void trace_start(void) {
+	trace_reset();
+
+	monitor_thread_create(trace_thd_wa, sizeof(trace_thd_wa), LOWPRIO, trace_thd, NULL);
+}
+
+
+/*
+*	Function to stamp a sample at its capture, the trace is then copied along with
+*	the data derived from the sample.
+*
+*	params :
+*	trace_t *trace			trace of the sample
+*	trace_path_t path		path measured till trace_end
+*/
+void trace_stamp(trace_t *trace, trace_path_t path) {
+#if TRACING_ENABLED
+	chSysLock();
+	// 0 is kept for no trace when the counter wraps
+	lastId = (lastId + 1) ? (lastId + 1) : 1;
+	trace->id = lastId;
+	chSysUnlock();
+#else
+	trace->id = 0;
+#endif
+	// Also kept without tracing, the proximity stop measures its latency with it
+	trace->start = chSysGetRealtimeCounterX();
+	trace->path = path;
+}
+
+
+/*
+*	Function to record the latency of a trace when its path ends, the trace is cleared.
+*	Nothing is done for a cleared trace.
+*
+*	params :
+*	trace_t *trace			trace of the sample
+*/
+void trace_end(trace_t *trace) {
+	uint32_t latency;
+	trace_stats_t *s;
+	uint8_t bin;
+
+	if((trace->id == 0) || (trace->path >= TRACE_NB_PATHS)) {
+		return;
+	}
+
+	latency = RTC2US(STM32_SYSCLK, chSysGetRealtimeCounterX() - trace->start);
+	bin = (latency > 1) ? (31 - __builtin_clz(latency)) : 0;
+	s = &stats[trace->path];
+	trace->id = 0;
+
+	if(bin >= TRACE_HIST_BINS) {
+		bin = TRACE_HIST_BINS - 1;
+	}
+
+	chSysLock();
+
+	if((s->count == 0) || (latency < s->min)) {
+		s->min = latency;
+	}
+
+	if(latency > s->max) {
+		s->max = latency;
+	}
+
+	s->count++;
+	s->last = latency;
+	s->sum += latency;
+	s->hist[bin]++;
+
+	chSysUnlock();
+}
+
+
+/*
+*	Function to count a trace which will not reach the end of its path, e.g. a peak
+*	replaced by the next one before the steering used it. The trace is cleared.
+*
+*	params :
+*	trace_t *trace			trace of the sample
+*/
+void trace_drop(trace_t *trace) {
+	if((trace->id == 0) || (trace->path >= TRACE_NB_PATHS)) {
+		return;
+	}
+
+	trace->id = 0;
+
+	chSysLock();
+	stats[trace->path].dropped++;
+	chSysUnlock();
+}
+
+
+/*
+*	Function to get a consistent copy of the statistics of a path.
+*
+*	params :
+*	trace_path_t path		traced path
+*	trace_stats_t *out		pointer to the structure to fill
+*/
+void trace_get_stats(trace_path_t path, trace_stats_t *out) {
+	chSysLock();
+	*out = stats[path];
+	chSysUnlock();
+}
+
+
+/*
+*	Function to clear the statistics of every path.
+*/
+void trace_reset(void) {
+	chSysLock();
+	memset(stats, 0, sizeof(stats));
+	chSysUnlock();
+}
+
+
+/*
+*	Function to get the name of a path.
+*/
+const char *trace_path_name(trace_path_t path) {
+	return (path < TRACE_NB_PATHS) ? pathNames[path] : "?";
+}
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "ch.h"
+
+
+#ifndef TRACING_ENABLED
+#define TRACING_ENABLED			TRUE	// FALSE stamps no sample, nothing is recorded
+#endif
+
+#define TRACE_HIST_BINS			20		// Bin i counts the latencies in [2^i, 2^(i+1)) us
+#define TRACE_REPORT_PERIOD		1000	// Period of the reports on the USB serial in [ms]
+
+// Traced paths, from the capture of a sample to the event it causes
+typedef enum {
+	TRACE_MIC_MOTOR = 0,	// mic block completing an FFT frame -> steering applied to the motors
+	TRACE_CAM_FINISH,		// camera frame -> transition to GAME_FINISHED
+	TRACE_PROX_STOP,		// proximity sample -> safety stop applied to the motors
+	TRACE_NB_PATHS,
+} trace_path_t;
+
+// Stamp of a sample, carried along with the data derived from it. An id of 0 is no trace.
+typedef struct {
+	uint32_t id;			// sequence number of the sample, unique over all the paths
+	rtcnt_t start;			// realtime counter at the capture
+	uint8_t path;			// trace_path_t
+} trace_t;
+
+// Latencies of a path in [us]
+typedef struct {
+	uint32_t count;
+	uint32_t dropped;		// traces superseded or lost before the end of the path
+	uint32_t min;
+	uint32_t max;
+	uint32_t last;
+	uint64_t sum;
+	uint32_t hist[TRACE_HIST_BINS];
+} trace_stats_t;
+
+// Report of a path sent in the CAPTURE_TRACE stream
+typedef struct __attribute__((packed)) {
+	uint8_t path;			// trace_path_t
+	uint8_t bins;			// TRACE_HIST_BINS
+	uint16_t reserved;
+	uint32_t count;
+	uint32_t dropped;
+	uint32_t min;
+	uint32_t mean;
+	uint32_t max;
+	uint32_t hist[TRACE_HIST_BINS];
+} trace_report_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void trace_start(void);
+void trace_stamp(trace_t *trace, trace_path_t path);
+void trace_end(trace_t *trace);
+void trace_drop(trace_t *trace);
+void trace_get_stats(trace_path_t path, trace_stats_t *stats);
+void trace_reset(void);
+const char *trace_path_name(trace_path_t path);
+
+
+#endif /* TRACE_H */
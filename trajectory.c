@@ -0,0 +1,233 @@
+/*
+  \file   	trajectory.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.0
+  \brief  	Recording of the path of a game and planning of the fast return to the start
+*/
+
+#include <stdbool.h>
+#include <math.h>
+#include <arm_math.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "main.h"
+#include "monitor.h"
+#include "odometry.h"
+#include "periodic.h"
+#include "trajectory.h"
+
+
+// Ring of records, the anchor is the pose before the oldest record
+static MUTEX_DECL(traj_lock); // @suppress("Field cannot be resolved")
+static traj_record_t ring[TRAJ_RING_SIZE];
+static uint16_t head = 0;
+static uint16_t count = 0;
+static bool overflow = FALSE;
+static traj_point_t anchor = {0};
+static traj_point_t decoded = {0};
+
+// Recording status and last motor command
+static bool recording = FALSE;
+static int16_t leftCmd = 0;
+static int16_t rightCmd = 0;
+
+static periodic_task_t trajectoryTask;
+
+static void trajectory_append(const pose_msg_t *pose);
+static int8_t trajectory_quantize(float value);
+static float trajectory_deviation(const traj_point_t *p, const traj_point_t *a,
+									const traj_point_t *b);
+
+
+// Thread recording the odometry while the game is running
+static THD_WORKING_AREA(trajectory_thd_wa, 256);
+static THD_FUNCTION(trajectory_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	pose_msg_t pose;
+
+	periodic_init(&trajectoryTask, "trajectory", TRAJ_PERIOD);
+
+	while(1) {
+		if(recording) {
+			odometry_get_pose(&pose);
+
+			chMtxLock(&traj_lock);
+			trajectory_append(&pose);
+			chMtxUnlock(&traj_lock);
+		}
+
+		periodic_wait(&trajectoryTask);
+	}
+}
+
+
+/*
+*	Function to start the THREAD recording the trajectory.
+*/
+void trajectory_start(void) {
+	monitor_thread_create(trajectory_thd_wa, sizeof(trajectory_thd_wa), NORMALPRIO, trajectory_thd, NULL);
+}
+
+
+/*
+*	Function to control the recording. A new recording starts from the current pose.
+*
+*	params :
+*	bool status		status value TRUE or FALSE
+*/
+void trajectory_record(bool status) {
+	pose_msg_t pose;
+
+	chMtxLock(&traj_lock);
+
+	if(status && !recording) {
+		odometry_get_pose(&pose);
+		anchor.x = pose.x;
+		anchor.y = pose.y;
+		anchor.theta = pose.theta;
+		decoded = anchor;
+		head = 0;
+		count = 0;
+		overflow = FALSE;
+	}
+
+	recording = status;
+	chMtxUnlock(&traj_lock);
+}
+
+
+/*
+*	Function to give the last motor command to the recorder.
+*
+*	params :
+*	int16_t leftSpeed		speed of the left motor in steps/s
+*	int16_t rightSpeed		speed of the right motor in steps/s
+*/
+void trajectory_command(int16_t leftSpeed, int16_t rightSpeed) {
+	leftCmd = leftSpeed;
+	rightCmd = rightSpeed;
+}
+
+
+/*
+*	Route planner for the fast return. The recorded path is followed backwards and
+*	simplified in one pass: a point is only kept when the path leaves the line going
+*	through the previous kept point by more than TRAJ_TOLERANCE.
+*
+*	params :
+*	traj_point_t *route		array filled with the points to reach, the last one is the
+*							start pose of the recording
+*	uint16_t maxPoints		size of the array
+*
+*	Returns the number of points, 0 if the recording is not complete or the route too long.
+*/
+uint16_t trajectory_plan_return(traj_point_t *route, uint16_t maxPoints) {
+	traj_point_t point, previous, last, direction = {0};
+	const traj_record_t *record;
+	uint16_t nbPoints = 0;
+	bool hasDirection = FALSE;
+
+	chMtxLock(&traj_lock);
+
+	if(overflow || (count == 0) || (maxPoints == 0)) {
+		chMtxUnlock(&traj_lock);
+		return 0;
+	}
+
+	point = decoded;
+	previous = decoded;
+	last = decoded;
+
+	for(int32_t k = count - 1; k >= 0; k--) {
+		// Position before the record k
+		record = &ring[(head + k) % TRAJ_RING_SIZE];
+		point.x -= record->dx / TRAJ_POS_SCALE;
+		point.y -= record->dy / TRAJ_POS_SCALE;
+
+		if(!hasDirection) {
+			direction = point;
+			hasDirection = (hypotf(point.x - last.x, point.y - last.y) > TRAJ_TOLERANCE);
+		} else if(trajectory_deviation(&point, &last, &direction) > TRAJ_TOLERANCE) {
+			if(nbPoints == maxPoints - 1) {
+				chMtxUnlock(&traj_lock);
+				return 0;
+			}
+
+			route[nbPoints++] = previous;
+			last = previous;
+			direction = point;
+			hasDirection = (hypotf(point.x - last.x, point.y - last.y) > TRAJ_TOLERANCE);
+		}
+
+		previous = point;
+	}
+
+	route[nbPoints++] = anchor;
+
+	chMtxUnlock(&traj_lock);
+
+	return nbPoints;
+}
+
+
+/*
+*	Delta-encoding of the pose in the ring. When the ring is full the oldest record
+*	is merged into the anchor.
+*/
+static void trajectory_append(const pose_msg_t *pose) {
+	traj_record_t *record;
+
+	if(count == TRAJ_RING_SIZE) {
+		anchor.x += ring[head].dx / TRAJ_POS_SCALE;
+		anchor.y += ring[head].dy / TRAJ_POS_SCALE;
+		anchor.theta = odometry_wrap_angle(anchor.theta + ring[head].dtheta / TRAJ_ANGLE_SCALE);
+		head = (head + 1) % TRAJ_RING_SIZE;
+		count--;
+		overflow = TRUE;
+	}
+
+	record = &ring[(head + count) % TRAJ_RING_SIZE];
+	record->dx = trajectory_quantize((pose->x - decoded.x) * TRAJ_POS_SCALE);
+	record->dy = trajectory_quantize((pose->y - decoded.y) * TRAJ_POS_SCALE);
+	record->dtheta = trajectory_quantize(odometry_wrap_angle(pose->theta - decoded.theta)
+											* TRAJ_ANGLE_SCALE);
+	record->left = trajectory_quantize((float)leftCmd / TRAJ_SPEED_SCALE);
+	record->right = trajectory_quantize((float)rightCmd / TRAJ_SPEED_SCALE);
+	count++;
+
+	decoded.x += record->dx / TRAJ_POS_SCALE;
+	decoded.y += record->dy / TRAJ_POS_SCALE;
+	decoded.theta = odometry_wrap_angle(decoded.theta + record->dtheta / TRAJ_ANGLE_SCALE);
+}
+
+
+/*
+*	Rounding and saturation of a value on 8 bits.
+*/
+static int8_t trajectory_quantize(float value) {
+	value = roundf(value);
+
+	if(value > INT8_MAX) {
+		return INT8_MAX;
+	} else if(value < INT8_MIN) {
+		return INT8_MIN;
+	}
+
+	return (int8_t)value;
+}
+
+
+/*
+*	Distance in cm from the point p to the line going through a and b (a != b).
+*/
+static float trajectory_deviation(const traj_point_t *p, const traj_point_t *a,
+									const traj_point_t *b) {
+	float abx = b->x - a->x, aby = b->y - a->y;
+
+	return fabsf(abx * (p->y - a->y) - aby * (p->x - a->x)) / hypotf(abx, aby);
+}
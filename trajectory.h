@@ -0,0 +1,38 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+
+#define TRAJ_PERIOD				100		// Recording period in [ms]
+#define TRAJ_RING_SIZE			1024	// Number of records (TRAJ_RING_SIZE*TRAJ_PERIOD ms of game)
+#define TRAJ_POS_SCALE			10.0f	// Position resolution: 1/TRAJ_POS_SCALE [cm] (1 mm)
+#define TRAJ_ANGLE_SCALE		256.0f	// Heading resolution: 1/TRAJ_ANGLE_SCALE [rad]
+#define TRAJ_SPEED_SCALE		10		// Motor command resolution in [steps/s]
+#define TRAJ_TOLERANCE			1.0f	// Max distance between the path and the planned route in [cm]
+
+// One record: displacement since the previous record and last motor command.
+// The deltas are taken against the decoded pose so the rounding errors do not add up.
+typedef struct __attribute__((packed)) {
+	int8_t dx;
+	int8_t dy;
+	int8_t dtheta;
+	int8_t left;
+	int8_t right;
+} traj_record_t;
+
+typedef struct {
+	float x;				// in [cm]
+	float y;				// in [cm]
+	float theta;			// in [rad]
+} traj_point_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void trajectory_start(void);
+void trajectory_record(bool status);
+void trajectory_command(int16_t leftSpeed, int16_t rightSpeed);
+uint16_t trajectory_plan_return(traj_point_t *route, uint16_t maxPoints);
+
+
+#endif /* TRAJECTORY_H */
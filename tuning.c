@@ -0,0 +1,430 @@
+/*
+  \file   	tuning.c
+  \author 	Antoine Duret & Carla Schmid (Group G08)
+  \date   	16.05.2021
+  \version	1.1
+  \brief  	Gains and thresholds declared in the parameter tree and set at runtime with
+  			commands on the USB serial
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include <usbcfg.h>
+
+#include "audio_processing.h"
+#include "capture.h"
+#include "main.h"
+#include "monitor.h"
+#include "process_image.h"
+#include "proximity_sensors.h"
+#include "run_log.h"
+#include "selector_input.h"
+#include "tuning.h"
+
+#include "parameter/parameter.h"
+
+
+typedef enum {
+	TUNING_KP = 0,
+	TUNING_KI,
+	TUNING_KD,
+	TUNING_GAME_SPEED,
+	TUNING_MIN_VALUE_THRESHOLD,
+	TUNING_MIN_DIST_OBST,
+	TUNING_GOAL_DIST_MIN,
+	TUNING_GOAL_DIST_MAX,
+	TUNING_MIN_LINE_WIDTH,
+	TUNING_SELECTOR_STABLE,
+	TUNING_TOURNAMENT,
+	TUNING_AVOIDANCE,
+	TUNING_NB_PARAMS,
+} tuning_param_name_t;
+
+typedef struct {
+	parameter_t param;
+	const char *id;
+	bool integer;
+	float def;
+	float min;
+	float max;
+} tuning_param_t;
+
+#define TUNING_DEFAULTS		{KP, KI, KD, MAX_SUM_ERROR, GAME_SPEED, MIN_VALUE_THRESHOLD,	\
+							 MIN_DIST_OBST, GOAL_DIST_MIN, GOAL_DIST_MAX, MIN_LINE_WIDTH,		\
+							 SELECTOR_STABLE_TIME, TOURNAMENT_MODE, OBST_PENALTY}
+
+static parameter_namespace_t tuning_ns;
+static tuning_param_t params[TUNING_NB_PARAMS] = {
+	[TUNING_KP] = 					{.id = "kp", .def = KP, .max = 10000},
+	[TUNING_KI] = 					{.id = "ki", .def = KI, .min = 0.01f, .max = 1000},
+	[TUNING_KD] = 					{.id = "kd", .def = KD, .max = 10000},
+	[TUNING_GAME_SPEED] = 			{.id = "game_speed", .integer = TRUE, .def = GAME_SPEED,
+									 .max = GAME_SPEED},
+	[TUNING_MIN_VALUE_THRESHOLD] = 	{.id = "min_value", .integer = TRUE, .def = MIN_VALUE_THRESHOLD,
+									 .max = UINT16_MAX},
+	[TUNING_MIN_DIST_OBST] = 		{.id = "min_dist_obst", .integer = TRUE, .def = MIN_DIST_OBST,
+									 .min = OBST_HYSTERESIS, .max = 4095},
+	[TUNING_GOAL_DIST_MIN] = 		{.id = "goal_dist_min", .integer = TRUE, .def = GOAL_DIST_MIN,
+									 .max = 2000},
+	[TUNING_GOAL_DIST_MAX] = 		{.id = "goal_dist_max", .integer = TRUE, .def = GOAL_DIST_MAX,
+									 .max = 2000},
+	[TUNING_MIN_LINE_WIDTH] = 		{.id = "min_line_width", .integer = TRUE, .def = MIN_LINE_WIDTH,
+									 .max = IMAGE_BUFFER_SIZE},
+	[TUNING_SELECTOR_STABLE] = 		{.id = "selector_stable", .integer = TRUE,
+									 .def = SELECTOR_STABLE_TIME, .max = 1000},
+	[TUNING_TOURNAMENT] = 			{.id = "tournament", .integer = TRUE, .def = TOURNAMENT_MODE,
+									 .max = 1},
+	[TUNING_AVOIDANCE] = 			{.id = "avoidance", .integer = TRUE, .def = OBST_PENALTY,
+									 .max = OBST_AVOIDANCE},
+};
+
+// Values copied by the loops under the system lock, rebuilt under the mutex. The version
+// changes with them, 0 is never used so that a loop copies them the first time.
+static tuning_t values = TUNING_DEFAULTS;
+static uint32_t version = 1;
+static MUTEX_DECL(tuning_lock); // @suppress("Field cannot be resolved")
+
+static bool tuning_refresh(void);
+static bool tuning_parse(const char *text, float *value);
+static void tuning_report(uint8_t i);
+static void tuning_command(char *line);
+
+
+// Thread reading the commands on the USB serial
+static THD_WORKING_AREA(tuning_thd_wa, 512);
+static THD_FUNCTION(tuning_thd, arg) {
+	(void) arg;
+	chRegSetThreadName(__FUNCTION__);
+
+	char line[TUNING_LINE_LEN];
+	uint8_t len = 0;
+	msg_t c;
+
+	// Initial values in the recording
+	for(uint8_t i = 0; i < TUNING_NB_PARAMS; i++) {
+		tuning_report(i);
+	}
+
+	while(1) {
+		c = chnGetTimeout(&SDU1, MS2ST(TUNING_READ_TIMEOUT));
+
+		if(c == MSG_TIMEOUT) {
+			continue;
+		} else if(c < 0) {
+			// USB not connected
+			chThdSleepMilliseconds(TUNING_READ_TIMEOUT);
+			continue;
+		}
+
+		if((c == '\n') || (c == '\r')) {
+			line[len] = '\0';
+
+			if(len > 0) {
+				tuning_command(line);
+			}
+
+			len = 0;
+		} else if(len < TUNING_LINE_LEN - 1) {
+			line[len++] = c;
+		}
+	}
+}
+
+
+/*
+*	Function to declare the parameters in the tree and start the THREAD reading the
+*	commands. usb_start() must be called before.
+*/
+void tuning_start(void) {
+	parameter_namespace_declare(&tuning_ns, &parameter_root, "tuning");
+
+	for(uint8_t i = 0; i < TUNING_NB_PARAMS; i++) {
+		if(params[i].integer) {
+			parameter_integer_declare_with_default(&params[i].param, &tuning_ns, params[i].id,
+												   params[i].def);
+		} else {
+			parameter_scalar_declare_with_default(&params[i].param, &tuning_ns, params[i].id,
+												  params[i].def);
+		}
+	}
+
+	monitor_thread_create(tuning_thd_wa, sizeof(tuning_thd_wa), LOWPRIO, tuning_thd, NULL);
+}
+
+
+/*
+*	Function to get a consistent copy of the values of the parameters.
+*
+*	params :
+*	tuning_t *out		pointer to the structure to fill
+*/
+void tuning_get(tuning_t *out) {
+	chSysLock();
+	*out = values;
+	chSysUnlock();
+}
+
+
+/*
+*	Function for the loops keeping their own copy of the values: the values are only
+*	copied if they changed since the last copy. The loops call it once per iteration.
+*
+*	params :
+*	tuning_t *out			copy of the loop
+*	uint32_t *outVersion	version of the copy, 0 before the first call
+*
+*	Returns TRUE if the copy was updated.
+*/
+bool tuning_update(tuning_t *out, uint32_t *outVersion) {
+	// A single word, read without the lock
+	if(*outVersion == version) {
+		return FALSE;
+	}
+
+	chSysLock();
+	*out = values;
+	*outVersion = version;
+	chSysUnlock();
+
+	return TRUE;
+}
+
+
+/*
+*	Function to change a parameter.
+*
+*	params :
+*	const char *name	id of the parameter in the namespace /tuning
+*	float value			new value, rounded for the integer parameters
+*
+*	Returns FALSE if the parameter doesn't exist, the value is out of range or
+*	inconsistent with the other parameters.
+*/
+bool tuning_set(const char *name, float value) {
+	parameter_t *p = parameter_find(&tuning_ns, name);
+	uint8_t i = 0;
+	int32_t lastInteger = 0;
+	float lastScalar = 0;
+	bool valid;
+
+	while((i < TUNING_NB_PARAMS) && (p != &params[i].param)) {
+		i++;
+	}
+
+	if((i == TUNING_NB_PARAMS) || !(value >= params[i].min) || !(value <= params[i].max)) {
+		return FALSE;
+	}
+
+	chMtxLock(&tuning_lock);
+
+	if(params[i].integer) {
+		lastInteger = parameter_integer_read(p);
+		parameter_integer_set(p, (int32_t)(value + 0.5f));
+	} else {
+		lastScalar = parameter_scalar_read(p);
+		parameter_scalar_set(p, value);
+	}
+
+	// A rejected value is undone, the loops never see it
+	if(!(valid = tuning_refresh())) {
+		if(params[i].integer) {
+			parameter_integer_set(p, lastInteger);
+		} else {
+			parameter_scalar_set(p, lastScalar);
+		}
+	}
+
+	chMtxUnlock(&tuning_lock);
+
+	if(valid) {
+		tuning_report(i);
+	}
+
+	return valid;
+}
+
+
+/*
+*	Rebuilds the values from the parameters and applies the obstacle threshold, the
+*	caller holds the lock.
+*
+*	Returns FALSE, without any change, if the goal distances are inverted.
+*/
+static bool tuning_refresh(void) {
+	static const uint8_t frontSensors[] = {0, 1, 6, 7};
+	tuning_t next;
+	uint16_t lastDistObst = values.minDistObst;
+	uint8_t lastObstMode = values.obstMode;
+
+	next.kp = parameter_scalar_read(&params[TUNING_KP].param);
+	next.ki = parameter_scalar_read(&params[TUNING_KI].param);
+	next.kd = parameter_scalar_read(&params[TUNING_KD].param);
+	next.gameSpeed = parameter_integer_read(&params[TUNING_GAME_SPEED].param);
+	next.maxSumError = next.gameSpeed / next.ki;
+	next.minValueThreshold = parameter_integer_read(&params[TUNING_MIN_VALUE_THRESHOLD].param);
+	next.minDistObst = parameter_integer_read(&params[TUNING_MIN_DIST_OBST].param);
+	next.goalDistMin = parameter_integer_read(&params[TUNING_GOAL_DIST_MIN].param);
+	next.goalDistMax = parameter_integer_read(&params[TUNING_GOAL_DIST_MAX].param);
+	next.minLineWidth = parameter_integer_read(&params[TUNING_MIN_LINE_WIDTH].param);
+	next.selectorStableTime = parameter_integer_read(&params[TUNING_SELECTOR_STABLE].param);
+	next.tournament = parameter_integer_read(&params[TUNING_TOURNAMENT].param);
+	next.obstMode = parameter_integer_read(&params[TUNING_AVOIDANCE].param);
+
+	if(next.goalDistMin > next.goalDistMax) {
+		return FALSE;
+	}
+
+	chSysLock();
+	values = next;
+	version = (version == UINT32_MAX) ? 1 : version + 1;
+	chSysUnlock();
+
+	// The proximity sensors keep their own thresholds
+	if(next.minDistObst != lastDistObst) {
+		for(uint8_t i = 0; i < sizeof(frontSensors); i++) {
+			set_obst_threshold(frontSensors[i], next.minDistObst, OBST_HYSTERESIS);
+		}
+	}
+
+	if(next.obstMode != lastObstMode) {
+		set_obst_mode(next.obstMode);
+	}
+
+	return TRUE;
+}
+
+
+/*
+*	Sends the value of a parameter in the CAPTURE_PARAM stream.
+*/
+static void tuning_report(uint8_t i) {
+	tuning_report_t report;
+
+	memset(&report, 0, sizeof(report));
+	strncpy(report.name, params[i].id, TUNING_NAME_LEN - 1);
+
+	if(params[i].integer) {
+		report.value = parameter_integer_read(&params[i].param);
+	} else {
+		report.value = parameter_scalar_read(&params[i].param);
+	}
+
+	capture_send(CAPTURE_PARAM, &report, sizeof(report));
+}
+
+
+/*
+*	Executes a command line received on the USB serial :
+*	"set NAME VALUE"	changes a parameter, its new value is reported
+*	"get"				reports all the parameters
+*	"log"				exports the run log
+*	"capture STREAMS"	selects the recorded streams (bit field of capture_stream_t)
+*/
+static void tuning_command(char *line) {
+	char *name, *value, *end;
+	float f;
+	unsigned long streams;
+
+	if(strcmp(line, "get") == 0) {
+		for(uint8_t i = 0; i < TUNING_NB_PARAMS; i++) {
+			tuning_report(i);
+		}
+	} else if(strcmp(line, "log") == 0) {
+		run_log_export();
+	} else if(strncmp(line, "capture ", 8) == 0) {
+		streams = strtoul(line + 8, &end, 0);
+
+		if((end != line + 8) && (streams <= CAPTURE_ALL)) {
+			capture_set_streams(streams);
+		}
+	} else if(strncmp(line, "set ", 4) == 0) {
+		name = line + 4;
+		value = strchr(name, ' ');
+
+		if(value == NULL) {
+			return;
+		}
+
+		*value++ = '\0';
+
+		if(tuning_parse(value, &f)) {
+			tuning_set(name, f);
+		}
+	}
+}
+
+
+/*
+*	Reads a decimal number ("-12.5", "0.00999999978", "1e-05") without strtof, whose
+*	stack use doesn't fit the thread. The digits after the first TUNING_PARSE_DIGITS
+*	significant ones are ignored.
+*
+*	Returns FALSE if the text isn't a number.
+*/
+static bool tuning_parse(const char *text, float *value) {
+	uint32_t mantissa = 0;
+	int16_t exponent = 0, e = 0;
+	uint8_t digits = 0;
+	bool negative = FALSE, negativeExp = FALSE, found = FALSE, fraction = FALSE;
+	double scale = 1;
+
+	if((*text == '-') || (*text == '+')) {
+		negative = (*text++ == '-');
+	}
+
+	for(; ((*text >= '0') && (*text <= '9')) || ((*text == '.') && !fraction); text++) {
+		if(*text == '.') {
+			fraction = TRUE;
+			continue;
+		}
+
+		found = TRUE;
+
+		if(digits < TUNING_PARSE_DIGITS) {
+			mantissa = 10 * mantissa + (*text - '0');
+			exponent -= fraction;
+			digits += (mantissa > 0);
+		} else {
+			exponent += !fraction;
+		}
+	}
+
+	if(!found) {
+		return FALSE;
+	}
+
+	if((*text == 'e') || (*text == 'E')) {
+		text++;
+
+		if((*text == '-') || (*text == '+')) {
+			negativeExp = (*text++ == '-');
+		}
+
+		// Out of the range of every parameter beyond
+		for(; (*text >= '0') && (*text <= '9') && (e < 100); text++) {
+			e = 10 * e + (*text - '0');
+		}
+
+		exponent += negativeExp ? -e : e;
+	}
+
+	if(*text != '\0') {
+		return FALSE;
+	}
+
+	// The mantissas and the powers of 10 up to 1e22 are exact in a double
+	for(int16_t i = (exponent < 0) ? -exponent : exponent; i > 0; i--) {
+		scale *= 10;
+	}
+
+	*value = (exponent < 0) ? (mantissa / scale) : (mantissa * scale);
+	*value = negative ? -*value : *value;
+
+	return TRUE;
+}
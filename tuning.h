@@ -0,0 +1,47 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define TUNING_NAME_LEN			16		// Characters of the parameter names in the reports
+#define TUNING_LINE_LEN			48		// Max length of a command line on the USB serial
+#define TUNING_READ_TIMEOUT		100		// Max wait for a character in [ms]
+#define TUNING_PARSE_DIGITS		9		// Significant digits kept from a value of a command
+
+// Values of the parameters, copied by the loops with tuning_update() when they changed.
+// The defaults are the #defines of the modules.
+typedef struct {
+	float kp;
+	float ki;
+	float kd;
+	float maxSumError;			// GAME_SPEED / KI, updated with them (ARW)
+	int16_t gameSpeed;			// in [steps/s]
+	uint16_t minValueThreshold;	// intensity of the audio command
+	uint16_t minDistObst;		// proximity delta of the front sensors
+	uint16_t goalDistMin;		// in [mm]
+	uint16_t goalDistMax;		// in [mm]
+	uint16_t minLineWidth;		// in [pixels]
+	uint16_t selectorStableTime;	// in [ms]
+	bool tournament;			// see TOURNAMENT_MODE
+	uint8_t obstMode;			// obst_mode_t, applied with set_obst_mode
+} tuning_t;
+
+// Value of a parameter sent in the CAPTURE_PARAM stream after each change
+typedef struct __attribute__((packed)) {
+	char name[TUNING_NAME_LEN];
+	float value;
+} tuning_report_t;
+
+
+/*======================================================================================*/
+/* 								NEW FUNCTIONS DEFINED									*/
+/*======================================================================================*/
+void tuning_start(void);
+void tuning_get(tuning_t *values);
+bool tuning_update(tuning_t *values, uint32_t *version);
+bool tuning_set(const char *name, float value);
+
+
+#endif /* TUNING_H */